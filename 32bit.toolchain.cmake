@@ -1,8 +1,10 @@
 set(CMAKE_SYSTEM_NAME Linux)
 
+# Use SSE2 for floating-point operations, so that audio mixing
+# gives the same results as in 64-bit
 set(CMAKE_C_COMPILER gcc)
-set(CMAKE_C_FLAGS -m32)
+set(CMAKE_C_FLAGS "-m32 -msse2 -mfpmath=sse")
 set(CMAKE_CXX_COMPILER g++)
-set(CMAKE_CXX_FLAGS -m32)
+set(CMAKE_CXX_FLAGS "-m32 -msse2 -mfpmath=sse")
 set(CMAKE_SYSTEM_PROCESSOR "i686")
 
@@ -10,6 +10,36 @@ Usage ()
     echo "  -d, --dump FILE     Start a audio/video encode into the specified FILE"
     echo "  -r, --read MOVIE    Play game inputs from MOVIE file"
     echo "  -w, --write MOVIE   Record game inputs into the specified MOVIE file"
+    echo "  -n, --no-skip-draws Do not elide the game draw calls of frames that"
+    echo "                      are not displayed during fastforward"
+    echo "  -t, --trace FILE    Record a profiling trace of libTAS into FILE,"
+    echo "                      to be converted with build/trace2json"
+    echo "  -o, --logfile FILE  Write the libTAS logs into FILE instead of stderr"
+    echo "  -p, --profile FILE  Count the calls of hooked functions and write a"
+    echo "                      summary for each frame into FILE, in CSV format"
+    echo "  -m, --telemetry FILE  Write the telemetry of each frame into FILE,"
+    echo "                      in CSV format"
+    echo "  -g, --spin-margin US  When pacing frames, spin instead of sleeping"
+    echo "                      during the last US microseconds before the"
+    echo "                      frame deadline (default 1000)"
+    echo "  -a, --async-mix     Mix the audio of a frame in a separate thread,"
+    echo "                      while the game runs the next frame"
+    echo "  -q, --resample-quality N  Quality of the audio resampling: 0 for"
+    echo "                      nearest sample, 1 for linear interpolation,"
+    echo "                      2 for windowed sinc (default)"
+    echo "  -c, --video-encoder NAME  FFmpeg encoder of the video dump, like"
+    echo "                      ffv1, libx264 or mpeg4 (default)"
+    echo "  -C, --video-options OPTS  Options of the video encoder, as a list"
+    echo "                      of key=value separated by commas"
+    echo "  -k, --audio-encoder NAME  FFmpeg encoder of the audio dump, like"
+    echo "                      flac, libopus or pcm_s16le (default)"
+    echo "  -K, --audio-options OPTS  Options of the audio encoder"
+    echo "  -x, --raw-audio FILE  Do not encode the dump: write raw video frames"
+    echo "                      into the dump file and raw audio samples into"
+    echo "                      FILE, for an external encoder. Files can be"
+    echo "                      FIFOs, or fd:N for an inherited file descriptor"
+    echo "  -X, --raw-header    Write a RawFrameHeader before each raw video"
+    echo "                      frame (see src/libTAS/avdumping.h)"
     echo "  -l, --lib     PATH  Manually import a library"
     echo "  -L, --libpath PATH  Indicate a path to additional libraries the game"
     echo "                      will want to import."
@@ -21,6 +51,15 @@ Usage ()
 gamepath=
 movieopt=
 dumpopt=
+drawopt=
+traceopt=
+logopt=
+profileopt=
+telemetryopt=
+mixopt=
+marginopt=
+qualityopt=
+encoderopt=
 libdir=
 rundir=
 SHLIBS=
@@ -41,6 +80,45 @@ do
     -w | --write)   shift
                     movieopt="-w $1"
                     ;;
+    -n | --no-skip-draws) drawopt="-n"
+                    ;;
+    -t | --trace)   shift
+                    traceopt="-t $1"
+                    ;;
+    -o | --logfile) shift
+                    logopt="-o $1"
+                    ;;
+    -p | --profile) shift
+                    profileopt="-p $1"
+                    ;;
+    -m | --telemetry) shift
+                    telemetryopt="-m $1"
+                    ;;
+    -a | --async-mix) mixopt="-a"
+                    ;;
+    -g | --spin-margin) shift
+                    marginopt="-g $1"
+                    ;;
+    -q | --resample-quality) shift
+                    qualityopt="-q $1"
+                    ;;
+    -c | --video-encoder) shift
+                    encoderopt="${encoderopt} -c $1"
+                    ;;
+    -C | --video-options) shift
+                    encoderopt="${encoderopt} -C $1"
+                    ;;
+    -k | --audio-encoder) shift
+                    encoderopt="${encoderopt} -k $1"
+                    ;;
+    -K | --audio-options) shift
+                    encoderopt="${encoderopt} -K $1"
+                    ;;
+    -x | --raw-audio) shift
+                    encoderopt="${encoderopt} -x $1"
+                    ;;
+    -X | --raw-header) encoderopt="${encoderopt} -X"
+                    ;;
     -l | --lib)     shift
                     SHLIBS="${SHLIBS} -l $1"
                     ;;
@@ -94,6 +172,6 @@ cd - > /dev/null
 sleep 1
 
 # Launch the TAS program
-echo "./build/linTAS $SHLIBS $movieopt $dumpopt"
-./build/linTAS $SHLIBS $movieopt $dumpopt
+echo "./build/linTAS $SHLIBS $movieopt $dumpopt $drawopt $traceopt $logopt $profileopt $telemetryopt $marginopt $mixopt $qualityopt $encoderopt"
+./build/linTAS $SHLIBS $movieopt $dumpopt $drawopt $traceopt $logopt $profileopt $telemetryopt $marginopt $mixopt $qualityopt $encoderopt
 
@@ -26,12 +26,16 @@
 #include "time.h" // clock_gettime_real
 #include "audio/AudioContext.h"
 #include "ThreadState.h"
+#include "FramePacer.h"
 
 #define MAX_NONFRAME_GETTIMES 4000
 
+/* Count of getTicks calls from a non main thread since the last frame boundary */
+static thread_local unsigned int getTimes = 0;
+static thread_local unsigned long getTimesBoundary = 0;
+
 struct timespec DeterministicTimer::getTicks(TimeCallType type=TIMETYPE_UNTRACKED)
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FREQUENT);
 
     /* If we are in the native thread state, just return the real time */
@@ -55,6 +59,13 @@ struct timespec DeterministicTimer::getTicks(TimeCallType type=TIMETYPE_UNTRACKE
     if(!isFrameThread) {
         if(type != TIMETYPE_UNTRACKED) {
 
+            /* Reset our count if a frame boundary occured since our last call */
+            unsigned long currentBoundary = boundaryCount.load(std::memory_order_relaxed);
+            if (getTimesBoundary != currentBoundary) {
+                getTimesBoundary = currentBoundary;
+                getTimes = 0;
+            }
+
             /* Well, actually, if another thread get the time too many times,
              * we temporarily consider it as the main thread.
              * This can lead to desyncs, but it avoids freeze in games that
@@ -70,16 +81,15 @@ struct timespec DeterministicTimer::getTicks(TimeCallType type=TIMETYPE_UNTRACKE
         }
     }
 
-    if (isFrameThread)
+    if (isFrameThread && (type != TIMETYPE_UNTRACKED))
     {
-        /* Only do this in the main thread so as to not dirty the timer with nondeterministic values
-         * (not to mention it would be extremely multithreading-unsafe without using sync primitives otherwise)
-         */
+        /* Only do this in the frame thread so as to not dirty the timer with nondeterministic values */
 
         int ticksExtra = 0;
 
-        if (type != TIMETYPE_UNTRACKED)
         {
+            std::lock_guard<std::mutex> lock(mutex);
+
             debuglog(LCF_TIMESET | LCF_FREQUENT, "subticks ", type, " increased");
             altGetTimes[type]++;
 
@@ -93,6 +103,7 @@ struct timespec DeterministicTimer::getTicks(TimeCallType type=TIMETYPE_UNTRACKE
                 debuglog(LCF_TIMESET | LCF_FREQUENT, "WARNING! force-advancing time of type ", type);
 
                 ticksExtra += tickDelta;
+                forcedAdvances.fetch_add(1, std::memory_order_relaxed);
 
                 /* Reseting the number of calls from all functions */
                 for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
@@ -108,14 +119,69 @@ struct timespec DeterministicTimer::getTicks(TimeCallType type=TIMETYPE_UNTRACKE
         }
     }
 
-    TimeHolder fakeTicks = ticks + fakeExtraTicks;
+    TimeHolder fakeTicks = readTicks();
     return *(struct timespec*)&fakeTicks;
 }
 
+void DeterministicTimer::publishTicks(void)
+{
+    TimeHolder fakeTicks = ticks + fakeExtraTicks;
+
+    unsigned int seq = ticksSeq.load(std::memory_order_relaxed);
+    ticksSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    publishedSec.store(fakeTicks.tv_sec, std::memory_order_relaxed);
+    publishedNsec.store(fakeTicks.tv_nsec, std::memory_order_relaxed);
+
+    ticksSeq.store(seq + 2, std::memory_order_release);
+
+    /* Wake up the threads waiting for a deadline */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        waitCond.notify_all();
+    }
+}
+
+TimeHolder DeterministicTimer::readTicks(void)
+{
+    TimeHolder fakeTicks;
+    unsigned int seq0, seq1;
+
+    do {
+        seq0 = ticksSeq.load(std::memory_order_acquire);
+        fakeTicks.tv_sec = publishedSec.load(std::memory_order_relaxed);
+        fakeTicks.tv_nsec = publishedNsec.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq1 = ticksSeq.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) || (seq0 != seq1));
+
+    return fakeTicks;
+}
+
+void DeterministicTimer::waitTicks(TimeHolder deadline, TimeHolder realDeadline)
+{
+    std::chrono::steady_clock::time_point realTimePoint(
+        std::chrono::seconds(realDeadline.tv_sec) +
+        std::chrono::nanoseconds(realDeadline.tv_nsec));
+
+    std::unique_lock<std::mutex> lock(waitMutex);
+    waiters.fetch_add(1);
+
+    /* The condition variable uses the real clock and wait functions */
+    threadState.setNative(true);
+    while (deadline > readTicks()) {
+        if (waitCond.wait_until(lock, realTimePoint) == std::cv_status::timeout)
+            break;
+    }
+    threadState.setNative(false);
+
+    waiters.fetch_sub(1);
+}
 
 void DeterministicTimer::addDelay(struct timespec delayTicks)
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     debuglog(LCF_TIMESET | LCF_SLEEP, __func__, " call with delay ", delayTicks.tv_sec * 1000000000 + delayTicks.tv_nsec, " nsec");
 
     if(tasflags.framerate == 0) // 0 framerate means disable deterministic timer
@@ -132,11 +198,13 @@ void DeterministicTimer::addDelay(struct timespec delayTicks)
      * otherwise it could easily build up and make us freeze (in some games)
      */
 
-    TimeHolder maxDeferredDelay = timeIncrement * 6;
-
-    addedDelay += *(TimeHolder*)&delayTicks;
-    ticks += *(TimeHolder*)&delayTicks;
-    forceAdvancedTicks += *(TimeHolder*)&delayTicks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        addedDelay += *(TimeHolder*)&delayTicks;
+        ticks += *(TimeHolder*)&delayTicks;
+        forceAdvancedTicks += *(TimeHolder*)&delayTicks;
+        publishTicks();
+    }
 
     if(!tasflags.fastforward)
     {
@@ -145,12 +213,19 @@ void DeterministicTimer::addDelay(struct timespec delayTicks)
         nanosleep_real(&nosleep, NULL);
     }
 
-    while(addedDelay > maxDeferredDelay)
+    while(1)
     {
-        /* Indicating that the following frame boundary is not
-         * a normal (draw) frame boundary.
-         */
-        drawFB = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            TimeHolder maxDeferredDelay = timeIncrement * 6;
+            if (!(addedDelay > maxDeferredDelay))
+                break;
+
+            /* Indicating that the following frame boundary is not
+             * a normal (draw) frame boundary.
+             */
+            drawFB = false;
+        }
 
         /* We have built up too much delay. We must enter a frame boundary,
          * to advance the time.
@@ -163,9 +238,10 @@ void DeterministicTimer::addDelay(struct timespec delayTicks)
 
 void DeterministicTimer::exitFrameBoundary()
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FRAME);
 
+    std::lock_guard<std::mutex> lock(mutex);
+
     /* Reset the counts of each time get function */
     for(int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
         altGetTimes[i] = 0;
@@ -173,7 +249,8 @@ void DeterministicTimer::exitFrameBoundary()
     if(tasflags.framerate == 0)
         return nonDetTimer.exitFrameBoundary(); // 0 framerate means disable deterministic timer
 
-    getTimes = 0;
+    /* Reset the counts of calls from other threads */
+    boundaryCount.fetch_add(1, std::memory_order_relaxed);
 
     if(addedDelay > timeIncrement)
         addedDelay -= timeIncrement;
@@ -186,7 +263,6 @@ void DeterministicTimer::exitFrameBoundary()
 
 void DeterministicTimer::enterFrameBoundary()
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FRAME);
 
     if(tasflags.framerate == 0)
@@ -194,6 +270,8 @@ void DeterministicTimer::enterFrameBoundary()
 
     /*** First we update the state of the internal timer ***/
 
+    std::unique_lock<std::mutex> lock(mutex);
+
     /* We compute by how much we should advance the timer
      * to run exactly as the indicated framerate
      */
@@ -230,56 +308,47 @@ void DeterministicTimer::enterFrameBoundary()
         TimeHolder deltaTicks = timeIncrement - takenTicks;
         ticks += deltaTicks;
         debuglog(LCF_TIMESET | LCF_FRAME, __func__, " added ", deltaTicks.tv_sec * 1000000000 + deltaTicks.tv_nsec, " nsec");
+        publishTicks();
     }
 
+    TimeHolder increment = timeIncrement;
+    lock.unlock();
+
     /* Doing the audio mixing here */
-    audiocontext.mixAllSources(*(struct timespec*)&timeIncrement);
+    audiocontext.mixAllSources(*(struct timespec*)&increment);
 
     /*** Then, we sleep the right amount of time so that the game runs at normal speed ***/
 
-    /* Get the current actual time */
-    TimeHolder currentTime;
-    clock_gettime_real(CLOCK_MONOTONIC, (struct timespec*)&currentTime);
-
-    /* calculate the target time we wanted to be at now */
-    /* TODO: This is where we would implement slowdown */
-    TimeHolder desiredTime = lastEnterTime + timeIncrement;
-
-    TimeHolder deltaTime = desiredTime - currentTime;
-
-    /* If we are not fast forwarding, and not the first frame,
-     * then we wait the delta amount of time.
+    /* If we are not fast forwarding, not running at unbounded speed,
+     * and not the first frame, then we wait until the end of the frame,
+     * taking into account the speed of the game.
      */
-    if (!tasflags.fastforward && lastEnterValid) {
-
-        /* Check that we wait for a positive time */
-        if ((deltaTime.tv_sec > 0) || ((deltaTime.tv_sec == 0) && (deltaTime.tv_nsec >= 0))) {
-            nanosleep_real((struct timespec*)&deltaTime, NULL);
-        }
-    }
-
-    /* 
-     * WARNING: This time update is not done in Hourglass,
-     * maybe intentionally (the author does not remember).
-     */
-    clock_gettime_real(CLOCK_MONOTONIC, (struct timespec*)&currentTime);
-
-    lastEnterTime = currentTime;
+    bool unbounded = (tasflags.speed_multiplier <= 0) || (tasflags.speed_divisor <= 0);
+    if (!tasflags.fastforward && !unbounded && lastEnterValid)
+        framePacer.wait(increment.scale(tasflags.speed_divisor, tasflags.speed_multiplier));
+    else
+        framePacer.resync();
 
+    lock.lock();
     lastEnterTicks = ticks;
     lastEnterValid = true;
 }
 
 void DeterministicTimer::fakeAdvanceTimer(struct timespec extraTicks) {
+    std::lock_guard<std::mutex> lock(mutex);
     fakeExtraTicks = *(TimeHolder*) &extraTicks;
+    publishTicks();
 }
 
 void DeterministicTimer::initialize(void)
 {
-    getTimes = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    boundaryCount = 0;
+    ticksSeq = 0;
     ticks = {0, 0};
     fractional_part = 0;
-    clock_gettime_real(CLOCK_MONOTONIC, (struct timespec*)&lastEnterTime);
+    framePacer.resync();
     lastEnterTicks = ticks;
 
     for(int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
@@ -288,11 +357,19 @@ void DeterministicTimer::initialize(void)
         altGetTimeLimits[i] = 100;
 
     forceAdvancedTicks = {0, 0};
+    forcedAdvances = 0;
     addedDelay = {0, 0};
     fakeExtraTicks = {0, 0};
     lastEnterValid = false;
 
     drawFB = true;
+
+    publishTicks();
+}
+
+unsigned int DeterministicTimer::popForcedAdvances(void)
+{
+    return forcedAdvances.exchange(0, std::memory_order_relaxed);
 }
 
 DeterministicTimer detTimer;
@@ -23,6 +23,8 @@
 #include <time.h>
 #include "TimeHolder.h"
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 /* An enum indicating which time-getting function query the time */
 enum TimeCallType
@@ -49,6 +51,11 @@ enum TimeCallType
  * we define a frame rate beforehand and always tell the game it is running that fast
  * from frame to frame. Then we do the waiting ourselves for each frame (using system timer).
  * this also lets us support "fast forward" without changing the values the game sees.
+ *
+ * Only the frame thread advances the timer. Other threads read a snapshot of
+ * the timer value, protected by a seqlock, so they never take a lock.
+ * Modifications of the timer state are serialized by a mutex, in case
+ * another thread is temporarily considered as the frame thread.
  */
 
 class DeterministicTimer
@@ -79,10 +86,35 @@ public:
      */
     void fakeAdvanceTimer(struct timespec extraTicks);
 
+    /* Wait, from a thread that does not advance the timer, until the timer
+     * reaches a deadline, or until a real (monotonic) time deadline.
+     * Waiting threads are woken up each time the timer is advanced.
+     */
+    void waitTicks(TimeHolder deadline, TimeHolder realDeadline);
+
+    /* Return the number of times the timer was force-advanced
+     * since the last call */
+    unsigned int popForcedAdvances(void);
+
 private:
 
-    /* Number of getTicks calls of a non main thread */
-    unsigned int getTimes;
+    /* Publish the current timer value for the other threads.
+     * Must be called with the mutex locked. */
+    void publishTicks(void);
+
+    /* Read the published timer value */
+    TimeHolder readTicks(void);
+
+    /* Number of frame boundaries, used to reset the per-thread counts
+     * of getTicks calls from a non main thread */
+    std::atomic<unsigned long> boundaryCount;
+
+    /* Seqlock protecting the published timer value: odd while being written */
+    std::atomic<unsigned int> ticksSeq;
+
+    /* Published timer value (ticks + fakeExtraTicks) */
+    std::atomic<time_t> publishedSec;
+    std::atomic<long> publishedNsec;
 
     /* By how much time did we increment the timer */
     TimeHolder timeIncrement;
@@ -102,13 +134,7 @@ private:
      */
     TimeHolder fakeExtraTicks;
 
-    /* 
-     * Real time of the last frame boundary enter.
-     * Used for sleeping the right amount of time
-     */
-    TimeHolder lastEnterTime;
-
-    /* Is the lastEnterTime value valid?
+    /* Did we already enter a frame boundary?
      * True except on the first frame
      */
     bool lastEnterValid;
@@ -131,8 +157,16 @@ private:
     unsigned int altGetTimes [TIMETYPE_NUMTRACKEDTYPES];
     unsigned int altGetTimeLimits [TIMETYPE_NUMTRACKEDTYPES];
 
-    /* Mutex to protect access to all audio objects */
+    /* Number of times the timer was force-advanced, for telemetry */
+    std::atomic<unsigned int> forcedAdvances;
+
+    /* Mutex to serialize modifications of the timer state */
     std::mutex mutex;
+
+    /* Threads waiting for the timer to reach a deadline */
+    std::mutex waitMutex;
+    std::condition_variable waitCond;
+    std::atomic<int> waiters;
 };
 
 extern DeterministicTimer detTimer;
@@ -223,6 +223,11 @@ void EventQueue::flush(Uint32 minType, Uint32 maxType)
     }
 }
 
+int EventQueue::size(void)
+{
+    return eventQueue.size();
+}
+
 void EventQueue::flush(Uint32 mask)
 {
     std::list<void*>::iterator it = eventQueue.begin();
@@ -52,6 +52,9 @@ class EventQueue
         void flush(Uint32 mask);
         void flush(Uint32 minType, Uint32 maxType);
 
+        /* Number of events in the queue */
+        int size(void);
+
         /* Enable an event type to be inserted */
         void enable(int type);
         /* Disable an event type to be inserted */
@@ -0,0 +1,99 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FramePacer.h"
+#include "time.h" // clock_gettime_real, nanosleep_real
+#include "logging.h"
+#include "../shared/tasflags.h"
+#include "trace.h"
+
+FramePacer framePacer;
+
+static inline void cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+void FramePacer::resync(void)
+{
+    scheduled = false;
+}
+
+void FramePacer::wait(TimeHolder period)
+{
+    TRACE_SCOPE("Frame pacing");
+    TimeHolder currentTime;
+    clock_gettime_real(CLOCK_MONOTONIC, (struct timespec*)&currentTime);
+
+    if (!scheduled) {
+        /* Start a new schedule from now */
+        deadline = currentTime + period;
+        scheduled = true;
+        return;
+    }
+
+    /* If we are late by more than a frame (e.g. the game was paused,
+     * or a frame took too long), don't try to catch up, start a new
+     * schedule instead.
+     */
+    TimeHolder lateDeadline = deadline + period;
+    if (currentTime > lateDeadline) {
+        deadline = currentTime + period;
+        return;
+    }
+
+    /* Sleep until the spin margin before the deadline */
+    TimeHolder margin;
+    margin.tv_sec = tasflags.pacing_spin_margin / 1000000;
+    margin.tv_nsec = (tasflags.pacing_spin_margin % 1000000) * 1000;
+    TimeHolder sleepDeadline = deadline - margin;
+
+    if (sleepDeadline > currentTime) {
+        TimeHolder sleepTime = sleepDeadline - currentTime;
+        nanosleep_real((struct timespec*)&sleepTime, NULL);
+    }
+
+    /* Then spin until the deadline */
+    do {
+        clock_gettime_real(CLOCK_MONOTONIC, (struct timespec*)&currentTime);
+        if (!(deadline > currentTime))
+            break;
+        cpu_relax();
+    } while (1);
+
+    /* Record the jitter */
+    TimeHolder delay = currentTime - deadline;
+    long long int delay_ns = (long long int)delay.tv_sec * 1000000000 + delay.tv_nsec;
+    jitter = (delay_ns > UINT32_MAX) ? UINT32_MAX : delay_ns;
+    paced = true;
+
+    /* Schedule the next frame from the deadline and not from
+     * the current time, so that the delays do not accumulate */
+    deadline += period;
+}
+
+bool FramePacer::popJitter(uint32_t* jitter_ns)
+{
+    bool wasPaced = paced;
+    *jitter_ns = jitter;
+    paced = false;
+    return wasPaced;
+}
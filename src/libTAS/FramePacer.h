@@ -0,0 +1,65 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_FRAMEPACER_H_INCL
+#define LIBTAS_FRAMEPACER_H_INCL
+
+#include "TimeHolder.h"
+#include <stdint.h>
+
+/* Wait until the real time of each frame, following an absolute schedule
+ * so that small delays do not accumulate over frames.
+ *
+ * To get a precise wake up time despite the scheduler latency, we sleep
+ * until some margin before the deadline (TasFlags::pacing_spin_margin),
+ * then spin on the monotonic clock until the deadline.
+ *
+ * The difference between the actual wake up time and the deadline is
+ * sent with the frame telemetry, and linTAS builds its histogram.
+ */
+
+class FramePacer
+{
+    public:
+        /* Forget the schedule, the next frame will start a new one */
+        void resync(void);
+
+        /* Wait until the deadline of the current frame, then schedule
+         * the next frame deadline period later */
+        void wait(TimeHolder period);
+
+        /* Get the wake up delay after the deadline of the last wait,
+         * in ns. Returns false if no frame was paced since the last call */
+        bool popJitter(uint32_t* jitter_ns);
+
+    private:
+        /* Wake up delay of the last paced frame */
+        uint32_t jitter = 0;
+        bool paced = false;
+
+        /* Real time at which the current frame should end */
+        TimeHolder deadline;
+
+        /* Is the deadline valid? */
+        bool scheduled = false;
+};
+
+extern FramePacer framePacer;
+
+#endif
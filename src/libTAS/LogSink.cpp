@@ -0,0 +1,243 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LogSink.h"
+#include "time.h" // nanosleep_real
+#include "ThreadState.h"
+#include "threads.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/* Delay between two writes of the buffers, in nanoseconds */
+#define LOGSINK_WRITE_PERIOD 5000000
+
+LogSink logSink;
+
+static thread_local void* ownBuffer = nullptr;
+
+/* Was the buffer of this thread released. Logs from the thread after
+ * that are written directly */
+static thread_local bool bufferReleased = false;
+
+void LogSink::openFile(const char* filename)
+{
+    int newfd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (newfd < 0) {
+        std::string err = std::string("Could not open log file ") + filename + "\n";
+        writeAll(err.c_str(), err.size());
+        return;
+    }
+    fd = newfd;
+    isTerm = -1;
+}
+
+bool LogSink::isTerminal(void)
+{
+    if (isTerm < 0)
+        isTerm = isatty(fd);
+    return isTerm;
+}
+
+void LogSink::start(void)
+{
+    if (running)
+        return;
+
+    static bool atforkRegistered = false;
+    if (!atforkRegistered) {
+        pthread_atfork(nullptr, nullptr, atforkChild);
+        pthread_key_create(&bufferKey, releaseBuffer);
+        atforkRegistered = true;
+    }
+
+    running = true;
+    /* The writer thread is ours, so we do not go through our hook */
+    if (pthread_create_real(&writerThread, nullptr, writerLoop, this) != 0)
+        running = false;
+}
+
+void LogSink::stop(void)
+{
+    if (!running)
+        return;
+
+    running = false;
+    pthread_join_real(writerThread, nullptr);
+    flush();
+}
+
+void LogSink::atforkChild(void)
+{
+    /* The writer thread does not exist in the child process */
+    logSink.running = false;
+
+    /* Only the forking thread exists in the child process, so all buffers
+     * are free again. Their pending lines are written by the parent.
+     * A buffer locked by another thread at the time of the fork stays
+     * locked forever, so it is abandoned. */
+    int count = logSink.bufferCount.load();
+    for (int b = 0; b < count; b++) {
+        ThreadBuffer* buffer = logSink.buffers[b].load(std::memory_order_acquire);
+        if (!buffer)
+            continue;
+        if (!buffer->mutex.try_lock()) {
+            logSink.buffers[b].store(nullptr, std::memory_order_release);
+            continue;
+        }
+        buffer->lines.clear();
+        buffer->used.store(false);
+        buffer->mutex.unlock();
+    }
+    logSink.droppedLines = 0;
+
+    ownBuffer = nullptr;
+    bufferReleased = false;
+    pthread_setspecific(logSink.bufferKey, nullptr);
+}
+
+void LogSink::releaseBuffer(void* arg)
+{
+    ThreadBuffer* buffer = static_cast<ThreadBuffer*>(arg);
+    ownBuffer = nullptr;
+    bufferReleased = true;
+
+    /* Write the remaining lines before another thread can append its own */
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        logSink.writeAll(buffer->lines.c_str(), buffer->lines.size());
+        buffer->lines.clear();
+    }
+    buffer->used.store(false);
+}
+
+LogSink::ThreadBuffer* LogSink::threadBuffer(void)
+{
+    if (ownBuffer)
+        return static_cast<ThreadBuffer*>(ownBuffer);
+    if (bufferReleased)
+        return nullptr;
+
+    /* Reuse the buffer of a thread that exited */
+    ThreadBuffer* buffer = nullptr;
+    int count = bufferCount.load();
+    for (int b = 0; b < count; b++) {
+        bool used = false;
+        ThreadBuffer* candidate = buffers[b].load(std::memory_order_acquire);
+        if (candidate && candidate->used.compare_exchange_strong(used, true)) {
+            buffer = candidate;
+            break;
+        }
+    }
+
+    if (!buffer) {
+        int index = bufferCount.load();
+        do {
+            if (index >= LOGSINK_MAX_THREADS)
+                return nullptr;
+        } while (!bufferCount.compare_exchange_weak(index, index + 1));
+
+        buffer = new ThreadBuffer;
+        buffer->used.store(true);
+        buffers[index].store(buffer, std::memory_order_release);
+    }
+
+    /* Release the buffer when the thread exits. The main thread keeps
+     * it, as key destructors are not called when the process exits */
+    pthread_setspecific(bufferKey, buffer);
+    ownBuffer = buffer;
+    return buffer;
+}
+
+void LogSink::write(const std::string& line, bool urgent)
+{
+    ThreadBuffer* buffer = nullptr;
+    if (running)
+        buffer = threadBuffer();
+
+    if (!buffer) {
+        writeAll(line.c_str(), line.size());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    if (urgent) {
+        buffer->lines += line;
+        writeAll(buffer->lines.c_str(), buffer->lines.size());
+        buffer->lines.clear();
+        return;
+    }
+
+    if ((buffer->lines.size() + line.size()) > LOGSINK_MAX_BUFFER_SIZE) {
+        droppedLines++;
+        return;
+    }
+    buffer->lines += line;
+}
+
+void LogSink::flush(void)
+{
+    std::string batch;
+    int count = bufferCount.load();
+    for (int b = 0; b < count; b++) {
+        /* The buffer may not be stored yet */
+        ThreadBuffer* buffer = buffers[b].load(std::memory_order_acquire);
+        if (!buffer)
+            continue;
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        batch += buffer->lines;
+        buffer->lines.clear();
+    }
+
+    unsigned int dropped = droppedLines.exchange(0);
+    if (dropped > 0)
+        batch += std::to_string(dropped) + " log lines were dropped\n";
+
+    if (!batch.empty())
+        writeAll(batch.c_str(), batch.size());
+}
+
+void LogSink::writeAll(const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t ret = ::write(fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        data += ret;
+        size -= ret;
+    }
+}
+
+void* LogSink::writerLoop(void* arg)
+{
+    LogSink* sink = static_cast<LogSink*>(arg);
+
+    /* This thread only uses real functions and must never log */
+    threadState.setNative(true);
+
+    struct timespec period = {0, LOGSINK_WRITE_PERIOD};
+    while (sink->running) {
+        nanosleep_real(&period, nullptr);
+        sink->flush();
+    }
+    return nullptr;
+}
@@ -0,0 +1,123 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_LOGSINK_H_INCL
+#define LIBTAS_LOGSINK_H_INCL
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <pthread.h>
+
+/* Maximum number of threads that can have a log buffer at the same time */
+#define LOGSINK_MAX_THREADS 256
+
+/* Maximum size of the pending lines of a thread, in bytes. Lines that
+ * would exceed it are dropped and counted */
+#define LOGSINK_MAX_BUFFER_SIZE (1 << 20)
+
+/* Destination of the log messages.
+ *
+ * Once started, each thread appends its log lines into its own buffer,
+ * and a background thread regularly writes all buffers to the output
+ * (a file or stderr) in batches. The game threads never wait for the
+ * output. Lines of a same thread stay in order, but lines of different
+ * threads are only ordered by batch.
+ *
+ * When a thread exits, its buffer is given to the next new thread, after
+ * its remaining lines are written. When the writer thread cannot keep up,
+ * lines are dropped and the number of dropped lines is written instead.
+ *
+ * Before starting, after stopping, or in a forked process, lines are
+ * written directly. Error messages are also written directly, so that
+ * they are not lost if the game crashes.
+ *
+ * The members are trivially destructible on purpose, because we still log
+ * in our library destructor, after static objects are destroyed.
+ */
+
+class LogSink
+{
+    public:
+        /* Write the logs into a file instead of stderr */
+        void openFile(const char* filename);
+
+        /* Is the output a terminal? Cached, because it is checked
+         * for each line to know if we print colors */
+        bool isTerminal(void);
+
+        /* Start the writer thread */
+        void start(void);
+
+        /* Write all pending lines and stop the writer thread */
+        void stop(void);
+
+        /* Output a log line. If urgent, it is written immediately
+         * along with the pending lines of the calling thread */
+        void write(const std::string& line, bool urgent);
+
+    private:
+        struct ThreadBuffer {
+            std::mutex mutex;
+            std::string lines;
+
+            /* Is the buffer owned by a running thread */
+            std::atomic<bool> used;
+        };
+
+        /* Get the buffer of the calling thread, or nullptr */
+        ThreadBuffer* threadBuffer(void);
+
+        /* Write all buffers into the output */
+        void flush(void);
+
+        /* Write a full string into the output */
+        void writeAll(const char* data, size_t size);
+
+        static void* writerLoop(void* arg);
+
+        static void atforkChild(void);
+
+        /* Give back the buffer of an exiting thread */
+        static void releaseBuffer(void* arg);
+
+        /* Buffers are published after being constructed, so that the
+         * writer thread never sees a partially constructed one */
+        std::atomic<ThreadBuffer*> buffers[LOGSINK_MAX_THREADS];
+        std::atomic<int> bufferCount;
+
+        /* Number of lines dropped since the last write */
+        std::atomic<unsigned int> droppedLines;
+
+        /* Key whose destructor releases the buffer of a thread */
+        pthread_key_t bufferKey;
+
+        std::atomic<bool> running;
+        pthread_t writerThread;
+
+        /* Output file descriptor, stderr by default */
+        int fd = 2;
+
+        /* Cached result of isatty, or -1 if unknown */
+        int isTerm = -1;
+};
+
+extern LogSink logSink;
+
+#endif
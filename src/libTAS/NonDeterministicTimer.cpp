@@ -56,10 +56,6 @@ struct timespec NonDeterministicTimer::getTicks(void)
         /* Compute the difference from the last call */
         TimeHolder delta = realtime - lasttime;
 
-        if(tasflags.fastforward) { // fast-forward
-            delta = delta * 3; // arbitrary
-        }
-
         /* If we paused at a frame boudary, we should not count that time */
         TimeHolder frameBoundaryDur = lastExitTime - lastEnterTime;
 
@@ -76,6 +72,13 @@ struct timespec NonDeterministicTimer::getTicks(void)
             lastEnterTime = lastExitTime;
         }
 
+        /* Apply the speed of the game to the elapsed time. When fast-forwarding
+         * or running at unbounded speed, the delays are not slept but directly
+         * added to the timer (see addDelay), so the elapsed time is kept as is.
+         */
+        if (!isUnbounded())
+            delta = delta.scale(tasflags.speed_multiplier, tasflags.speed_divisor);
+
         ticks += delta;
         debuglog(LCF_TIMESET|LCF_FREQUENT, __func__, " added ", delta.tv_sec * 1000000000 + delta.tv_nsec, " nsec ");
 
@@ -110,12 +113,21 @@ void NonDeterministicTimer::addDelay(struct timespec delayTicks)
 {
     DEBUGLOGCALL(LCF_SLEEP | LCF_FREQUENT);
 
-    if (tasflags.fastforward) {
-        delayTicks.tv_sec = 0;
-        delayTicks.tv_nsec = 0;
+    /* Don't sleep and advance the timer instead, so that the game
+     * runs as fast as it can */
+    if (isUnbounded()) {
+        ticks += *(TimeHolder*)&delayTicks;
+        return;
     }
-    
-    nanosleep_real(&delayTicks, NULL);
+
+    /* Sleep the delay at the speed of the game */
+    TimeHolder realDelay = ((TimeHolder*)&delayTicks)->scale(tasflags.speed_divisor, tasflags.speed_multiplier);
+    nanosleep_real((struct timespec*)&realDelay, NULL);
+}
+
+bool NonDeterministicTimer::isUnbounded(void)
+{
+    return tasflags.fastforward || (tasflags.speed_multiplier <= 0) || (tasflags.speed_divisor <= 0);
 }
 
 NonDeterministicTimer nonDetTimer;
@@ -62,6 +62,10 @@ public:
     void addDelay(struct timespec delayTicks);
 
 private:
+    /* Are we running without any frame pacing
+     * (fast-forward or unbounded speed) */
+    bool isUnbounded(void);
+
     /* Current time of the timer */
     TimeHolder ticks;
 
@@ -34,6 +34,18 @@ TimeHolder TimeHolder::shiftadd(TimeHolder& pow, TimeHolder& mult, int m)
     return shiftadd(pow, mult, m);
 }
 
+TimeHolder TimeHolder::scale(int num, int den) const
+{
+    long long int nsec = (long long int)this->tv_sec * 1000000000LL + this->tv_nsec;
+    nsec = nsec * num / den;
+
+    TimeHolder scaled;
+    scaled.tv_sec = nsec / 1000000000LL;
+    scaled.tv_nsec = nsec % 1000000000LL;
+    scaled.normalize();
+    return scaled;
+}
+
 void TimeHolder::normalize()
 {
     if (this->tv_nsec < 0) {
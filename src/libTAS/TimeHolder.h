@@ -36,12 +36,8 @@ public:
     long int tv_sec;
     long int tv_nsec;
 
-    TimeHolder &operator=(const TimeHolder& th)
-    {
-        this->tv_sec = th.tv_sec;
-        this->tv_nsec = th.tv_nsec;
-        return *this;
-    }
+    /* Copies and assignments are the implicit ones, which keep the
+     * class POD and avoid deprecated implicit copies */
 
     TimeHolder operator+(const TimeHolder& th)
     {
@@ -90,6 +86,9 @@ public:
         return ((this->tv_sec > th.tv_sec) || ((this->tv_sec == th.tv_sec) && (this->tv_nsec > th.tv_nsec)));
     }
 
+    /* Multiply the time by the ratio num / den */
+    TimeHolder scale(int num, int den) const;
+
     /* Use a shift and add algorithm for multiplying a TimeHolder
      * by an integer, so that we should never overflow the tv_nsec value
      */
@@ -0,0 +1,140 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TimedWait.h"
+#include "DeterministicTimer.h"
+#include "time.h" // clock_gettime_real, nanosleep_real
+#include "threads.h"
+#include "ThreadState.h"
+#include "global.h" // libTAS_init
+#include "../shared/tasflags.h"
+
+/* Longest real-time slice when the game time may run faster than real time */
+#define MAX_SLICE_NSEC 1000000
+
+static TimeHolder gameTime(void)
+{
+    struct timespec ts = detTimer.getTicks(TIMETYPE_UNTRACKED);
+    return *(TimeHolder*)&ts;
+}
+
+static TimeHolder realTime(void)
+{
+    TimeHolder ts;
+    clock_gettime_real(CLOCK_MONOTONIC, (struct timespec*)&ts);
+    return ts;
+}
+
+/* Can the game time advance faster than the real time? */
+static bool fastGameTime(void)
+{
+    if (isMainThread())
+        /* The game time does not advance while the frame thread waits */
+        return false;
+
+    return tasflags.fastforward || (tasflags.speed_multiplier <= 0) ||
+        (tasflags.speed_multiplier > tasflags.speed_divisor);
+}
+
+bool useGameTime(void)
+{
+    return libTAS_init && !threadState.isNative() && !threadState.isOwnCode();
+}
+
+TimedWait::TimedWait(struct timespec time, bool absolute)
+{
+    TimeHolder now = gameTime();
+    TimeHolder timeout = {0, 0};
+
+    if (absolute) {
+        deadline = *(TimeHolder*)&time;
+        if (deadline > now)
+            timeout = deadline - now;
+    }
+    else {
+        timeout = *(TimeHolder*)&time;
+        deadline = now + timeout;
+    }
+
+    /* The game time goes slower or faster than real time
+     * depending on the game speed */
+    if ((tasflags.speed_multiplier > 0) && (tasflags.speed_divisor > 0))
+        timeout = timeout.scale(tasflags.speed_divisor, tasflags.speed_multiplier);
+
+    realDeadline = realTime() + timeout;
+    tried = false;
+}
+
+bool TimedWait::nextSlice(struct timespec* slice)
+{
+    TimeHolder realNow = realTime();
+    bool timedout = !(realDeadline > realNow) || !(deadline > gameTime());
+
+    if (timedout) {
+        if (tried)
+            return false;
+
+        /* Try the function once without waiting */
+        tried = true;
+        slice->tv_sec = 0;
+        slice->tv_nsec = 0;
+        return true;
+    }
+
+    tried = true;
+    TimeHolder realRemaining = realDeadline - realNow;
+    TimeHolder maxSlice = {0, MAX_SLICE_NSEC};
+    if (fastGameTime() && (realRemaining > maxSlice))
+        realRemaining = maxSlice;
+
+    *slice = *(struct timespec*)&realRemaining;
+    return true;
+}
+
+struct timespec TimedWait::remaining(void)
+{
+    TimeHolder now = gameTime();
+    TimeHolder left = {0, 0};
+    if (deadline > now)
+        left = deadline - now;
+    return *(struct timespec*)&left;
+}
+
+void TimedWait::sleep(void)
+{
+    if (tasflags.framerate == 0) {
+        /* The non deterministic timer follows the real time */
+        TimeHolder realNow = realTime();
+        if (realDeadline > realNow) {
+            TimeHolder realRemaining = realDeadline - realNow;
+            nanosleep_real((struct timespec*)&realRemaining, NULL);
+        }
+        return;
+    }
+
+    detTimer.waitTicks(deadline, realDeadline);
+}
+
+struct timespec TimedWait::sliceEnd(clockid_t clock, struct timespec slice)
+{
+    TimeHolder end;
+    clock_gettime_real(clock, (struct timespec*)&end);
+    end += *(TimeHolder*)&slice;
+    return *(struct timespec*)&end;
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_TIMEDWAIT_H_INCL
+#define LIBTAS_TIMEDWAIT_H_INCL
+
+#include <time.h>
+#include "TimeHolder.h"
+
+/* Convert the timeout of a sleep or a wait function called by the game
+ * into a timeout on the deterministic timer.
+ *
+ * The wait ends when the game time reaches the deadline, or when the
+ * timeout has elapsed in real time (adjusted by the game speed). The real
+ * time limit ensures that we never freeze when the frame thread itself is
+ * waiting for this thread, because the game time cannot advance then.
+ *
+ * Blocking functions (condition variables, semaphores, poll, etc.) are
+ * called with a real-time slice returned by nextSlice(), until the
+ * function succeeds or the wait times out. When the game time may advance
+ * faster than the real time (fast-forward, speed above 1x), slices are
+ * kept short so that we quickly notice that the game time passed the
+ * deadline.
+ */
+
+/* Should a sleep or a wait from the calling thread follow the game time?
+ * This is false for our own code, and before our initialization.
+ */
+bool useGameTime(void);
+
+class TimedWait
+{
+    public:
+        /* Start a wait, either for a relative timeout or until
+         * an absolute time of the game clock */
+        TimedWait(struct timespec time, bool absolute);
+
+        /* Get the next real-time slice to wait for. The first call always
+         * succeeds, so that the function is at least tried once.
+         * @return false if the wait timed out
+         */
+        bool nextSlice(struct timespec* slice);
+
+        /* Game time remaining until the deadline */
+        struct timespec remaining(void);
+
+        /* Sleep until the wait times out. Threads sleeping here are
+         * woken up as soon as the game time reaches their deadline */
+        void sleep(void);
+
+        /* Convert a real-time slice into an absolute time of a clock */
+        static struct timespec sliceEnd(clockid_t clock, struct timespec slice);
+
+    private:
+        /* Game time at which the wait ends */
+        TimeHolder deadline;
+
+        /* Real (monotonic) time at which the wait ends */
+        TimeHolder realDeadline;
+
+        /* Was the function already tried? */
+        bool tried;
+};
+
+#endif
@@ -19,7 +19,7 @@
 
 #include "AudioBuffer.h"
 #include "DecoderMSADPCM.h"
-#include "BinaryIStream.h"
+#include "Resampler.h"
 #include "../logging.h"
 
 AudioBuffer::AudioBuffer(void)
@@ -34,6 +34,11 @@ AudioBuffer::AudioBuffer(void)
     sampleSize = 0;
     blockSamples = 0;
     blockSize = 0;
+    rawValid = false;
+    convertedValid = false;
+    convertedFrequency = 0;
+    convertedNbChannels = 0;
+    convertedQuality = 0;
 }
 
 void AudioBuffer::update(void)
@@ -73,10 +78,9 @@ void AudioBuffer::update(void)
             /* Number of bytes of a block */
             blockSize = nbChannels * (7 + (blockSamples - 2) / 2);
 
-            sampleSize = blockSamples * (size / blockSize);
-            if ((size % blockSize) >= (7 * nbChannels))
-                /* We have an incomplete block */
-                sampleSize += 2 + ((size % blockSize)/nbChannels - 7) * 2;
+            /* Same count as the decoder, which writes into a buffer
+             * of this size */
+            sampleSize = DecoderMSADPCM::sampleCount(size, nbChannels, blockSamples);
             break;
     }
 }
@@ -114,43 +118,87 @@ int AudioBuffer::getSamples(uint8_t* &outSamples, int nbSamples, int position)
                 return (sampleSize - position);
         case SAMPLE_FMT_MSADPCM:
 
-            /*** 1. Compute which portion of our buffer we decompress ***/
+            /* Decode the whole buffer once, instead of decoding
+             * the requested blocks each time */
+            if (!rawValid) {
+                rawSamples.resize(sampleSize * nbChannels);
+                int decodedSamples = DecoderMSADPCM::decode(samples.data(), size, nbChannels, blockSamples, rawSamples.data());
+                rawSamples.resize(decodedSamples * nbChannels);
+                rawValid = true;
+                debuglog(LCF_SOUND, "   Decompressed ", size, " B -> ", rawSamples.size()*2, " B");
+            }
+
+            int rawSampleSize = rawSamples.size() / nbChannels;
+            if (position >= rawSampleSize) {
+                outSamples = (uint8_t*) rawSamples.data();
+                return 0;
+            }
+
+            outSamples = (uint8_t*) &rawSamples[position*nbChannels];
+            if ((rawSampleSize - position) >= nbSamples)
+                return nbSamples;
+            else
+                return (rawSampleSize - position);
+    }
+    return 0;
+}
 
-            /* Number of blocks to read */
-            int firstBlock = position / blockSamples;
-            int lastBlock = 1 + (position + nbSamples - 1) / blockSamples;
+void AudioBuffer::setSamples(const uint8_t* data, int dataSize)
+{
+    /* assign() only reallocates if the capacity is too small */
+    samples.assign(data, data + dataSize);
+    size = dataSize;
+    invalidateCache();
+}
+
+void AudioBuffer::invalidateCache(void)
+{
+    rawValid = false;
+    convertedValid = false;
+}
 
-            /* Pointer to the beginning of the first block to read */
-            uint8_t* firstSamples = &samples[firstBlock*blockSize];
+void AudioBuffer::releaseConvertedSamples(void)
+{
+    std::vector<float>().swap(convertedSamples);
+    convertedValid = false;
+}
 
-            /* Size of the portion of compressed buffer to decompress */
-            int portionSize = std::min(size - firstBlock*blockSize, (lastBlock-firstBlock)*blockSize);
+const float* AudioBuffer::getConvertedSamples(int outFrequency, int outNbChannels, int quality, int &nbFrames)
+{
+    if (convertedValid && (convertedFrequency == outFrequency) &&
+        (convertedNbChannels == outNbChannels) && (convertedQuality == quality)) {
+        nbFrames = convertedSamples.size() / outNbChannels;
+        return convertedSamples.data();
+    }
 
-            /* We wrap this portion into an home-made binary stream */
-            BinaryIStream sourceStream(firstSamples, portionSize);
+    convertedSamples.clear();
+    nbFrames = 0;
 
-            /*** 2. Prepare the uncompressed buffer ***/
+    if ((frequency <= 0) || (nbChannels < 1) || (nbChannels > 2) || (format == SAMPLE_FMT_NB))
+        return nullptr;
 
-            /* Compute the maximum uncompressed size */
-            int rawSize = nbSamples * nbChannels;
-            rawSamples.clear();
-            rawSamples.reserve(rawSize);
+    /* Use a temporary resampler to convert the whole buffer */
+    Resampler resampler;
+    resampler.configure(frequency, outFrequency, outNbChannels, quality);
 
-            /*** 3. Call the decompression routine ***/
-            DecoderMSADPCM::toPCM(sourceStream, nbChannels, blockSamples, rawSamples);
+    uint8_t* inSamples;
+    int inNbFrames = getSamples(inSamples, sampleSize, 0);
+    resampler.push(inSamples, format, nbChannels, inNbFrames);
 
-            /*** 4. Return the proper values ***/
-            int rawPosition = position % blockSamples;
-            outSamples = (uint8_t*) &rawSamples[rawPosition*nbChannels];
-            int totSamples = nbSamples;
-            if ((rawSamples.size()/nbChannels - rawPosition) < nbSamples)
-                totSamples = rawSamples.size()/nbChannels - rawPosition;
+    /* One extra frame for the rounding */
+    int outCapacity = (int)(((int64_t) inNbFrames * outFrequency) / frequency) + 1;
+    convertedSamples.resize(outCapacity * outNbChannels);
 
-            debuglog(LCF_SOUND, "   Decompressed ", portionSize, " B -> ", rawSamples.size(), " B");
-            return totSamples;
-    }
-    return 0;
-}
+    int outNbFrames = resampler.flush(convertedSamples.data(), outCapacity);
 
+    convertedSamples.resize(outNbFrames * outNbChannels);
+    convertedValid = true;
+    convertedFrequency = outFrequency;
+    convertedNbChannels = outNbChannels;
+    convertedQuality = quality;
 
+    debuglog(LCF_SOUND, "Converted buffer ", id, " into ", outNbFrames, " float frames");
 
+    nbFrames = outNbFrames;
+    return convertedSamples.data();
+}
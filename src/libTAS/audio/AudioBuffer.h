@@ -96,7 +96,8 @@ class AudioBuffer
         /* Number of samples in a block for compressed formats */
         int blockSamples;
 
-        /* In the case of compressed audio, temporary uncompressed buffer */
+        /* In the case of compressed audio, the whole buffer decoded.
+         * It is filled at the first call to getSamples() */
         std::vector<int16_t> rawSamples;
 
         /* Update all fields below based on above fields */
@@ -118,6 +119,39 @@ class AudioBuffer
         */
         int blockSize;
 
+        /* Replace the samples of the buffer with a copy of data.
+         * The memory already allocated for the samples is reused */
+        void setSamples(const uint8_t* data, int dataSize);
+
+        /* Must be called each time the samples are modified */
+        void invalidateCache(void);
+
+        /* Get the whole buffer converted to float samples with the given
+         * frequency, number of channels and resampling quality.
+         * The conversion is done at the first call and kept until the
+         * samples are modified.
+         * @param [out] nbFrames      number of converted frames
+         * @return                    the converted samples, or nullptr
+         *                            if the conversion failed
+         */
+        const float* getConvertedSamples(int outFrequency, int outNbChannels, int quality, int &nbFrames);
+
+        /* Free the converted samples. Buffers that are unqueued from a
+         * source are usually filled with new samples, so their converted
+         * copy would never be used again */
+        void releaseConvertedSamples(void);
+
+    private:
+        /* Is rawSamples up-to-date with the compressed samples */
+        bool rawValid;
+
+        /* Cache of the buffer converted to the output format */
+        std::vector<float> convertedSamples;
+        bool convertedValid;
+        int convertedFrequency;
+        int convertedNbChannels;
+        int convertedQuality;
+
 };
 
 #endif
@@ -20,9 +20,12 @@
 #include "../logging.h"
 #include "AudioContext.h"
 #include "AudioPlayer.h"
-
-#define MAXBUFFERS 2048 // Max I've seen so far: 960
-#define MAXSOURCES 256 // Max I've seen so far: 112
+#include "mixkernels.h"
+#include "../trace.h"
+#include "../telemetry.h"
+#include "../threads.h" // pthread_create_real
+#include "../../shared/tasflags.h"
+#include "../ThreadState.h"
 
 AudioContext audiocontext;
 
@@ -48,124 +51,238 @@ AudioContext::AudioContext(void)
     outNbChannels = 2;
     outAlignSize = 4;
     outFrequency = 44100;
+    playingHead = nullptr;
+    playingTail = nullptr;
+    mixThreadRunning = false;
+    mixPending = false;
+    mixQuit = false;
 }
 
 int AudioContext::createBuffer(void)
 {
+    waitMix();
     std::lock_guard<std::mutex> lock(mutex);
-    
-    if ((! buffers.empty()) && buffers.front()->id >= MAXBUFFERS)
-        return -1;
 
     AudioBuffer* newab = new AudioBuffer;
-
-    if (buffers.empty()) {
-        newab->id = 1;
+    newab->id = buffers.insert(newab);
+    if (newab->id < 0) {
+        delete newab;
+        return -1;
     }
-    else {
-        /* Get the id of the last AudioBuffer
-         * (situated at the beginning of the list) */
-        int last_id = buffers.front()->id;
-        newab->id = last_id + 1;
+
+    if (!samplePool.empty()) {
+        newab->samples.swap(samplePool.back());
+        samplePool.pop_back();
     }
-    buffers.push_front(newab);
 
     return newab->id;
 }
 
 void AudioContext::deleteBuffer(int id)
 {
+    waitMix();
     std::lock_guard<std::mutex> lock(mutex);
-    
-    buffers.remove_if([id](AudioBuffer* const& buffer)
-        {
-            if (buffer->id == id) {
-                delete buffer;
-                return true;
-            }
-            return false;
-        });
+
+    AudioBuffer* buffer = buffers.remove(id);
+    if (!buffer)
+        return;
+
+    if ((samplePool.size() < SAMPLEPOOL_MAX_ARRAYS) &&
+        (buffer->samples.capacity() <= SAMPLEPOOL_MAX_BYTES)) {
+        buffer->samples.clear();
+        samplePool.push_back(std::move(buffer->samples));
+    }
+    delete buffer;
 }
 
 bool AudioContext::isBuffer(int id)
 {
-    for (auto& buffer : buffers) {
-        if (buffer->id == id)
-            return true;
-    }
-
-    return false;
+    waitMix();
+    return buffers.get(id) != nullptr;
 }
 
 AudioBuffer* AudioContext::getBuffer(int id)
 {
-    for (auto& buffer : buffers) {
-        if (buffer->id == id)
-            return buffer;
-    }
-
-    return nullptr;
+    waitMix();
+    return buffers.get(id);
 }
 
 int AudioContext::createSource(void)
 {
+    waitMix();
     std::lock_guard<std::mutex> lock(mutex);
-    
-    if ((! sources.empty()) && sources.front()->id >= MAXSOURCES)
-        return -1;
 
     AudioSource* newas = new AudioSource;
-
-    if (sources.empty()) {
-        newas->id = 1;
-    }
-    else {
-        /* Get the id of the last AudioSource
-         * (situated at the beginning of the list) */
-        int last_id = sources.front()->id;
-        newas->id = last_id + 1;
+    newas->id = sources.insert(newas);
+    if (newas->id < 0) {
+        delete newas;
+        return -1;
     }
-    sources.push_front(newas);
 
     return newas->id;
 }
 
 void AudioContext::deleteSource(int id)
 {
+    waitMix();
     std::lock_guard<std::mutex> lock(mutex);
-    
-    sources.remove_if([id](AudioSource* const& source)
-        {
-            if (source->id == id) {
-                delete source;
-                return true;
-            }
-            return false;
-        });
+
+    AudioSource* source = sources.remove(id);
+    if (source) {
+        unlinkPlaying(source);
+        delete source;
+    }
 }
 
 bool AudioContext::isSource(int id)
 {
-    for (auto& source : sources) {
-        if (source->id == id)
-            return true;
+    waitMix();
+    return sources.get(id) != nullptr;
+}
+
+AudioSource* AudioContext::getSource(int id)
+{
+    waitMix();
+    return sources.get(id);
+}
+
+void AudioContext::playSource(AudioSource* source)
+{
+    waitMix();
+    source->state = SOURCE_PLAYING;
+
+    if (source->inPlayingList)
+        return;
+
+    /* Append the source to the list of playing sources */
+    source->prevPlaying = playingTail;
+    source->nextPlaying = nullptr;
+    if (playingTail)
+        playingTail->nextPlaying = source;
+    else
+        playingHead = source;
+    playingTail = source;
+    source->inPlayingList = true;
+}
+
+void AudioContext::unlinkPlaying(AudioSource* source)
+{
+    if (!source->inPlayingList)
+        return;
+
+    if (source->prevPlaying)
+        source->prevPlaying->nextPlaying = source->nextPlaying;
+    else
+        playingHead = source->nextPlaying;
+    if (source->nextPlaying)
+        source->nextPlaying->prevPlaying = source->prevPlaying;
+    else
+        playingTail = source->prevPlaying;
+
+    source->prevPlaying = nullptr;
+    source->nextPlaying = nullptr;
+    source->inPlayingList = false;
+}
+
+void AudioContext::mixAllSources(struct timespec ticks)
+{
+    /* Mixes are done in order */
+    waitMix();
+
+    if (!tasflags.async_audio_mix || !canMixAsync()) {
+        mixSources(ticks);
+        return;
+    }
+
+    if (!mixThreadRunning) {
+        static bool atforkRegistered = false;
+        if (!atforkRegistered) {
+            pthread_atfork(nullptr, nullptr, atforkChild);
+            atforkRegistered = true;
+        }
+
+        mixQuit = false;
+        /* The mixing thread is ours, so we do not go through our hook */
+        if (pthread_create_real(&mixThread, nullptr, mixLoop, this) != 0) {
+            debuglog(LCF_SOUND | LCF_ERROR, "Could not create the mixing thread");
+            mixSources(ticks);
+            return;
+        }
+        mixThreadRunning = true;
     }
 
-    return false;
+    std::lock_guard<std::mutex> lock(mixMutex);
+    mixTicks = ticks;
+    mixPending = true;
+    mixCond.notify_all();
 }
 
-AudioSource* AudioContext::getSource(int id)
+void AudioContext::waitMix(void)
 {
-    for (auto& source : sources) {
-        if (source->id == id)
-            return source;
+    if (!mixPending)
+        return;
+
+    TRACE_SCOPE("Wait audio mix");
+    std::unique_lock<std::mutex> lock(mixMutex);
+    mixCond.wait(lock, [this]{ return !mixPending; });
+}
+
+void AudioContext::stopMixThread(void)
+{
+    if (!mixThreadRunning)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mixMutex);
+        mixQuit = true;
+        mixCond.notify_all();
     }
+    pthread_join_real(mixThread, nullptr);
+    mixThreadRunning = false;
+}
 
+void AudioContext::atforkChild(void)
+{
+    /* The mixing thread does not exist in the child process */
+    audiocontext.mixThreadRunning = false;
+    audiocontext.mixPending = false;
+}
+
+void* AudioContext::mixLoop(void* arg)
+{
+    AudioContext* ac = static_cast<AudioContext*>(arg);
+    threadState.setNative(true);
+
+    std::unique_lock<std::mutex> lock(ac->mixMutex);
+    while (true) {
+        ac->mixCond.wait(lock, [ac]{ return ac->mixPending || ac->mixQuit; });
+        if (ac->mixPending) {
+            /* The game thread waits for the end of the mix before
+             * accessing any audio object, so we can mix without lock */
+            lock.unlock();
+            ac->mixSources(ac->mixTicks);
+            lock.lock();
+            ac->mixPending = false;
+            ac->mixCond.notify_all();
+        }
+        else if (ac->mixQuit)
+            break;
+    }
     return nullptr;
 }
 
-void AudioContext::mixAllSources(struct timespec ticks)
+bool AudioContext::canMixAsync(void)
+{
+    for (AudioSource* source = playingHead; source; source = source->nextPlaying)
+        if (source->source == SOURCE_CALLBACK)
+            return false;
+    return true;
+}
+
+void AudioContext::mixSources(struct timespec ticks)
 {
+    TRACE_SCOPE("Audio mix");
+    TelemetryTimer telemetryTimer(telemetryAudioMixNs);
     //std::lock_guard<std::mutex> lock(mutex);
 
     /* Check that ticks is positive! */
@@ -180,16 +297,31 @@ void AudioContext::mixAllSources(struct timespec ticks)
 
     debuglog(LCF_SOUND | LCF_FRAME, "Start mixing about ", outNbSamples, " samples");
 
-    /* Silent the output buffer */
-    if (outBitDepth == 8) // Unsigned 8-bit samples
-        outSamples.assign(outBytes, 0x80);
-    if (outBitDepth == 16) // Signed 16-bit samples
-        outSamples.assign(outBytes, 0);
+    /* Silent the mix bus */
+    mixBus.assign(outNbSamples * outNbChannels, 0.0f);
+
+    AudioSource* source = playingHead;
+    while (source) {
+        /* Get the next source now, because this one may be unlinked */
+        AudioSource* next = source->nextPlaying;
+
+        if (source->state == SOURCE_PLAYING)
+            source->mixWith(ticks, mixBus.data(), outNbSamples, outNbChannels, outFrequency, outVolume);
 
-    for (auto& source : sources) {
-        source->mixWith(ticks, &outSamples[0], outBytes, outBitDepth, outNbChannels, outFrequency, outVolume);
+        /* Sources that are not playing anymore leave the list */
+        if (source->state != SOURCE_PLAYING)
+            unlinkPlaying(source);
+
+        source = next;
     }
 
+    /* Convert the mix bus to the output format, saturating only once */
+    outSamples.resize(outBytes);
+    if (outBitDepth == 8) // Unsigned 8-bit samples
+        mixSaturateU8(mixBus.data(), outSamples.data(), outNbSamples * outNbChannels);
+    if (outBitDepth == 16) // Signed 16-bit samples
+        mixSaturateS16(mixBus.data(), reinterpret_cast<int16_t*>(outSamples.data()), outNbSamples * outNbChannels);
+
 #ifdef LIBTAS_ENABLE_SOUNDPLAYBACK
     /* Play the music */
     audioplayer.play(*this);
@@ -21,10 +21,20 @@
 #define LIBTAS_AUDIOCONTEXT_H_INCL
 
 #include <vector>
-#include <forward_list>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <pthread.h>
 #include "AudioBuffer.h"
 #include "AudioSource.h"
+#include "SlotTable.h"
+
+#define MAXBUFFERS 2048 // Max I've seen so far: 960
+#define MAXSOURCES 256 // Max I've seen so far: 112
+
+/* Sample arrays of deleted buffers kept for new buffers */
+#define SAMPLEPOOL_MAX_ARRAYS 64
+#define SAMPLEPOOL_MAX_BYTES (1 << 20)
 
 /* This class stores a set of audio sources and audio buffers, and
  * is in charge of creating or deleting them.
@@ -58,6 +68,9 @@ class AudioContext
         /* Mixed buffer during a frame */
         std::vector<uint8_t> outSamples;
 
+        /* Mix bus where all sources are added, in float format */
+        std::vector<float> mixBus;
+
         /* Size of the mixed buffer in samples */
         int outNbSamples;
 
@@ -88,15 +101,69 @@ class AudioContext
         /* Return the source of requested id, or nullptr if not exists */
         AudioSource* getSource(int id);
 
-        /* Mix all source that are playing */
+        /* Set a source as playing, and add it to the list of sources
+         * to mix. Sources leave the list when they are not playing anymore */
+        void playSource(AudioSource* source);
+
+        /* Mix all source that are playing.
+         * With asynchronous mixing, the mix is done by the mixing thread
+         * while the game runs its next frame, and this function only
+         * starts it */
         void mixAllSources(struct timespec ticks);
 
+        /* Wait for the end of the mix started by the last call to
+         * mixAllSources(). Must be called before accessing the audio
+         * objects or the mixed samples from another thread */
+        void waitMix(void);
+
+        /* Terminate the mixing thread */
+        void stopMixThread(void);
+
         /* Mutex to protect access to all audio objects */
         std::mutex mutex;
 
     private:
-        std::forward_list<AudioBuffer*> buffers;
-        std::forward_list<AudioSource*> sources;
+        SlotTable<AudioBuffer, MAXBUFFERS> buffers;
+        SlotTable<AudioSource, MAXSOURCES> sources;
+
+        /* Pool of sample arrays of deleted buffers, reused by new buffers
+         * to avoid allocating memory when games create and delete
+         * buffers while streaming. Large arrays are not kept. */
+        std::vector<std::vector<uint8_t>> samplePool;
+
+        /* Intrusive list of the sources that may be playing */
+        AudioSource* playingHead;
+        AudioSource* playingTail;
+
+        /* Remove a source from the list of playing sources */
+        void unlinkPlaying(AudioSource* source);
+
+        /* Mix all sources that are playing, in the calling thread */
+        void mixSources(struct timespec ticks);
+
+        /* Callback sources execute game code while being mixed, so
+         * they cannot be mixed outside of the game thread */
+        bool canMixAsync(void);
+
+        /* Mixing thread, which mixes the sources in the same order
+         * as the synchronous mixing, one frame at a time */
+        pthread_t mixThread;
+        bool mixThreadRunning;
+        static void* mixLoop(void* arg);
+        static void atforkChild(void);
+
+        /* Protects the mix request below */
+        std::mutex mixMutex;
+        std::condition_variable mixCond;
+
+        /* Is a mix requested or in progress in the mixing thread */
+        std::atomic<bool> mixPending;
+
+        /* Length of the requested mix */
+        struct timespec mixTicks;
+
+        /* Asks the mixing thread to terminate */
+        bool mixQuit;
 };
 
 extern AudioContext audiocontext;
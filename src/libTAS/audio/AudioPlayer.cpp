@@ -24,6 +24,9 @@
 #include "../logging.h"
 #include "../../shared/tasflags.h"
 #include "../ThreadState.h"
+#include "../threads.h" // pthread_create_real
+#include "../time.h" // nanosleep_real
+#include <string.h>
 
 AudioPlayer audioplayer;
 
@@ -34,10 +37,15 @@ AudioPlayer::AudioPlayer(void)
     }
 
     inited = false;
+    writePos = 0;
+    readPos = 0;
+    dropQueued = false;
+    running = false;
 }
 
 AudioPlayer::~AudioPlayer(void)
 {
+    stop();
     snd_pcm_close(phandle);
 }
 
@@ -79,6 +87,7 @@ bool AudioPlayer::init(snd_pcm_format_t format, int nbChannels, unsigned int fre
         debuglog(LCF_SOUND | LCF_ERROR, "  snd_pcm_hw_params_set_rate_near failed");
         return false;
     }
+    deviceBufferSize = buffer_size;
 
     if (snd_pcm_hw_params_set_channels(phandle, hw_params, nbChannels) < 0) {
         debuglog(LCF_SOUND | LCF_ERROR, "  snd_pcm_hw_params_set_channels failed");
@@ -110,39 +119,190 @@ bool AudioPlayer::play(AudioContext& ac)
             format = SND_PCM_FORMAT_S16_LE;
         if (!init(format, ac.outNbChannels, (unsigned int)ac.outFrequency))
             return false;
+
+        frameSize = ac.outAlignSize;
+        silence = (ac.outBitDepth == 8) ? 0x80 : 0;
+        gameFrameSamples = ac.outFrequency / ((tasflags.framerate>0)?tasflags.framerate:30);
+
+        /* Queue up to half a second of samples */
+        size_t ringSize = 1;
+        while (ringSize < (size_t)(ac.outFrequency / 2 * frameSize))
+            ringSize <<= 1;
+        ring.resize(ringSize);
+
+        static bool atforkRegistered = false;
+        if (!atforkRegistered) {
+            pthread_atfork(nullptr, nullptr, atforkChild);
+            atforkRegistered = true;
+        }
+
+        running = true;
+        /* The playback thread is ours, so we do not go through our hook */
+        if (pthread_create_real(&playbackThread, nullptr, playbackLoop, this) != 0) {
+            debuglog(LCF_SOUND | LCF_ERROR, "  Could not create the playback thread");
+            running = false;
+            return false;
+        }
         inited = true;
     }
 
-    if (tasflags.fastforward)
+    /* Don't play audio when the game does not run at normal speed,
+     * we would only produce under or overruns. Samples that are still
+     * queued are dropped, so that we restart with a low latency */
+    if (tasflags.fastforward || (tasflags.speed_multiplier != tasflags.speed_divisor)) {
+        dropQueued = true;
         return true;
+    }
+
+    debuglog(LCF_SOUND, "Queue an audio frame");
+
+    size_t size = ac.outNbSamples * frameSize;
+    size_t wpos = writePos.load(std::memory_order_relaxed);
+    size_t rpos = readPos.load(std::memory_order_acquire);
+    if ((ring.size() - (wpos - rpos)) < size) {
+        debuglog(LCF_SOUND, "  Playback queue is full, dropping the frame");
+        return true;
+    }
+
+    size_t offset = wpos & (ring.size() - 1);
+    size_t firstSize = std::min(size, ring.size() - offset);
+    memcpy(&ring[offset], ac.outSamples.data(), firstSize);
+    memcpy(&ring[0], ac.outSamples.data() + firstSize, size - firstSize);
+
+    writePos.store(wpos + size, std::memory_order_release);
+    return true;
+}
+
+void AudioPlayer::readRing(size_t pos, uint8_t* dest, size_t size)
+{
+    size_t offset = pos & (ring.size() - 1);
+    size_t firstSize = std::min(size, ring.size() - offset);
+    memcpy(dest, &ring[offset], firstSize);
+    memcpy(dest + firstSize, &ring[0], size - firstSize);
+}
+
+int AudioPlayer::writeDevice(const uint8_t* samples, int nbFrames)
+{
+    while (nbFrames > 0) {
+        snd_pcm_sframes_t err = snd_pcm_writei(phandle, samples, nbFrames);
+        if (err == -EAGAIN) {
+            snd_pcm_wait(phandle, 10);
+            continue;
+        }
+        if (err < 0) {
+            /* Recover from underruns and suspends */
+            int ret = snd_pcm_recover(phandle, err, 1);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+        samples += err * frameSize;
+        nbFrames -= err;
+    }
+    return 0;
+}
+
+void* AudioPlayer::playbackLoop(void* arg)
+{
+    AudioPlayer* player = static_cast<AudioPlayer*>(arg);
+    threadState.setNative(true);
+
+    const int chunkFrames = PLAYBACK_CHUNK_FRAMES;
+
+    /* One more frame, for when we drop a sample frame */
+    std::vector<uint8_t> chunk((chunkFrames + 1) * player->frameSize);
 
-    debuglog(LCF_SOUND, "Play an audio frame");
-    threadState.setOwnCode(true);
-    int err = snd_pcm_writei(phandle, ac.outSamples.data(), ac.outNbSamples);
-    threadState.setOwnCode(false);
-	if (err < 0) {
-		if (err == -EPIPE) {
-			debuglog(LCF_SOUND, "  Underrun");
-            threadState.setOwnCode(true);
-			err = snd_pcm_prepare(phandle);
-            threadState.setOwnCode(false);
-			if (err < 0) {
-				debuglog(LCF_SOUND | LCF_ERROR, "  Can't recovery from underrun, prepare failed: ", snd_strerror(err));
-			    return false;
+    /* Average number of queued sample frames, used for rate adaptation */
+    float averageQueued = 0;
+
+    /* Delay before trying again to write to a failing audio device */
+    long failureDelay = 0;
+
+    while (player->running) {
+        if (failureDelay > 0) {
+            struct timespec wait = {failureDelay / 1000000000, failureDelay % 1000000000};
+            nanosleep_real(&wait, nullptr);
+
+            /* Samples queued in the meantime are late, drop them */
+            player->dropQueued = true;
+        }
+
+        if (player->dropQueued.exchange(false))
+            player->readPos.store(player->writePos.load(std::memory_order_acquire), std::memory_order_release);
+
+        size_t rpos = player->readPos.load(std::memory_order_relaxed);
+        size_t wpos = player->writePos.load(std::memory_order_acquire);
+        int queued = (wpos - rpos) / player->frameSize;
+
+        if (queued < chunkFrames) {
+            /* Not enough samples. If the audio device is about to run out
+             * of samples, we send silence to prevent an underrun,
+             * otherwise we wait for the next frame of the game. */
+            snd_pcm_sframes_t avail = snd_pcm_avail_update(player->phandle);
+            if ((avail < 0) || ((player->deviceBufferSize - avail) < (snd_pcm_uframes_t)chunkFrames)) {
+                memset(chunk.data(), player->silence, chunkFrames * player->frameSize);
+                player->checkWrite(player->writeDevice(chunk.data(), chunkFrames), failureDelay);
             }
             else {
-                threadState.setOwnCode(true);
-                snd_pcm_writei(phandle, ac.outSamples.data(), ac.outNbSamples);
-                threadState.setOwnCode(false);
+                struct timespec wait = {0, 1000000};
+                nanosleep_real(&wait, nullptr);
             }
-		}
-		else {
-			debuglog(LCF_SOUND | LCF_ERROR, "  snd_pcm_writei() failed: ", snd_strerror (err));
-			return false;
-		}
-	}
+            continue;
+        }
 
-    return true;
+        /* Rate adaptation: the game and the audio device do not run at
+         * exactly the same rate, so we drop a sample frame when too many
+         * samples are queued, and repeat one when too few are queued. */
+        averageQueued += (queued - averageQueued) / 16;
+        int readFrames = chunkFrames;
+        int writeFrames = chunkFrames;
+        if ((averageQueued > (2 * player->gameFrameSamples + chunkFrames)) && (queued > chunkFrames))
+            readFrames++;
+        else if (averageQueued < chunkFrames)
+            writeFrames++;
+
+        player->readRing(rpos, chunk.data(), readFrames * player->frameSize);
+        player->readPos.store(rpos + readFrames * player->frameSize, std::memory_order_release);
+
+        if (writeFrames > readFrames)
+            memcpy(&chunk[readFrames * player->frameSize], &chunk[(readFrames - 1) * player->frameSize], player->frameSize);
+
+        player->checkWrite(player->writeDevice(chunk.data(), writeFrames), failureDelay);
+    }
+    return nullptr;
+}
+
+void AudioPlayer::checkWrite(int err, long& failureDelay)
+{
+    if (err == 0) {
+        if (failureDelay > 0)
+            debuglog(LCF_SOUND, "  Audio device recovered");
+        failureDelay = 0;
+        return;
+    }
+
+    /* Only log the first failure, and back off until the device works again */
+    if (failureDelay == 0) {
+        debuglog(LCF_SOUND | LCF_ERROR, "  Could not write to the audio device: ", snd_strerror(err));
+        failureDelay = PLAYBACK_MIN_FAILURE_DELAY;
+    }
+    else if (failureDelay < PLAYBACK_MAX_FAILURE_DELAY)
+        failureDelay *= 2;
+}
+
+void AudioPlayer::stop(void)
+{
+    if (!running)
+        return;
+
+    running = false;
+    pthread_join_real(playbackThread, nullptr);
+}
+
+void AudioPlayer::atforkChild(void)
+{
+    /* The playback thread does not exist in the child process */
+    audioplayer.running = false;
 }
 
 #endif
@@ -24,8 +24,22 @@
 
 #include "AudioContext.h"
 #include <alsa/asoundlib.h>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
 
-/* Class in charge of sending the mixed samples to the audio device */
+/* Number of sample frames sent to the audio device at once */
+#define PLAYBACK_CHUNK_FRAMES 256
+
+/* Bounds of the delay between writes to a failing audio device, in nsec */
+#define PLAYBACK_MIN_FAILURE_DELAY 10000000
+#define PLAYBACK_MAX_FAILURE_DELAY 640000000
+
+/* Class in charge of sending the mixed samples to the audio device.
+ * Samples are queued into a ring buffer by the frame path, and a
+ * playback thread sends them to the audio device, so that a frame
+ * never waits for the audio device.
+ */
 class AudioPlayer
 {
     public:
@@ -43,8 +57,57 @@ class AudioPlayer
          */
 		bool init(snd_pcm_format_t format, int nbChannels, unsigned int frequency);
 
-        /* Play the audio buffer stored in the audio context */
+        /* Queue the audio buffer stored in the audio context, to be
+         * played by the playback thread. Does not block.
+         */
 		bool play(AudioContext& ac);
+
+    private:
+        /* Size of a sample frame in bytes */
+        int frameSize;
+
+        /* Value of the bytes of silent samples */
+        uint8_t silence;
+
+        /* Number of sample frames of a game frame */
+        int gameFrameSamples;
+
+        /* Size of the buffer of the audio device in sample frames */
+        snd_pcm_uframes_t deviceBufferSize;
+
+        /* Single-producer single-consumer ring of samples, filled by
+         * play() and emptied by the playback thread. Positions are
+         * in bytes and only increase, the size is a power of two.
+         */
+        std::vector<uint8_t> ring;
+        std::atomic<size_t> writePos;
+        std::atomic<size_t> readPos;
+
+        /* Asks the playback thread to discard the queued samples */
+        std::atomic<bool> dropQueued;
+
+        pthread_t playbackThread;
+        std::atomic<bool> running;
+
+        static void* playbackLoop(void* arg);
+        static void atforkChild(void);
+
+        /* Stop the playback thread */
+        void stop(void);
+
+        /* Write samples to the audio device, recovering from underruns
+         * and suspends. Return 0, or a negative error code if the
+         * device could not be recovered.
+         */
+        int writeDevice(const uint8_t* samples, int nbFrames);
+
+        /* Log the first error of the audio device and update the delay
+         * before the next write. The delay is reset once writes succeed.
+         */
+        void checkWrite(int err, long& failureDelay);
+
+        /* Copy samples from the ring, starting at a position */
+        void readRing(size_t pos, uint8_t* dest, size_t size);
 };
 
 extern AudioPlayer audioplayer;
@@ -21,14 +21,10 @@
 #include <iterator>     // std::back_inserter
 #include <algorithm>    // std::copy
 #include "../logging.h"
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-extern "C" {
-    #include <libavutil/opt.h>
-    #include <libavutil/channel_layout.h>
-}
-#endif
 #include <stdlib.h>
 #include "../DeterministicTimer.h" // detTimer.fakeAdvanceTimer()
+#include "mixkernels.h"
+#include "../../shared/tasflags.h"
 
 /* Helper function to convert ticks into a number of bytes in the audio buffer */
 int AudioSource::ticksToSamples(struct timespec ticks, int frequency)
@@ -53,10 +49,9 @@ AudioSource::AudioSource(void)
     looping = false;
     state = SOURCE_INITIAL;
     queue_index = 0;
-
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-    swr = swr_alloc();
-#endif
+    prevPlaying = nullptr;
+    nextPlaying = nullptr;
+    inPlayingList = false;
 }
 
 void AudioSource::init(void)
@@ -64,10 +59,7 @@ void AudioSource::init(void)
     position = 0;
     samples_frac = 0;
     queue_index = 0;
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-    if (swr_is_initialized(swr))
-        swr_close(swr);
-#endif
+    resampler.reset();
 }
 
 int AudioSource::nbQueue()
@@ -83,8 +75,8 @@ int AudioSource::nbQueueProcessed()
 int AudioSource::queueSize()
 {
     int totalSize = 0;
-    for (auto& buffer : buffer_queue) {
-        totalSize += buffer->sampleSize;
+    for (int i=0; i<buffer_queue.size(); i++) {
+        totalSize += buffer_queue[i]->sampleSize;
     }
     return totalSize;
 }
@@ -122,7 +114,7 @@ void AudioSource::setPosition(int pos)
     }
 }
 
-int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outBytes, int outBitDepth, int outNbChannels, int outFrequency, float outVolume)
+int AudioSource::mixWith( struct timespec ticks, float* mixBus, int outNbSamples, int outNbChannels, int outFrequency, float outVolume)
 {
     if (state != SOURCE_PLAYING)
         return -1;
@@ -134,64 +126,14 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
 
     AudioBuffer* curBuf = buffer_queue[queue_index];
 
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-    /* Get the sample format */
-    AVSampleFormat inFormat, outFormat;
-    switch (curBuf->format) {
-        case SAMPLE_FMT_U8:
-            inFormat = AV_SAMPLE_FMT_U8;
-            break;
-        case SAMPLE_FMT_S16:
-        case SAMPLE_FMT_MSADPCM:
-            inFormat = AV_SAMPLE_FMT_S16;
-            break;
-        case SAMPLE_FMT_S32:
-            inFormat = AV_SAMPLE_FMT_S32;
-            break;
-        case SAMPLE_FMT_FLT:
-            inFormat = AV_SAMPLE_FMT_FLT;
-            break;
-        case SAMPLE_FMT_DBL:
-            inFormat = AV_SAMPLE_FMT_DBL;
-            break;
-        default:
-            debuglog(LCF_SOUND | LCF_FRAME | LCF_ERROR, "Unknown sample format");
-            break;
-    }
-    if (outBitDepth == 8)
-        outFormat = AV_SAMPLE_FMT_U8;
-    if (outBitDepth == 16)
-        outFormat = AV_SAMPLE_FMT_S16;
-
-    /* Check if SWR context is initialized.
-     * If not, set parameters and init it
-     */
-    if (! swr_is_initialized(swr)) {
-        /* Set channel layout */
-        if (curBuf->nbChannels == 1)
-            av_opt_set_int(swr, "in_channel_layout", AV_CH_LAYOUT_MONO, 0);
-        if (curBuf->nbChannels == 2)
-            av_opt_set_int(swr, "in_channel_layout", AV_CH_LAYOUT_STEREO, 0);
-        if (outNbChannels == 1)
-            av_opt_set_int(swr, "out_channel_layout", AV_CH_LAYOUT_MONO, 0);
-        if (outNbChannels == 2)
-            av_opt_set_int(swr, "out_channel_layout", AV_CH_LAYOUT_STEREO, 0);
-
-        /* Set sample format */
-        av_opt_set_sample_fmt(swr, "in_sample_fmt", inFormat, 0);
-        av_opt_set_sample_fmt(swr, "out_sample_fmt", outFormat, 0);
-
-        /* Set sampling frequency */
-        av_opt_set_int(swr, "in_sample_rate", curBuf->frequency, 0);
-        av_opt_set_int(swr, "out_sample_rate", outFrequency, 0);
-
-        /* Open the context */
-        if (swr_init(swr) < 0) {
-            debuglog(LCF_SOUND | LCF_FRAME | LCF_ERROR, "Error initializing swr context");
+    /* Configure the resampler with the first buffer that we play */
+    if (! resampler.isConfigured()) {
+        if (curBuf->frequency <= 0) {
+            debuglog(LCF_SOUND | LCF_FRAME | LCF_ERROR, "Invalid buffer frequency");
             return 0;
         }
+        resampler.configure(curBuf->frequency, outFrequency, outNbChannels, tasflags.resample_quality);
     }
-#endif
 
     /* Mixing source volume and master volume.
      * Taken from openAL doc:
@@ -201,8 +143,15 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
      * TODO: This is where we can support panning.
      */
     float resultVolume = (volume * outVolume) > 1.0?1.0:(volume*outVolume);
-    int lvas = (int)(resultVolume * 65536.0f);
-    int rvas = (int)(resultVolume * 65536.0f);
+    float leftGain = resultVolume;
+    float rightGain = resultVolume;
+
+    /* Static buffers, and buffers that do not need resampling, are
+     * converted once and mixed directly from the converted copy */
+    if ((source != SOURCE_CALLBACK) &&
+        ((source == SOURCE_STATIC) || (curBuf->frequency == outFrequency))) {
+        return mixCached(ticks, mixBus, outNbSamples, outNbChannels, outFrequency, leftGain, rightGain);
+    }
 
     /* Number of samples to advance in the buffer. */
     int inNbSamples = ticksToSamples(ticks, curBuf->frequency);
@@ -211,11 +160,7 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
     int newPosition = position + inNbSamples;
 
     /* Allocate the mixed audio array */
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-    int outNbSamples = outBytes / (outNbChannels * outBitDepth / 8);
-    mixedSamples.resize(outBytes);
-    uint8_t* begMixed = &mixedSamples[0];
-#endif
+    mixedSamples.resize(outNbSamples * outNbChannels);
 
     int convOutSamples = 0;
     uint8_t* begSamples;
@@ -226,17 +171,14 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
 
         position = newPosition;
         debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", curBuf->id, " in read in range ", oldPosition, " - ", position);
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-        convOutSamples = swr_convert(swr, &begMixed, outNbSamples, (const uint8_t**)&begSamples, inNbSamples);
-#endif
+        resampler.push(begSamples, curBuf->format, curBuf->nbChannels, inNbSamples);
+        convOutSamples = resampler.pull(mixedSamples.data(), outNbSamples);
     }
     else {
         /* We reached the end of the buffer */
         debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", curBuf->id, " is read from ", oldPosition, " to its end ", curBuf->sampleSize);
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
         if (availableSamples > 0)
-            swr_convert(swr, nullptr, 0, (const uint8_t**)&begSamples, availableSamples);
-#endif
+            resampler.push(begSamples, curBuf->format, curBuf->nbChannels, availableSamples);
 
         int remainingSamples = inNbSamples - availableSamples;
         if (source == SOURCE_CALLBACK) {
@@ -253,19 +195,15 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
                 callback(curBuf);
                 detTimer.fakeAdvanceTimer({0, 0});
                 availableSamples = curBuf->getSamples(begSamples, remainingSamples, 0);
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-                    swr_convert(swr, nullptr, 0, (const uint8_t**)&begSamples, availableSamples);
-#endif
+                resampler.push(begSamples, curBuf->format, curBuf->nbChannels, availableSamples);
                 debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", curBuf->id, " is read again from 0 to ", availableSamples);
                 if (remainingSamples == availableSamples)
                     position = availableSamples;
                 remainingSamples -= availableSamples;
             }
 
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
             /* Get the mixed samples */
-            convOutSamples = swr_convert(swr, &begMixed, outNbSamples, nullptr, 0);
-#endif
+            convOutSamples = resampler.pull(mixedSamples.data(), outNbSamples);
         }
         else {
             int queue_size = buffer_queue.size();
@@ -278,9 +216,7 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
                     AudioBuffer* loopbuf = buffer_queue[i];
                     availableSamples = loopbuf->getSamples(begSamples, remainingSamples, 0);
                     debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", loopbuf->id, " in read in range 0 - ", availableSamples);
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-                    swr_convert(swr, nullptr, 0, (const uint8_t**)&begSamples, availableSamples);
-#endif
+                    resampler.push(begSamples, loopbuf->format, loopbuf->nbChannels, availableSamples);
                     if (remainingSamples == availableSamples) {
                         finalIndex = i;
                         finalPos = availableSamples;
@@ -293,9 +229,7 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
                     AudioBuffer* loopbuf = buffer_queue[i];
                     availableSamples = loopbuf->getSamples(begSamples, remainingSamples, 0);
                     debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", loopbuf->id, " in read in range 0 - ", availableSamples);
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-                    swr_convert(swr, nullptr, 0, (const uint8_t**)&begSamples, availableSamples);
-#endif
+                    resampler.push(begSamples, loopbuf->format, loopbuf->nbChannels, availableSamples);
                     if (remainingSamples == availableSamples) {
                         finalIndex = i;
                         finalPos = availableSamples;
@@ -304,10 +238,8 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
                 }
             }
 
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
             /* Get the mixed samples */
-            convOutSamples = swr_convert(swr, &begMixed, outNbSamples, nullptr, 0);
-#endif
+            convOutSamples = resampler.pull(mixedSamples.data(), outNbSamples);
 
             if (remainingSamples > 0) {
                 /* We reached the end of the buffer queue */
@@ -324,44 +256,77 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
 
     }
 
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-
-#define clamptofullsignedrange(x,lo,hi) (((unsigned int)((x)-(lo))<=(unsigned int)((hi)-(lo)))?(x):(((x)<0)?(lo):(hi)))
+    /* Add mixed source to the mix bus */
+    mixAddGain(mixBus, mixedSamples.data(), convOutSamples, outNbChannels, leftGain, rightGain);
 
-    /* Add mixed source to the output buffer */
-    if (outBitDepth == 8) {
-        for (int s=0; s<convOutSamples*outNbChannels; s+=outNbChannels) {
-            int myL = ((uint8_t*)&mixedSamples[0])[s];
-            int otherL = ((uint8_t*)outSamples)[s];
-            int sumL = otherL + ((myL * lvas) >> 16) - 256;
-            ((uint8_t*)outSamples)[s] = clamptofullsignedrange(sumL, 0, (1<<8)-1);
+    return convOutSamples;
+}
 
-            if (outNbChannels == 2) {
-                int myR = ((uint8_t*)&mixedSamples[0])[s+1];
-                int otherR = ((uint8_t*)outSamples)[s+1];
-                int sumR = otherR + ((myR * rvas) >> 16);
-                ((uint8_t*)outSamples)[s+1] = clamptofullsignedrange(sumR, 0, (1<<8)-1);
+int AudioSource::mixCached( struct timespec ticks, float* mixBus, int outNbSamples, int outNbChannels, int outFrequency, float leftGain, float rightGain)
+{
+    /* Number of samples to advance in the buffer. It is converted to the
+     * frequency of each buffer of the queue that we read */
+    int frequency = buffer_queue[queue_index]->frequency;
+    int remainingSamples = ticksToSamples(ticks, frequency);
+
+    int mixedFrames = 0;
+    int queue_size = buffer_queue.size();
+
+    /* Number of consecutive buffers that we skipped without reading
+     * anything, to detect a queue of empty buffers */
+    int emptyBuffers = 0;
+
+    while (remainingSamples > 0) {
+        AudioBuffer* curBuf = buffer_queue[queue_index];
+
+        if (position >= curBuf->sampleSize) {
+            /* Go to the next buffer in the queue */
+            if ((queue_index + 1 < queue_size) || (looping && (emptyBuffers < queue_size))) {
+                queue_index = (queue_index + 1) % queue_size;
+                position = 0;
+                emptyBuffers++;
+                continue;
             }
+
+            /* We reached the end of the buffer queue */
+            init();
+            state = SOURCE_STOPPED;
+            debuglog(LCF_SOUND | LCF_FRAME, "  End of the queue reached");
+            break;
         }
-    }
+        emptyBuffers = 0;
 
-    if (outBitDepth == 16) {
-        for (int s=0; s<convOutSamples*outNbChannels; s+=outNbChannels) {
-            int myL = ((int16_t*)&mixedSamples[0])[s];
-            int otherL = ((int16_t*)outSamples)[s];
-            int sumL = otherL + ((myL * lvas) >> 16);
-            ((int16_t*)outSamples)[s] = clamptofullsignedrange(sumL, -(1<<15), (1<<15)-1);
-
-            if (outNbChannels == 2) {
-                int myR = ((int16_t*)&mixedSamples[0])[s+1];
-                int otherR = ((int16_t*)outSamples)[s+1];
-                int sumR = otherR + ((myR * rvas) >> 16);
-                ((int16_t*)outSamples)[s+1] = clamptofullsignedrange(sumR, -(1<<15), (1<<15)-1);
-            }
+        if (curBuf->frequency != frequency) {
+            remainingSamples = ((int64_t) remainingSamples * curBuf->frequency) / frequency;
+            frequency = curBuf->frequency;
+            if (remainingSamples == 0)
+                break;
         }
+
+        int convFrames;
+        const float* convSamples = curBuf->getConvertedSamples(outFrequency, outNbChannels, tasflags.resample_quality, convFrames);
+
+        int readSamples = std::min(remainingSamples, curBuf->sampleSize - position);
+
+        /* Range of converted frames matching the range of samples.
+         * Both ends are computed the same way from positions in the buffer,
+         * so that consecutive frames neither skip nor repeat samples. */
+        int64_t startFrame = ((int64_t) position * outFrequency) / curBuf->frequency;
+        int64_t endFrame = ((int64_t) (position + readSamples) * outFrequency) / curBuf->frequency;
+        endFrame = std::min(endFrame, (int64_t) convFrames);
+        int nbFrames = std::min((int) (endFrame - startFrame), outNbSamples - mixedFrames);
+
+        if (convSamples && (nbFrames > 0)) {
+            mixAddGain(mixBus + mixedFrames * outNbChannels, convSamples + startFrame * outNbChannels,
+                    nbFrames, outNbChannels, leftGain, rightGain);
+            mixedFrames += nbFrames;
+        }
+
+        debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", curBuf->id, " in read from cache in range ", position, " - ", position + readSamples);
+
+        position += readSamples;
+        remainingSamples -= readSamples;
     }
-#endif
 
-    return convOutSamples;
+    return mixedFrames;
 }
-
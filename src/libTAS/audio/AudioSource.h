@@ -22,11 +22,8 @@
 
 #include <vector>
 #include "AudioBuffer.h"
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-extern "C" {
-#include <libswresample/swresample.h>
-}
-#endif
+#include "RingQueue.h"
+#include "Resampler.h"
 
 enum SourceType {
     SOURCE_UNDETERMINED,
@@ -96,18 +93,21 @@ class AudioSource
         SourceState state;
 
         /* A queue of buffers to play */
-        std::vector<AudioBuffer*> buffer_queue;
+        RingQueue<AudioBuffer*> buffer_queue;
 
         /* Indicate the current position in the buffer queue */
         int queue_index;
 
-#if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-        /* Context for resampling audio */
-        struct SwrContext *swr;
+        /* Links in the list of playing sources of the audio context */
+        AudioSource* prevPlaying;
+        AudioSource* nextPlaying;
+        bool inPlayingList;
 
-        /* Temporary array of mixed samples */
-        std::vector<uint8_t> mixedSamples;
-#endif
+        /* Resampling of the audio */
+        Resampler resampler;
+
+        /* Temporary array of converted samples, in float format */
+        std::vector<float> mixedSamples;
 
         /* In case of callback type, callback function.
          * We send as an argument a pointer to the buffer to refill.
@@ -148,11 +148,16 @@ class AudioSource
          */
         void setPosition(int pos);
 
-        /* Mix the buffer with an external buffer of the given format.
-         * The number of samples to mix correspond to the number of ticks given.
-         * The function returns the number of samples written in the output buffer.
+        /* Add the buffer to a mix bus of outNbSamples float samples
+         * of the given format. The number of samples to mix correspond to
+         * the number of ticks given.
+         * The function returns the number of samples added to the mix bus.
          */
-        int mixWith( struct timespec ticks, uint8_t* outSamples, int outBytes, int outBitDepth, int outNbChannels, int outFrequency, float outVolume);
+        int mixWith( struct timespec ticks, float* mixBus, int outNbSamples, int outNbChannels, int outFrequency, float outVolume);
+
+        /* Same as mixWith(), but reading the buffers already converted
+         * to the output format, without our resampler */
+        int mixCached( struct timespec ticks, float* mixBus, int outNbSamples, int outNbChannels, int outFrequency, float leftGain, float rightGain);
 };
 
 #endif
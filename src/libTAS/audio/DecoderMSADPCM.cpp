@@ -19,121 +19,152 @@
 
 #include "DecoderMSADPCM.h"
 #include "../logging.h"
+#include <algorithm>
+
+static const int adaptionTable[] = {
+    230, 230, 230, 230, 307, 409, 512, 614,
+    768, 614, 512, 409, 307, 230, 230, 230
+};
+
+static const int adaptCoeff_1[] = {
+    256, 512, 0, 192, 240, 460, 392
+};
+static const int adaptCoeff_2[] = {
+    0, -256, 0, 64, 0, -208, -232
+};
+
+/* Decoding state of one channel */
+struct ChannelState {
+    int coeff1;
+    int coeff2;
+    int sample1;
+    int sample2;
+    int delta;
+};
+
+static inline int16_t readInt16(const uint8_t* p)
+{
+    return (int16_t) (p[0] | (p[1] << 8));
+}
 
-int16_t DecoderMSADPCM::calculateSample(uint8_t nibble, uint8_t predictor, int16_t& sample1, int16_t& sample2, int16_t& delta)
+static inline void initChannel(ChannelState& channel, uint8_t predictor, int16_t delta, int16_t sample1, int16_t sample2)
 {
-    /* 
-     * Get a signed number out of the nibble. We need to retain the
-     * original nibble value for when we access AdaptionTable[].
-     */
-    int8_t signedNibble = (int8_t) nibble;
-    if ((signedNibble & 0x8) == 0x8) {
-        signedNibble -= 0x10;
-    }
+    /* Invalid predictors would read outside of the tables */
+    predictor = std::min(predictor, (uint8_t) 6);
+    channel.coeff1 = adaptCoeff_1[predictor];
+    channel.coeff2 = adaptCoeff_2[predictor];
+    channel.delta = delta;
+    channel.sample1 = sample1;
+    channel.sample2 = sample2;
+}
+
+/* Calculates a PCM sample based on previous samples and a nibble input */
+static inline int16_t calculateSample(ChannelState& channel, int nibble)
+{
+    /* Get a signed number out of the nibble. We need to retain the
+     * original nibble value for when we access AdaptionTable[]. */
+    int signedNibble = (nibble ^ 0x8) - 0x8;
 
-    static const int adaptionTable[] = {
-        230, 230, 230, 230, 307, 409, 512, 614,
-        768, 614, 512, 409, 307, 230, 230, 230
-    };
-
-    static const int adaptCoeff_1[] = {
-        256, 512, 0, 192, 240, 460, 392
-    };
-    static const int adaptCoeff_2[] = {
-        0, -256, 0, 64, 0, -208, -232
-    };
-
-    /* Calculate new sample */
-    int sampleInt = (
-            (	(sample1 * adaptCoeff_1[predictor]) +
-                (sample2 * adaptCoeff_2[predictor])
-            ) /256
-            );
-    sampleInt += signedNibble * delta;
+    int sampleInt = ((channel.sample1 * channel.coeff1) + (channel.sample2 * channel.coeff2)) / 256;
+    sampleInt += signedNibble * channel.delta;
 
     /* Clamp result to 16-bit */
-    int16_t sample;
-    if (sampleInt < INT16_MIN) {
-        sample = INT16_MIN;
-    } else if (sampleInt > INT16_MAX) {
-        sample = INT16_MAX;
-    } else {
-        sample = (int16_t) sampleInt;
-    }
+    sampleInt = std::min(std::max(sampleInt, (int) INT16_MIN), (int) INT16_MAX);
 
     /* Shuffle samples, get new delta */
-    sample2 = sample1;
-    sample1 = sample;
-    delta = (int16_t) (adaptionTable[nibble] * delta / 256);
+    channel.sample2 = channel.sample1;
+    channel.sample1 = sampleInt;
+    int16_t delta = (int16_t) (adaptionTable[nibble] * channel.delta / 256);
 
     /* Saturate the delta to a lower bound of 16 */
-    if (delta < 16)
-        delta = 16;
+    channel.delta = std::max(delta, (int16_t) 16);
+
+    return (int16_t) sampleInt;
+}
+
+/* Number of samples per channel decoded from a block, from its preamble and
+ * its bytes of nibbles. Stereo blocks hold one sample of each channel per byte */
+static inline int blockSampleCount(int nbChannels, int nibbleBytes)
+{
+    return 2 + nibbleBytes * 2 / nbChannels;
+}
 
-    return sample;
+int DecoderMSADPCM::sampleCount(int size, int nbChannels, int sampleAlign)
+{
+    if ((nbChannels != 1) && (nbChannels != 2))
+        return 0;
+
+    const int preambleSize = 7 * nbChannels;
+    const int blockSize = nbChannels * (7 + (sampleAlign - 2) / 2);
+    if (blockSize < preambleSize)
+        return 0;
+
+    int nbSamples = (size / blockSize) * blockSampleCount(nbChannels, blockSize - preambleSize);
+    if ((size % blockSize) >= preambleSize)
+        /* We have an incomplete block */
+        nbSamples += blockSampleCount(nbChannels, (size % blockSize) - preambleSize);
+    return nbSamples;
 }
 
-void DecoderMSADPCM::toPCM(BinaryIStream &source, int nbChannels, int sampleAlign, std::vector<int16_t> &pcmOut)
+int DecoderMSADPCM::decode(const uint8_t* data, int size, int nbChannels, int sampleAlign, int16_t* pcmOut)
 {
-    /* Mono or Stereo? */
-    if (nbChannels == 1) {
-        uint8_t predictor;
+    if ((nbChannels != 1) && (nbChannels != 2)) {
+        debuglog(LCF_SOUND | LCF_ERROR, "MSADPCM data is not mono or stereo");
+        return 0;
+    }
+
+    const int preambleSize = 7 * nbChannels;
+    const int blockSize = nbChannels * (7 + (sampleAlign - 2) / 2);
+    if (blockSize < preambleSize) {
+        debuglog(LCF_SOUND | LCF_ERROR, "MSADPCM block alignment ", sampleAlign, " is too small");
+        return 0;
+    }
+
+    int nbSamples = 0;
 
-        /* Read to the end of the buffer */
-        while (source >> predictor) {
+    for (int pos = 0; pos + preambleSize <= size; pos += blockSize) {
+        const uint8_t* block = data + pos;
 
-            int16_t sample1, sample2, delta;
+        /* Number of bytes of nibbles in this block, which may be incomplete */
+        int nibbleBytes = std::min(blockSize, size - pos) - preambleSize;
 
-            /* Read block preamble */
-            source >> delta >> sample1 >> sample2;
+        if (nbChannels == 1) {
+            ChannelState channel;
+            initChannel(channel, block[0], readInt16(block + 1), readInt16(block + 3), readInt16(block + 5));
 
             /* Send the initial samples straight to PCM out. */
-            pcmOut.push_back(sample2);
-            pcmOut.push_back(sample1);
-
-            /* Go through the bytes in this MSADPCM block. */
-            for (int bi = 2; bi < sampleAlign; bi += 2) {
-                /* Each sample is one half of a nibbleBlock. */
-                uint8_t sampleByte;
-                source >> sampleByte;
-                if (!source) break;
-                pcmOut.push_back(calculateSample(sampleByte >>  4, predictor, sample1, sample2, delta));
-                pcmOut.push_back(calculateSample(sampleByte & 0xF, predictor, sample1, sample2, delta));
+            *pcmOut++ = channel.sample2;
+            *pcmOut++ = channel.sample1;
+
+            /* Each byte holds two consecutive samples */
+            const uint8_t* nibbles = block + preambleSize;
+            for (int b = 0; b < nibbleBytes; b++) {
+                *pcmOut++ = calculateSample(channel, nibbles[b] >> 4);
+                *pcmOut++ = calculateSample(channel, nibbles[b] & 0xF);
             }
-
+            nbSamples += blockSampleCount(nbChannels, nibbleBytes);
         }
-    } else if (nbChannels == 2) {
-        uint8_t lpredictor, rpredictor;
-
-        /* Read to the end of the buffer */
-        while (source >> lpredictor) {
-            int16_t lsample1, lsample2, ldelta;
-            int16_t rsample1, rsample2, rdelta;
-
-            /* Read block preamble */
-            source >> rpredictor;
-            source >> ldelta >> rdelta;
-            source >> lsample1 >> rsample1;
-            source >> lsample2 >> rsample2;
+        else {
+            ChannelState left, right;
+            initChannel(left, block[0], readInt16(block + 2), readInt16(block + 6), readInt16(block + 10));
+            initChannel(right, block[1], readInt16(block + 4), readInt16(block + 8), readInt16(block + 12));
 
             /* Send the initial samples straight to PCM out. */
-            pcmOut.push_back(lsample2);
-            pcmOut.push_back(rsample2);
-            pcmOut.push_back(lsample1);
-            pcmOut.push_back(rsample1);
-
-            /* Go through the bytes in this MSADPCM block. */
-            for (int bi = 4; bi < (sampleAlign*2); bi += 2) {
-                uint8_t sampleByte;
-                source >> sampleByte;
-                if (!source) break;
-                /* Each sample is one half of a nibbleBlock. */
-                pcmOut.push_back(calculateSample(sampleByte >>  4, lpredictor, lsample1, lsample2, ldelta));
-                pcmOut.push_back(calculateSample(sampleByte & 0xF, rpredictor, rsample1, rsample2, rdelta));
+            *pcmOut++ = left.sample2;
+            *pcmOut++ = right.sample2;
+            *pcmOut++ = left.sample1;
+            *pcmOut++ = right.sample1;
+
+            /* Each byte holds one sample of each channel, so both
+             * channels are decoded together */
+            const uint8_t* nibbles = block + preambleSize;
+            for (int b = 0; b < nibbleBytes; b++) {
+                *pcmOut++ = calculateSample(left, nibbles[b] >> 4);
+                *pcmOut++ = calculateSample(right, nibbles[b] & 0xF);
             }
+            nbSamples += blockSampleCount(nbChannels, nibbleBytes);
         }
-    } else {
-        debuglog(LCF_SOUND | LCF_ERROR, "MSADPCM data is not mono or stereo");
     }
-}
 
+    return nbSamples;
+}
@@ -24,8 +24,7 @@
 #ifndef LIBTAS_DECODERMSADPCM_H_INCL
 #define LIBTAS_DECODERMSADPCM_H_INCL
 
-#include <vector>
-#include "BinaryIStream.h"
+#include <stdint.h>
 
 class DecoderMSADPCM
 {
@@ -33,26 +32,23 @@ class DecoderMSADPCM
 
         /**
          * Decodes MSADPCM data to signed 16-bit PCM data.
-         * @param source     [in]  source stream containing the compressed samples
-         * @param nbChannels [in]  number of channels
-         * @param blockAlign [in]  size (in samples!) of a single ADPCM block
-         * @param pcmOut     [out] destination buffer
+         * Both channels of stereo data are decoded in lockstep. An incomplete
+         * last block is decoded if at least its preamble is present.
+         * @param data        [in]  compressed samples
+         * @param size        [in]  size of the compressed samples in bytes
+         * @param nbChannels  [in]  number of channels (1 or 2)
+         * @param sampleAlign [in]  size (in samples!) of a single ADPCM block
+         * @param pcmOut      [out] destination buffer, of sampleCount()
+         *                          samples per channel
+         * @return                  the number of decoded samples per channel
          */
-        static void toPCM(BinaryIStream &source, int nbChannels, int sampleAlign, std::vector<int16_t> &pcmOut);
+        static int decode(const uint8_t* data, int size, int nbChannels, int sampleAlign, int16_t* pcmOut);
 
-    private:
         /**
-         * Calculates PCM samples based on previous samples and a nibble input.
-         * @param nibble A parsed MSADPCM sample
-         * @param predictor The predictor we get from the MSADPCM block's preamble
-         * @param sample_1 The first sample we use to predict the next sample
-         * @param sample_2 The second sample we use to predict the next sample
-         * @param delta Used to calculate the final sample
-         * @return The calculated PCM sample
+         * Number of samples per channel that decode() outputs for this data,
+         * including the samples of an incomplete last block.
          */
-        static int16_t calculateSample(uint8_t nibble, uint8_t predictor, int16_t& sample1, int16_t& sample2, int16_t& delta);
-
+        static int sampleCount(int size, int nbChannels, int sampleAlign);
 };
 
 #endif
-
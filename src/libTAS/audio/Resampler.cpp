@@ -0,0 +1,296 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Resampler.h"
+#include "../logging.h"
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const double PI = 3.14159265358979323846;
+
+/* Sine computed with a Taylor series instead of the libm, whose result
+ * may differ between implementations */
+static double sinSeries(double x)
+{
+    /* Bring x into [-pi, pi] */
+    while (x > PI)
+        x -= 2 * PI;
+    while (x < -PI)
+        x += 2 * PI;
+
+    double x2 = x * x;
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x2 / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+static double cosSeries(double x)
+{
+    return sinSeries(x + PI / 2);
+}
+
+static inline float toFloat(uint8_t s) { return (s - 128) * (1.0f / 128); }
+static inline float toFloat(int16_t s) { return s * (1.0f / 32768); }
+static inline float toFloat(int32_t s) { return s * (1.0f / 2147483648.0f); }
+static inline float toFloat(float s) { return s; }
+static inline float toFloat(double s) { return (float) s; }
+
+/* Convert frames to float and to the output number of channels */
+template <typename T>
+static void convertFrames(const T* in, int inNbChannels, float* out, int outNbChannels, int nbFrames)
+{
+    if (inNbChannels == outNbChannels) {
+        for (int i = 0; i < nbFrames * inNbChannels; i++)
+            out[i] = toFloat(in[i]);
+    }
+    else if (inNbChannels == 1) {
+        for (int f = 0; f < nbFrames; f++)
+            out[2*f] = out[2*f+1] = toFloat(in[f]);
+    }
+    else {
+        for (int f = 0; f < nbFrames; f++)
+            out[f] = (toFloat(in[2*f]) + toFloat(in[2*f+1])) * 0.5f;
+    }
+}
+
+/* Apply a filter of n coefficients to n interleaved samples.
+ * Samples are summed in four lanes, in the same order for both versions.
+ * With one channel, the result is the sum of the lanes. With two
+ * channels, lanes 0 and 2 hold the left channel and lanes 1 and 3
+ * the right channel. */
+static inline void applyFilterScalar(const float* coefs, const float* samples, int n, float lanes[4])
+{
+    lanes[0] = lanes[1] = lanes[2] = lanes[3] = 0.0f;
+    for (int i = 0; i < n; i += 4)
+        for (int l = 0; l < 4; l++)
+            lanes[l] += coefs[i+l] * samples[i+l];
+}
+
+#ifdef __SSE2__
+static inline void applyFilterSSE2(const float* coefs, const float* samples, int n, float lanes[4])
+{
+    __m128 acc = _mm_setzero_ps();
+    for (int i = 0; i < n; i += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(coefs + i), _mm_loadu_ps(samples + i)));
+    _mm_storeu_ps(lanes, acc);
+}
+#endif
+
+static inline void applyFilter(const float* coefs, const float* samples, int nbChannels, float* out)
+{
+    float lanes[4];
+#ifdef __SSE2__
+    applyFilterSSE2(coefs, samples, RESAMPLE_SINC_TAPS * nbChannels, lanes);
+#else
+    applyFilterScalar(coefs, samples, RESAMPLE_SINC_TAPS * nbChannels, lanes);
+#endif
+
+    if (nbChannels == 1)
+        out[0] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    else {
+        out[0] = lanes[0] + lanes[2];
+        out[1] = lanes[1] + lanes[3];
+    }
+}
+
+Resampler::Resampler(void)
+{
+    reset();
+}
+
+void Resampler::reset(void)
+{
+    configured = false;
+    input.clear();
+    position = 0;
+}
+
+bool Resampler::isConfigured(void)
+{
+    return configured;
+}
+
+void Resampler::configure(int inFrequency, int outFrequency, int outChannels, int resampleQuality)
+{
+    quality = resampleQuality;
+    outNbChannels = outChannels;
+
+    step = (((uint64_t) inFrequency) << 32) / outFrequency;
+
+    switch (quality) {
+        case RESAMPLE_NEAREST:
+        case RESAMPLE_LINEAR:
+            before = 0;
+            after = 1;
+            break;
+        case RESAMPLE_SINC:
+        default:
+            quality = RESAMPLE_SINC;
+            before = RESAMPLE_SINC_TAPS / 2 - 1;
+            after = RESAMPLE_SINC_TAPS / 2;
+            /* Remove the frequencies above the output Nyquist frequency */
+            computeFilter(std::min(1.0, (double) outFrequency / inFrequency));
+            break;
+    }
+
+    /* Silence before the first samples */
+    input.assign(before * outNbChannels, 0.0f);
+    position = ((uint64_t) before) << 32;
+
+    configured = true;
+}
+
+void Resampler::computeFilter(double cutoff)
+{
+    filter.resize(RESAMPLE_SINC_PHASES * RESAMPLE_SINC_TAPS * outNbChannels);
+
+    for (int p = 0; p < RESAMPLE_SINC_PHASES; p++) {
+        double phase = (double) p / RESAMPLE_SINC_PHASES;
+        double coefs[RESAMPLE_SINC_TAPS];
+        double sum = 0;
+
+        for (int k = 0; k < RESAMPLE_SINC_TAPS; k++) {
+            /* Distance between the input sample and the output frame */
+            double x = (k - before) - phase;
+
+            double y = PI * cutoff * x;
+            double sinc = ((k == before) && (p == 0)) ? 1.0 : sinSeries(y) / y;
+
+            /* Blackman window over the filter length */
+            double w = PI * x / (RESAMPLE_SINC_TAPS / 2);
+            double window = 0.42 + 0.5 * cosSeries(w) + 0.08 * cosSeries(2 * w);
+
+            coefs[k] = sinc * window;
+            sum += coefs[k];
+        }
+
+        /* Normalize the filter so that it does not change the volume */
+        for (int k = 0; k < RESAMPLE_SINC_TAPS; k++)
+            for (int c = 0; c < outNbChannels; c++)
+                filter[(p * RESAMPLE_SINC_TAPS + k) * outNbChannels + c] = (float) (coefs[k] / sum);
+    }
+}
+
+void Resampler::push(const uint8_t* samples, SampleFormat format, int nbChannels, int nbFrames)
+{
+    if (!configured || (nbFrames <= 0))
+        return;
+
+    if ((nbChannels != 1) && (nbChannels != 2)) {
+        debuglog(LCF_SOUND | LCF_FRAME | LCF_ERROR, "Unsupported number of channels: ", nbChannels);
+        return;
+    }
+
+    size_t queued = input.size();
+    input.resize(queued + nbFrames * outNbChannels);
+    float* out = &input[queued];
+
+    switch (format) {
+        case SAMPLE_FMT_U8:
+            convertFrames(samples, nbChannels, out, outNbChannels, nbFrames);
+            break;
+        case SAMPLE_FMT_S16:
+        case SAMPLE_FMT_MSADPCM: /* Samples are decoded by the buffer */
+            convertFrames(reinterpret_cast<const int16_t*>(samples), nbChannels, out, outNbChannels, nbFrames);
+            break;
+        case SAMPLE_FMT_S32:
+            convertFrames(reinterpret_cast<const int32_t*>(samples), nbChannels, out, outNbChannels, nbFrames);
+            break;
+        case SAMPLE_FMT_FLT:
+            convertFrames(reinterpret_cast<const float*>(samples), nbChannels, out, outNbChannels, nbFrames);
+            break;
+        case SAMPLE_FMT_DBL:
+            convertFrames(reinterpret_cast<const double*>(samples), nbChannels, out, outNbChannels, nbFrames);
+            break;
+        default:
+            debuglog(LCF_SOUND | LCF_FRAME | LCF_ERROR, "Unknown sample format");
+            input.resize(queued);
+            break;
+    }
+}
+
+int Resampler::pull(float* out, int maxFrames)
+{
+    if (!configured)
+        return 0;
+
+    uint64_t nbInput = input.size() / outNbChannels;
+    int nbFrames = 0;
+
+    for (; nbFrames < maxFrames; nbFrames++) {
+        uint64_t index = position >> 32;
+        if (index + after >= nbInput)
+            break;
+
+        uint32_t frac = (uint32_t) position;
+        const float* in = &input[index * outNbChannels];
+        float* o = out + nbFrames * outNbChannels;
+
+        switch (quality) {
+            case RESAMPLE_NEAREST:
+                in += (frac >> 31) * outNbChannels;
+                for (int c = 0; c < outNbChannels; c++)
+                    o[c] = in[c];
+                break;
+            case RESAMPLE_LINEAR:
+            {
+                /* Keep 24 bits of the fraction, which are exact in a float */
+                float f = (frac >> 8) * (1.0f / 16777216);
+                for (int c = 0; c < outNbChannels; c++)
+                    o[c] = in[c] + (in[c + outNbChannels] - in[c]) * f;
+                break;
+            }
+            case RESAMPLE_SINC:
+            {
+                int phase = frac >> 24;
+                applyFilter(&filter[phase * RESAMPLE_SINC_TAPS * outNbChannels],
+                        in - before * outNbChannels, outNbChannels, o);
+                break;
+            }
+        }
+
+        position += step;
+    }
+
+    /* Remove the input frames that will not be used anymore */
+    uint64_t next = position >> 32;
+    if (next > (uint64_t) before) {
+        uint64_t unused = std::min(next - before, nbInput);
+        input.erase(input.begin(), input.begin() + unused * outNbChannels);
+        position -= unused << 32;
+    }
+
+    return nbFrames;
+}
+
+int Resampler::flush(float* out, int maxFrames)
+{
+    if (!configured)
+        return 0;
+
+    /* Silence after the last samples */
+    input.resize(input.size() + after * outNbChannels, 0.0f);
+    return pull(out, maxFrames);
+}
@@ -0,0 +1,107 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_RESAMPLER_H_INCL
+#define LIBTAS_RESAMPLER_H_INCL
+
+#include <vector>
+#include <stdint.h>
+#include "AudioBuffer.h"
+
+/* Quality of the resampling */
+enum ResampleQuality {
+    RESAMPLE_NEAREST = 0, /* Nearest input sample */
+    RESAMPLE_LINEAR = 1,  /* Linear interpolation between two input samples */
+    RESAMPLE_SINC = 2,    /* Windowed sinc filter */
+};
+
+/* Number of input samples used by the windowed sinc filter */
+#define RESAMPLE_SINC_TAPS 16
+
+/* Number of precomputed filters between two input samples */
+#define RESAMPLE_SINC_PHASES 256
+
+/* Class converting audio samples to float, to the output number of
+ * channels, and resampling them to the output frequency.
+ *
+ * Positions are tracked in fixed point, and the filter is computed using
+ * only basic floating-point operations, so that the output is the same
+ * on every machine. The SSE2 and the scalar versions of the filter
+ * give the same results.
+ */
+class Resampler
+{
+    public:
+        Resampler();
+
+        /* Set the parameters of the conversion, and reset the state */
+        void configure(int inFrequency, int outFrequency, int outChannels, int resampleQuality);
+
+        /* Is the resampler configured */
+        bool isConfigured(void);
+
+        /* Clear the state. The resampler must be configured again */
+        void reset(void);
+
+        /* Queue input samples of a given format and number of channels
+         * (1 or 2). The frequency of the samples must be the one
+         * given in configure() */
+        void push(const uint8_t* samples, SampleFormat format, int nbChannels, int nbFrames);
+
+        /* Resample queued samples into at most maxFrames output frames.
+         * Output frames that need input samples not queued yet are
+         * produced by a later call.
+         * Returns the number of output frames.
+         */
+        int pull(float* out, int maxFrames);
+
+        /* Same as pull(), but the input is considered to end here */
+        int flush(float* out, int maxFrames);
+
+    private:
+        bool configured;
+        int quality;
+        int outNbChannels;
+
+        /* Distance between two output frames, in input frames,
+         * as a 32.32 fixed-point number */
+        uint64_t step;
+
+        /* Position of the next output frame in the input queue,
+         * as a 32.32 fixed-point number */
+        uint64_t position;
+
+        /* Number of input frames used before and after the position */
+        int before;
+        int after;
+
+        /* Queued input samples, converted to float and interleaved */
+        std::vector<float> input;
+
+        /* Coefficients of the sinc filter, for each phase. With two
+         * channels, each coefficient is stored twice to match the
+         * interleaved samples */
+        std::vector<float> filter;
+
+        /* Compute the sinc filter for a cutoff frequency relative to
+         * the input frequency */
+        void computeFilter(double cutoff);
+};
+
+#endif
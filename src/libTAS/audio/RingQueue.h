@@ -0,0 +1,92 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_RINGQUEUE_H_INCL
+#define LIBTAS_RINGQUEUE_H_INCL
+
+#include <vector>
+
+/* Queue stored in a circular array, with access by index from the front.
+ * Adding at the back and removing from the front are done in constant
+ * time. The array only grows, so once it is large enough, using
+ * the queue does not allocate any memory.
+ */
+template <typename T>
+class RingQueue
+{
+    public:
+        RingQueue() : head(0), count(0) {}
+
+        int size(void) const
+        {
+            return count;
+        }
+
+        bool empty(void) const
+        {
+            return count == 0;
+        }
+
+        /* Element at position index from the front */
+        T& operator[](int index)
+        {
+            return elements[(head + index) & (elements.size() - 1)];
+        }
+
+        void push_back(const T& element)
+        {
+            if (count == static_cast<int>(elements.size()))
+                grow();
+            elements[(head + count) & (elements.size() - 1)] = element;
+            count++;
+        }
+
+        /* Remove n elements from the front */
+        void pop_front(int n = 1)
+        {
+            if (n > count)
+                n = count;
+            if (elements.size() > 0)
+                head = (head + n) & (elements.size() - 1);
+            count -= n;
+        }
+
+        void clear(void)
+        {
+            head = 0;
+            count = 0;
+        }
+
+    private:
+        /* Double the capacity, which is always a power of two */
+        void grow(void)
+        {
+            std::vector<T> newElements(elements.empty() ? 4 : 2 * elements.size());
+            for (int i = 0; i < count; i++)
+                newElements[i] = (*this)[i];
+            elements.swap(newElements);
+            head = 0;
+        }
+
+        std::vector<T> elements;
+        int head;
+        int count;
+};
+
+#endif
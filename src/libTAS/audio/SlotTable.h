@@ -0,0 +1,99 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_SLOTTABLE_H_INCL
+#define LIBTAS_SLOTTABLE_H_INCL
+
+#include <vector>
+
+/* Table of audio objects, giving access to an object from its id
+ * in constant time.
+ *
+ * An id is built from the index of the slot storing the object and
+ * the generation of the slot, which is incremented each time an object
+ * is removed. This way, a slot can be reused without an old id
+ * referring to the new object. Ids are always strictly positive,
+ * and the first ids are 1, 2, 3, ... as long as no object is removed.
+ *
+ * Freed slots are reused in a fixed order, so that the ids given to the
+ * game only depend on the sequence of insertions and removals.
+ */
+template <typename T, int MAXSLOTS>
+class SlotTable
+{
+    public:
+        /* Insert an object and return its id, or -1 if the table is full */
+        int insert(T* object)
+        {
+            int slot;
+            if (!freeSlots.empty()) {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            else {
+                if (objects.size() >= MAXSLOTS)
+                    return -1;
+                slot = objects.size();
+                objects.push_back(nullptr);
+                generations.push_back(0);
+            }
+            objects[slot] = object;
+            return (generations[slot] << SLOT_BITS) | (slot + 1);
+        }
+
+        /* Return the object of an id, or nullptr if the id is not valid */
+        T* get(int id)
+        {
+            if (id <= 0)
+                return nullptr;
+            unsigned int slot = (id & SLOT_MASK) - 1;
+            if ((slot >= objects.size()) || (generations[slot] != ((unsigned int)id >> SLOT_BITS)))
+                return nullptr;
+            return objects[slot];
+        }
+
+        /* Remove the object of an id and return it, or return nullptr
+         * if the id is not valid */
+        T* remove(int id)
+        {
+            T* object = get(id);
+            if (!object)
+                return nullptr;
+
+            unsigned int slot = (id & SLOT_MASK) - 1;
+            objects[slot] = nullptr;
+            generations[slot] = (generations[slot] + 1) & GENERATION_MASK;
+            freeSlots.push_back(slot);
+            return object;
+        }
+
+    private:
+        static const int SLOT_BITS = 16;
+        static const unsigned int SLOT_MASK = (1 << SLOT_BITS) - 1;
+        /* Keep ids positive */
+        static const unsigned int GENERATION_MASK = (1 << (31 - SLOT_BITS)) - 1;
+
+        static_assert(MAXSLOTS < (1 << SLOT_BITS), "Too many slots");
+
+        std::vector<T*> objects;
+        std::vector<unsigned int> generations;
+        std::vector<unsigned int> freeSlots;
+};
+
+#endif
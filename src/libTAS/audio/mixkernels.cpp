@@ -0,0 +1,216 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mixkernels.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIX_X86
+#endif
+
+/* Scalar implementations, used for the end of the arrays that do not
+ * fill a vector register, or when no vector instruction is available.
+ * Rounding is to nearest even, like the vector conversions.
+ */
+
+static void mixAddGainScalar(float* bus, const float* in, int nbSamples, int nbChannels, float leftGain, float rightGain)
+{
+    if (nbChannels == 2) {
+        for (int s = 0; s + 1 < nbSamples; s += 2) {
+            bus[s] += in[s] * leftGain;
+            bus[s+1] += in[s+1] * rightGain;
+        }
+    }
+    else {
+        for (int s = 0; s < nbSamples; s++)
+            bus[s] += in[s] * leftGain;
+    }
+}
+
+static void mixSaturateS16Scalar(const float* bus, int16_t* out, int nbSamples)
+{
+    for (int s = 0; s < nbSamples; s++) {
+        float v = bus[s] * 32768.0f;
+        v = (v > 32767.0f) ? 32767.0f : ((v < -32768.0f) ? -32768.0f : v);
+        out[s] = (int16_t) std::nearbyint(v);
+    }
+}
+
+static void mixSaturateU8Scalar(const float* bus, uint8_t* out, int nbSamples)
+{
+    for (int s = 0; s < nbSamples; s++) {
+        float v = bus[s] * 128.0f;
+        v = (v > 127.0f) ? 127.0f : ((v < -128.0f) ? -128.0f : v);
+        out[s] = (uint8_t) ((int) std::nearbyint(v) + 128);
+    }
+}
+
+#ifdef MIX_X86
+
+#ifdef __SSE2__
+
+static void mixAddGainSSE2(float* bus, const float* in, int nbSamples, int nbChannels, float leftGain, float rightGain)
+{
+    /* Gains of the interleaved samples. Frames have an even number
+     * of samples, so the pattern stays aligned with the channels */
+    __m128 gain = (nbChannels == 2) ? _mm_setr_ps(leftGain, rightGain, leftGain, rightGain) : _mm_set1_ps(leftGain);
+
+    int s = 0;
+    for (; s + 4 <= nbSamples; s += 4) {
+        __m128 b = _mm_loadu_ps(bus + s);
+        __m128 i = _mm_loadu_ps(in + s);
+        _mm_storeu_ps(bus + s, _mm_add_ps(b, _mm_mul_ps(i, gain)));
+    }
+    mixAddGainScalar(bus + s, in + s, nbSamples - s, nbChannels, leftGain, rightGain);
+}
+
+static void mixSaturateS16SSE2(const float* bus, int16_t* out, int nbSamples)
+{
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+
+    int s = 0;
+    for (; s + 8 <= nbSamples; s += 8) {
+        __m128 v0 = _mm_mul_ps(_mm_loadu_ps(bus + s), scale);
+        __m128 v1 = _mm_mul_ps(_mm_loadu_ps(bus + s + 4), scale);
+        v0 = _mm_min_ps(_mm_max_ps(v0, lo), hi);
+        v1 = _mm_min_ps(_mm_max_ps(v1, lo), hi);
+        __m128i i = _mm_packs_epi32(_mm_cvtps_epi32(v0), _mm_cvtps_epi32(v1));
+        _mm_storeu_si128((__m128i*)(out + s), i);
+    }
+    mixSaturateS16Scalar(bus + s, out + s, nbSamples - s);
+}
+
+static void mixSaturateU8SSE2(const float* bus, uint8_t* out, int nbSamples)
+{
+    const __m128 scale = _mm_set1_ps(128.0f);
+    const __m128 lo = _mm_set1_ps(-128.0f);
+    const __m128 hi = _mm_set1_ps(127.0f);
+    const __m128i bias = _mm_set1_epi16(128);
+
+    int s = 0;
+    for (; s + 16 <= nbSamples; s += 16) {
+        __m128i words[2];
+        for (int h = 0; h < 2; h++) {
+            __m128 v0 = _mm_mul_ps(_mm_loadu_ps(bus + s + 8*h), scale);
+            __m128 v1 = _mm_mul_ps(_mm_loadu_ps(bus + s + 8*h + 4), scale);
+            v0 = _mm_min_ps(_mm_max_ps(v0, lo), hi);
+            v1 = _mm_min_ps(_mm_max_ps(v1, lo), hi);
+            words[h] = _mm_add_epi16(_mm_packs_epi32(_mm_cvtps_epi32(v0), _mm_cvtps_epi32(v1)), bias);
+        }
+        _mm_storeu_si128((__m128i*)(out + s), _mm_packus_epi16(words[0], words[1]));
+    }
+    mixSaturateU8Scalar(bus + s, out + s, nbSamples - s);
+}
+
+#endif
+
+__attribute__((target("avx2")))
+static void mixAddGainAVX2(float* bus, const float* in, int nbSamples, int nbChannels, float leftGain, float rightGain)
+{
+    __m256 gain = (nbChannels == 2) ?
+        _mm256_setr_ps(leftGain, rightGain, leftGain, rightGain, leftGain, rightGain, leftGain, rightGain) :
+        _mm256_set1_ps(leftGain);
+
+    int s = 0;
+    for (; s + 8 <= nbSamples; s += 8) {
+        __m256 b = _mm256_loadu_ps(bus + s);
+        __m256 i = _mm256_loadu_ps(in + s);
+        /* No fused multiply-add, so that the result matches
+         * the other implementations */
+        _mm256_storeu_ps(bus + s, _mm256_add_ps(b, _mm256_mul_ps(i, gain)));
+    }
+    mixAddGainScalar(bus + s, in + s, nbSamples - s, nbChannels, leftGain, rightGain);
+}
+
+__attribute__((target("avx2")))
+static void mixSaturateS16AVX2(const float* bus, int16_t* out, int nbSamples)
+{
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f);
+
+    int s = 0;
+    for (; s + 16 <= nbSamples; s += 16) {
+        __m256 v0 = _mm256_mul_ps(_mm256_loadu_ps(bus + s), scale);
+        __m256 v1 = _mm256_mul_ps(_mm256_loadu_ps(bus + s + 8), scale);
+        v0 = _mm256_min_ps(_mm256_max_ps(v0, lo), hi);
+        v1 = _mm256_min_ps(_mm256_max_ps(v1, lo), hi);
+        /* Packing works inside each 128-bit lane, so we reorder
+         * the 64-bit quarters afterwards */
+        __m256i i = _mm256_packs_epi32(_mm256_cvtps_epi32(v0), _mm256_cvtps_epi32(v1));
+        i = _mm256_permute4x64_epi64(i, 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + s), i);
+    }
+    mixSaturateS16Scalar(bus + s, out + s, nbSamples - s);
+}
+
+#endif
+
+/* Implementations selected at the first call */
+
+typedef void (*MixAddGainFunc)(float*, const float*, int, int, float, float);
+typedef void (*MixSaturateS16Func)(const float*, int16_t*, int);
+typedef void (*MixSaturateU8Func)(const float*, uint8_t*, int);
+
+static MixAddGainFunc mixAddGainImpl = nullptr;
+static MixSaturateS16Func mixSaturateS16Impl = nullptr;
+static MixSaturateU8Func mixSaturateU8Impl = nullptr;
+
+static void selectKernels(void)
+{
+    mixAddGainImpl = mixAddGainScalar;
+    mixSaturateS16Impl = mixSaturateS16Scalar;
+    mixSaturateU8Impl = mixSaturateU8Scalar;
+
+#ifdef MIX_X86
+#ifdef __SSE2__
+    mixAddGainImpl = mixAddGainSSE2;
+    mixSaturateS16Impl = mixSaturateS16SSE2;
+    mixSaturateU8Impl = mixSaturateU8SSE2;
+#endif
+    if (__builtin_cpu_supports("avx2")) {
+        mixAddGainImpl = mixAddGainAVX2;
+        mixSaturateS16Impl = mixSaturateS16AVX2;
+    }
+#endif
+}
+
+void mixAddGain(float* bus, const float* in, int nbFrames, int nbChannels, float leftGain, float rightGain)
+{
+    if (!mixAddGainImpl)
+        selectKernels();
+    mixAddGainImpl(bus, in, nbFrames * nbChannels, nbChannels, leftGain, rightGain);
+}
+
+void mixSaturateS16(const float* bus, int16_t* out, int nbSamples)
+{
+    if (!mixSaturateS16Impl)
+        selectKernels();
+    mixSaturateS16Impl(bus, out, nbSamples);
+}
+
+void mixSaturateU8(const float* bus, uint8_t* out, int nbSamples)
+{
+    if (!mixSaturateU8Impl)
+        selectKernels();
+    mixSaturateU8Impl(bus, out, nbSamples);
+}
@@ -0,0 +1,46 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MIXKERNELS_H_INCL
+#define LIBTAS_MIXKERNELS_H_INCL
+
+#include <stdint.h>
+
+/* Kernels used to mix audio sources.
+ *
+ * Sources are accumulated into a mix bus of interleaved float samples,
+ * in the range [-1, 1] for a full-scale signal, and the mix bus is
+ * converted to the output format once, saturating the samples.
+ *
+ * Each function uses AVX2 or SSE2 instructions when available,
+ * with a scalar fallback. All implementations give the same results.
+ */
+
+/* Add nbFrames frames of nbChannels interleaved samples to the mix bus,
+ * with a gain for the left (or mono) and the right channel.
+ * Only 1 or 2 channels are supported. */
+void mixAddGain(float* bus, const float* in, int nbFrames, int nbChannels, float leftGain, float rightGain);
+
+/* Convert nbSamples samples of the mix bus into signed 16-bit samples */
+void mixSaturateS16(const float* bus, int16_t* out, int nbSamples);
+
+/* Convert nbSamples samples of the mix bus into unsigned 8-bit samples */
+void mixSaturateU8(const float* bus, uint8_t* out, int nbSamples);
+
+#endif
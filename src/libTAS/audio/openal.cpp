@@ -22,12 +22,14 @@
 #include "AudioBuffer.h"
 #include "AudioSource.h"
 #include "AudioContext.h"
+#include "../hookprofiler.h"
 
 ALenum alError;
 #define ALSETERROR(error) if(alError==AL_NO_ERROR) alError = error
 
 ALenum alGetError(ALvoid)
 {
+    PROFILE_HOOK();
     ALenum err = alError;
     alError = AL_NO_ERROR;
     return err;
@@ -35,6 +37,7 @@ ALenum alGetError(ALvoid)
 
 void alGenBuffers(ALsizei n, ALuint *buffers)
 {
+    PROFILE_HOOK();
     debuglog(LCF_OPENAL, __func__, " call - generate ", n, " buffers");
     for (int i=0; i<n; i++) {
         int id = audiocontext.createBuffer();
@@ -46,6 +49,7 @@ void alGenBuffers(ALsizei n, ALuint *buffers)
 
 void alDeleteBuffers(ALsizei n, ALuint *buffers)
 {
+    PROFILE_HOOK();
     debuglog(LCF_OPENAL, __func__, " call - delete ", n, " buffers");
     for (int i=0; i<n; i++) {
         /* Check if all buffers exist before removing any. */
@@ -61,12 +65,14 @@ void alDeleteBuffers(ALsizei n, ALuint *buffers)
 
 ALboolean alIsBuffer(ALuint buffer)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     return audiocontext.isBuffer(buffer);
 }
 
 void alBufferData(ALuint buffer, ALenum format, const ALvoid *data, ALsizei size, ALsizei freq)
 {
+    PROFILE_HOOK();
     debuglog(LCF_OPENAL, __func__, " call - copy buffer data of format ", format, ", size ", size, " and frequency ", freq, " into buffer ", buffer);
 	AudioBuffer* ab = audiocontext.getBuffer(buffer);
     if (ab == nullptr) {
@@ -138,31 +144,34 @@ void alBufferData(ALuint buffer, ALenum format, const ALvoid *data, ALsizei size
     }
 
     /* Copy the data into our buffer */
-    ab->samples.clear();
-    ab->samples.insert(ab->samples.end(), &((uint8_t*)data)[0], &((uint8_t*)data)[size]);
+    ab->setSamples(static_cast<const uint8_t*>(data), size);
 
 }
 
 void alBufferf(ALuint buffer, ALenum param, ALfloat value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alBuffer3f(ALuint buffer, ALenum param, ALfloat value1, ALfloat value2, ALfloat value3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alBufferfv(ALuint buffer, ALenum param, const ALfloat *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alBufferi(ALuint buffer, ALenum param, ALint value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioBuffer* ab = audiocontext.getBuffer(buffer);
     if (ab == nullptr) {
@@ -175,8 +184,16 @@ void alBufferi(ALuint buffer, ALenum param, ALint value)
     switch(param) {
         case AL_UNPACK_BLOCK_ALIGNMENT_SOFT:
             debuglog(LCF_OPENAL, "  Set block alignment ", value);
+            if (value < 0) {
+                ALSETERROR(AL_INVALID_VALUE);
+                return;
+            }
+            /* 0 means the default alignment */
+            if ((value == 0) && (ab->format == SAMPLE_FMT_MSADPCM))
+                value = 64;
             ab->blockSamples = value;
             ab->update();
+            ab->invalidateCache();
             break;
         default:
             debuglog(LCF_OPENAL, "  Operation not supported");
@@ -186,12 +203,14 @@ void alBufferi(ALuint buffer, ALenum param, ALint value)
 
 void alBuffer3i(ALuint buffer, ALenum param, ALint value1, ALint value2, ALint value3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alBufferiv(ALuint buffer, ALenum param, const ALint *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     if (values == nullptr) {
         ALSETERROR(AL_INVALID_VALUE);
@@ -203,6 +222,7 @@ void alBufferiv(ALuint buffer, ALenum param, const ALint *values)
 
 void alGetBufferi(ALuint buffer, ALenum pname, ALint *value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
 
     if (value == nullptr) {
@@ -244,6 +264,7 @@ void alGetBufferi(ALuint buffer, ALenum pname, ALint *value)
 
 void alGetBufferiv(ALuint buffer, ALenum pname, ALint *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     
     if (values == nullptr) {
@@ -267,6 +288,7 @@ void alGetBufferiv(ALuint buffer, ALenum pname, ALint *values)
 
 void alGenSources(ALsizei n, ALuint *sources)
 {
+    PROFILE_HOOK();
     debuglog(LCF_OPENAL, __func__, " call - generate ", n, " sources");
 	for (int i=0; i<n; i++) {
 		int id = audiocontext.createSource();
@@ -279,6 +301,7 @@ void alGenSources(ALsizei n, ALuint *sources)
 
 void alDeleteSources(ALsizei n, ALuint *sources)
 {
+    PROFILE_HOOK();
     debuglog(LCF_OPENAL, __func__, " call - delete ", n, " sources");
 	for (int i=0; i<n; i++) {
         /* Check if all sources exist before removing any. */
@@ -298,12 +321,14 @@ void alDeleteSources(ALsizei n, ALuint *sources)
 
 ALboolean alIsSource(ALuint source)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
 	return audiocontext.isSource(source);
 } 
 
 void alSourcef(ALuint source, ALenum param, ALfloat value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr) {
@@ -362,12 +387,14 @@ void alSourcef(ALuint source, ALenum param, ALfloat value)
 
 void alSource3f(ALuint source, ALenum param, ALfloat v1, ALfloat v2, ALfloat v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alSourcefv(ALuint source, ALenum param, ALfloat *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     if (values == nullptr) {
         ALSETERROR(AL_INVALID_VALUE);
@@ -378,6 +405,7 @@ void alSourcefv(ALuint source, ALenum param, ALfloat *values)
 
 void alSourcei(ALuint source, ALenum param, ALint value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr) {
@@ -446,12 +474,14 @@ void alSourcei(ALuint source, ALenum param, ALint value)
 
 void alSource3i(ALuint source, ALenum param, ALint v1, ALint v2, ALint v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alSourceiv(ALuint source, ALenum param, ALint *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     if (values == nullptr) {
         ALSETERROR(AL_INVALID_VALUE);
@@ -462,6 +492,7 @@ void alSourceiv(ALuint source, ALenum param, ALint *values)
 
 void alGetSourcef(ALuint source, ALenum param, ALfloat *value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
 
     if (value == nullptr) {
@@ -525,18 +556,21 @@ void alGetSourcef(ALuint source, ALenum param, ALfloat *value)
 
 void alGetSource3f(ALuint source, ALenum param, ALfloat *v1, ALfloat *v2, ALfloat *v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alGetSourcefv(ALuint source, ALenum param, ALfloat *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     alGetSourcef(source, param, values);
 }
 
 void alGetSourcei(ALuint source, ALenum param, ALint *value)
 {
+    PROFILE_HOOK();
     debuglog(LCF_OPENAL, __func__, " call for source ", source);
 
     if (value == nullptr) {
@@ -627,18 +661,21 @@ void alGetSourcei(ALuint source, ALenum param, ALint *value)
 
 void alGetSource3i(ALuint source, ALenum param, ALint *v1, ALint *v2, ALint *v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alGetSourceiv(ALuint source, ALenum param, ALint *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     alGetSourcei(source, param, values);
 }
 
 void alSourcePlay(ALuint source)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr)
@@ -648,11 +685,12 @@ void alSourcePlay(ALuint source)
         /* Restart the play from the beginning */
         as->setPosition(0);
     }
-    as->state = SOURCE_PLAYING;
+    audiocontext.playSource(as);
 }
 
 void alSourcePlayv(ALsizei n, ALuint *sources)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     for (int i=0; i<n; i++)
         alSourcePlay(sources[i]);
@@ -660,6 +698,7 @@ void alSourcePlayv(ALsizei n, ALuint *sources)
 
 void alSourcePause(ALuint source)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr)
@@ -674,6 +713,7 @@ void alSourcePause(ALuint source)
 
 void alSourcePausev(ALsizei n, ALuint *sources)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     for (int i=0; i<n; i++)
         alSourcePause(sources[i]);
@@ -681,6 +721,7 @@ void alSourcePausev(ALsizei n, ALuint *sources)
 
 void alSourceStop(ALuint source)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr)
@@ -696,6 +737,7 @@ void alSourceStop(ALuint source)
 
 void alSourceStopv(ALsizei n, ALuint *sources)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     for (int i=0; i<n; i++)
         alSourceStop(sources[i]);
@@ -703,6 +745,7 @@ void alSourceStopv(ALsizei n, ALuint *sources)
 
 void alSourceRewind(ALuint source)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr)
@@ -718,6 +761,7 @@ void alSourceRewind(ALuint source)
 
 void alSourceRewindv(ALsizei n, ALuint *sources)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     for (int i=0; i<n; i++)
         alSourceRewind(sources[i]);
@@ -725,6 +769,7 @@ void alSourceRewindv(ALsizei n, ALuint *sources)
 
 void alSourceQueueBuffers(ALuint source, ALsizei n, ALuint* buffers)
 {
+    PROFILE_HOOK();
     debuglog(LCF_OPENAL, "Pushing ", n, " buffers in the queue of source ", source);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr)
@@ -753,6 +798,7 @@ void alSourceQueueBuffers(ALuint source, ALsizei n, ALuint* buffers)
 
 void alSourceUnqueueBuffers(ALuint source, ALsizei n, ALuint* buffers)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     AudioSource* as = audiocontext.getSource(source);
     if (as == nullptr)
@@ -776,12 +822,11 @@ void alSourceUnqueueBuffers(ALuint source, ALsizei n, ALuint* buffers)
     /* Save the id of the unqueued buffers */
     for (int i=0; i<n; i++) {
         buffers[i] = as->buffer_queue[i]->id;
+        as->buffer_queue[i]->releaseConvertedSamples();
     }
 
-    /* Remove the buffers from the queue.
-     * TODO: This is slow on a vector, maybe use forward_list?
-     */
-    as->buffer_queue.erase(as->buffer_queue.begin(), as->buffer_queue.begin()+n);
+    /* Remove the buffers from the queue */
+    as->buffer_queue.pop_front(n);
     if (as->state != SOURCE_STOPPED)
         as->queue_index -= n;
 }
@@ -790,43 +835,52 @@ void alSourceUnqueueBuffers(ALuint source, ALsizei n, ALuint* buffers)
 
 void alListenerf(ALenum param, ALfloat value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
-    if (param == AL_GAIN)
+    if (param == AL_GAIN) {
+        audiocontext.waitMix();
         audiocontext.outVolume = value;
+    }
 }
 
 void alListener3f(ALenum param, ALfloat v1, ALfloat v2, ALfloat v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alListenerfv(ALenum param, ALfloat *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alListeneri(ALenum param, ALint value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alListener3i(ALenum param, ALint v1, ALint v2, ALint v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alListeneriv(ALenum param, ALint *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alGetListenerf(ALenum param, ALfloat *value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     if (param == AL_GAIN) {
         if (*value < 0) {
@@ -839,12 +893,14 @@ void alGetListenerf(ALenum param, ALfloat *value)
 
 void alGetListener3f(ALenum param, ALfloat *v1, ALfloat *v2, ALfloat *v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alGetListenerfv(ALenum param, ALfloat *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     if (param == AL_GAIN)
         alGetListenerf(param, values);
@@ -854,18 +910,21 @@ void alGetListenerfv(ALenum param, ALfloat *values)
 
 void alGetListeneri(ALenum param, ALint *value)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alGetListener3i(ALenum param, ALint *v1, ALint *v2, ALint *v3)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
 
 void alGetListeneriv(ALenum param, ALint *values)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_OPENAL);
     debuglog(LCF_OPENAL, "Operation not supported");
 }
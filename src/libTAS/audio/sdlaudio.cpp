@@ -89,6 +89,7 @@ void fillBufferCallback(AudioBuffer* ab);
 void fillBufferCallback(AudioBuffer* ab)
 {
     audioCallback(callbackArg, &ab->samples[0], ab->size);
+    ab->invalidateCache();
 }
 
 /* Override */ int SDL_OpenAudio(SDL_AudioSpec * desired, SDL_AudioSpec * obtained)
@@ -199,6 +200,7 @@ const char* dummySDLDevice = "libTAS device";
 /* Override */ SDL_AudioStatus SDL_GetAudioStatus(void)
 {
     DEBUGLOGCALL(LCF_SDL | LCF_SOUND);
+    audiocontext.waitMix();
     switch(sourceSDL->state) {
         case SOURCE_INITIAL:
         case SOURCE_STOPPED:
@@ -223,10 +225,11 @@ const char* dummySDLDevice = "libTAS device";
 {
     DEBUGLOGCALL(LCF_SDL | LCF_SOUND);
     if (pause_on == 0)
-        sourceSDL->state = SOURCE_PLAYING;
-    else
+        audiocontext.playSource(sourceSDL);
+    else {
+        audiocontext.waitMix();
         sourceSDL->state = SOURCE_PAUSED;
-    
+    }
 }
 
 /* Override */ void SDL_PauseAudioDevice(SDL_AudioDeviceID dev, int pause_on)
@@ -239,6 +242,8 @@ const char* dummySDLDevice = "libTAS device";
 {
     debuglog(LCF_SDL | LCF_SOUND, __func__, " call with ", len, " bytes of data");
 
+    audiocontext.waitMix();
+
     if (sourceSDL->source == SOURCE_CALLBACK) {
         /* We cannot queue samples when using the callback mechanism */
         return -1;
@@ -251,7 +256,7 @@ const char* dummySDLDevice = "libTAS device";
     if (sourceSDL->nbQueueProcessed() > 0) {
         /* Removing first buffer */
         ab = sourceSDL->buffer_queue[0];
-        sourceSDL->buffer_queue.erase(sourceSDL->buffer_queue.begin());
+        sourceSDL->buffer_queue.pop_front();
         sourceSDL->queue_index--;
     }
     else {
@@ -274,9 +279,8 @@ const char* dummySDLDevice = "libTAS device";
     }
 
     /* Filling buffer */
-    ab->samples.clear();
-    ab->samples.insert(ab->samples.end(), &((uint8_t*)data)[0], &((uint8_t*)data)[len]);
-    ab->size = len;
+    ab->setSamples(static_cast<const uint8_t*>(data), len);
+    ab->update();
     sourceSDL->buffer_queue.push_back(ab);
 
     return 0;
@@ -285,6 +289,7 @@ const char* dummySDLDevice = "libTAS device";
 /* Override */ Uint32 SDL_GetQueuedAudioSize(SDL_AudioDeviceID dev)
 {
     DEBUGLOGCALL(LCF_SDL | LCF_SOUND);
+    audiocontext.waitMix();
 
     if (sourceSDL->source == SOURCE_CALLBACK) {
         /* We cannot get queue samples when using the callback mechanism */
@@ -299,6 +304,7 @@ const char* dummySDLDevice = "libTAS device";
 /* Override */ void SDL_ClearQueuedAudio(SDL_AudioDeviceID dev)
 {
     DEBUGLOGCALL(LCF_SDL | LCF_SOUND);
+    audiocontext.waitMix();
 
     if (sourceSDL->source == SOURCE_CALLBACK) {
         /* We cannot get queue samples when using the callback mechanism */
@@ -25,6 +25,11 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/opt.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/samplefmt.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/dict.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/version.h>
 #include <libswscale/swscale.h>
 }
 #include "hook.h"
@@ -33,22 +38,634 @@ extern "C" {
 #include "audio/AudioContext.h"
 #include "../shared/tasflags.h"
 #include "ThreadState.h"
+#include "threads.h" // pthread_create_real
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm> // std::min
+#include <string.h> // memcpy
+#include <stdlib.h> // abs, atoi
+#include <unistd.h> // write, close
+#include <fcntl.h> // open
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h> // fprintf
 
 
-AVFrame* video_frame;
 AVFrame* audio_frame;
 struct SwsContext *toYUVctx = NULL;
-AVOutputFormat *outputFormat = NULL;
 AVFormatContext *formatContext = NULL;
 AVStream* video_st;
 AVStream* audio_st;
+AVCodecContext* video_ctx;
+AVCodecContext* audio_ctx;
+
+/* FFmpeg 5.1 replaced the channels and channel_layout fields by ch_layout */
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+#define LIBTAS_AV_CH_LAYOUT
+#endif
+
+/* Encoders used when linTAS does not choose one */
+#define DEFAULT_VIDEO_ENCODER "mpeg4"
+#define DEFAULT_VIDEO_OPTIONS "b=400k,g=10,bf=1"
+#define DEFAULT_AUDIO_ENCODER "pcm_s16le"
+
+std::string videoEncoderName;
+std::string videoEncoderOptions;
+std::string audioEncoderName;
+std::string audioEncoderOptions;
+std::string rawAudioFilename;
 
 /* We save the frame when the dumping begins */
 int start_frame;
 
+/* Dimensions of the dumped screen */
+static int dump_width, dump_height;
+
+/* Files of a raw dump, and name of the pixel format of the frames.
+ * Inherited file descriptors are not ours, and are never closed, so that
+ * the dump can continue after a restart (e.g. when the window is resized) */
+static int raw_video_fd = -1;
+static int raw_audio_fd = -1;
+static bool raw_video_inherited;
+static bool raw_audio_inherited;
+static char raw_pixfmt[16];
+
 /* The accumulated number of audio samples */
 uint64_t accum_samples;
 
+/* Mixed audio samples waiting to fill a frame of the audio encoder */
+static std::vector<uint8_t> audio_fifo;
+
+/*
+ * Encoding is done by a pipeline of threads, so that the game only waits
+ * for the copy of the screen and the audio of each frame.
+ * Frames go through a ring of slots, and each stage of the pipeline
+ * processes the slots in order, after the stage it depends on:
+ *
+ *   game -> convert -> video encode -\
+ *        \-------> audio encode -----+-> mux
+ *
+ * Packets are written by the mux stage in the same order as if the
+ * frames were encoded by the game thread, so the dump does not depend
+ * on the timing of the threads. When all slots are in use, the game
+ * waits for the mux stage to release one. No frame is ever dropped.
+ */
+
+/* Number of frames that can be in the pipeline */
+#define DUMP_QUEUE_SIZE 6
+
+enum DumpStage {
+    STAGE_CONVERT,
+    STAGE_VIDEO,
+    STAGE_AUDIO,
+    STAGE_MUX,
+    STAGE_NB
+};
+
+struct DumpSlot {
+    /* Copy of the screen pixels, packed format, positive stride */
+    std::vector<uint8_t> pixels;
+    int stride;
+
+    /* Frame converted to the pixel format of the encoder */
+    AVFrame* video_frame;
+
+    /* Copy of the mixed audio samples */
+    std::vector<uint8_t> audio;
+    int audio_samples;
+
+    /* Timestamp of the video frame */
+    int64_t pts;
+
+    /* Encoded packets, to be written by the mux stage */
+    std::vector<AVPacket*> video_packets;
+    std::vector<AVPacket*> audio_packets;
+};
+
+static DumpSlot slots[DUMP_QUEUE_SIZE];
+
+/* Number of frames whose audio was copied by the game. The screen can be
+ * captured with some delay, so the pixels may be copied at a later frame */
+static uint64_t capture_index;
+
+/* Number of frames sent by the game and processed by each stage */
+static uint64_t push_index;
+static uint64_t stage_index[STAGE_NB];
+
+/* Has each stage processed all frames and terminated */
+static bool stage_done[STAGE_NB];
+
+static pthread_t stage_threads[STAGE_NB];
+static bool pipeline_running = false;
+
+/* No more frames will be sent by the game */
+static bool pipeline_quit;
+
+/* A stage failed. Following frames are not encoded anymore */
+static bool pipeline_error;
+
+/* Protects all the pipeline state above, except the content of the
+ * slots which are owned by the stage processing them */
+static std::mutex pipeline_mutex;
+static std::condition_variable pipeline_cond;
+
+/* Number of frames available to a stage */
+static uint64_t stageInput(int stage)
+{
+    switch (stage) {
+        case STAGE_VIDEO:
+            return stage_index[STAGE_CONVERT];
+        case STAGE_MUX:
+            return std::min(stage_index[STAGE_VIDEO], stage_index[STAGE_AUDIO]);
+        default:
+            return push_index;
+    }
+}
+
+/* Will the input of a stage not grow anymore */
+static bool stageInputDone(int stage)
+{
+    switch (stage) {
+        case STAGE_VIDEO:
+            return stage_done[STAGE_CONVERT];
+        case STAGE_MUX:
+            return stage_done[STAGE_VIDEO] && stage_done[STAGE_AUDIO];
+        default:
+            return pipeline_quit;
+    }
+}
+
+/* Get all the packets that the encoder has ready, and rescale their
+ * timestamps to the stream */
+static bool receivePackets(AVCodecContext* ctx, AVStream* st, std::vector<AVPacket*>& packets)
+{
+    while (1) {
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate packet");
+            return false;
+        }
+
+        int ret = avcodec_receive_packet(ctx, pkt);
+        if ((ret == AVERROR(EAGAIN)) || (ret == AVERROR_EOF)) {
+            av_packet_free(&pkt);
+            return true;
+        }
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            debuglog(LCF_DUMP | LCF_ERROR, "Error encoding frame");
+            return false;
+        }
+
+        av_packet_rescale_ts(pkt, ctx->time_base, st->time_base);
+        pkt->stream_index = st->index;
+        packets.push_back(pkt);
+    }
+}
+
+/* Change pixel format to the one of the encoder and copy it into the AVframe */
+static bool convertFrame(DumpSlot& slot)
+{
+    const uint8_t* plane[4] = {slot.pixels.data(), NULL, NULL, NULL};
+    int stride[4] = {slot.stride, 0, 0, 0};
+
+    int rets = sws_scale(toYUVctx, plane, stride, 0, video_ctx->height,
+                slot.video_frame->data, slot.video_frame->linesize);
+    if (rets != video_ctx->height) {
+        debuglog(LCF_DUMP | LCF_ERROR, "We could only convert ",rets," rows");
+        return false;
+    }
+    return true;
+}
+
+/* Encode the image */
+static bool encodeVideo(DumpSlot& slot)
+{
+    slot.video_frame->pts = slot.pts;
+
+    if (avcodec_send_frame(video_ctx, slot.video_frame) < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Error encoding video frame");
+        return false;
+    }
+
+    return receivePackets(video_ctx, video_st, slot.video_packets);
+}
+
+/* Number of channels of the audio encoder */
+static int audioChannels(void)
+{
+#ifdef LIBTAS_AV_CH_LAYOUT
+    return audio_ctx->ch_layout.nb_channels;
+#else
+    return audio_ctx->channels;
+#endif
+}
+
+/* Convert interleaved samples of the mix into the audio frame,
+ * in the sample format of the encoder */
+static void convertSamples(const uint8_t* samples, int nbSamples)
+{
+    int nbChannels = audioChannels();
+    AVSampleFormat fmt = av_get_packed_sample_fmt(audio_ctx->sample_fmt);
+    bool planar = av_sample_fmt_is_planar(audio_ctx->sample_fmt);
+
+    for (int i = 0; i < nbSamples; i++) {
+        for (int ch = 0; ch < nbChannels; ch++) {
+            int16_t v;
+            if (audiocontext.outBitDepth == 8)
+                v = (samples[i*nbChannels + ch] - 128) << 8;
+            else
+                memcpy(&v, samples + 2*(i*nbChannels + ch), 2);
+
+            int plane = planar ? ch : 0;
+            int index = planar ? i : (i*nbChannels + ch);
+            switch (fmt) {
+                case AV_SAMPLE_FMT_U8:
+                    audio_frame->data[plane][index] = (v >> 8) + 128;
+                    break;
+                case AV_SAMPLE_FMT_S16:
+                    reinterpret_cast<int16_t*>(audio_frame->data[plane])[index] = v;
+                    break;
+                case AV_SAMPLE_FMT_S32:
+                    reinterpret_cast<int32_t*>(audio_frame->data[plane])[index] = v << 16;
+                    break;
+                case AV_SAMPLE_FMT_FLT:
+                    reinterpret_cast<float*>(audio_frame->data[plane])[index] = v / 32768.0f;
+                    break;
+                case AV_SAMPLE_FMT_DBL:
+                    reinterpret_cast<double*>(audio_frame->data[plane])[index] = v / 32768.0;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/* Send a frame of samples from the start of the audio fifo to the
+ * encoder. The frame is completed with silence if needed. */
+static bool sendAudioFrame(int frameSamples, std::vector<AVPacket*>& packets)
+{
+    int available = audio_fifo.size() / audiocontext.outAlignSize;
+    int nbSamples = std::min(frameSamples, available);
+
+    av_frame_unref(audio_frame);
+    audio_frame->nb_samples = frameSamples;
+    audio_frame->format = audio_ctx->sample_fmt;
+#ifdef LIBTAS_AV_CH_LAYOUT
+    if (av_channel_layout_copy(&audio_frame->ch_layout, &audio_ctx->ch_layout) < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not set the audio frame channel layout");
+        return false;
+    }
+#else
+    audio_frame->channels = audio_ctx->channels;
+    audio_frame->channel_layout = audio_ctx->channel_layout;
+#endif
+    audio_frame->sample_rate = audio_ctx->sample_rate;
+    if (av_frame_get_buffer(audio_frame, 0) < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate audio frame");
+        return false;
+    }
+
+    av_samples_set_silence(audio_frame->extended_data, 0, frameSamples, audioChannels(), audio_ctx->sample_fmt);
+    convertSamples(audio_fifo.data(), nbSamples);
+    audio_fifo.erase(audio_fifo.begin(), audio_fifo.begin() + nbSamples * audiocontext.outAlignSize);
+
+    audio_frame->pts = accum_samples;
+    accum_samples += frameSamples;
+
+    if (avcodec_send_frame(audio_ctx, audio_frame) < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Error encoding audio frame");
+        return false;
+    }
+
+    return receivePackets(audio_ctx, audio_st, packets);
+}
+
+/* Number of samples in each audio frame sent to the encoder,
+ * or 0 if the encoder accepts any number of samples */
+static int audioFrameSize(void)
+{
+    if ((audio_ctx->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) || (audio_ctx->frame_size == 0))
+        return 0;
+    return audio_ctx->frame_size;
+}
+
+/* Encode the audio samples. Encoders that take a fixed number of
+ * samples get them once enough frames of the game are gathered */
+static bool encodeAudio(DumpSlot& slot)
+{
+    audio_fifo.insert(audio_fifo.end(), slot.audio.begin(), slot.audio.end());
+
+    int frameSize = audioFrameSize();
+    if (frameSize == 0)
+        return (slot.audio_samples == 0) || sendAudioFrame(slot.audio_samples, slot.audio_packets);
+
+    while (static_cast<int>(audio_fifo.size() / audiocontext.outAlignSize) >= frameSize)
+        if (!sendAudioFrame(frameSize, slot.audio_packets))
+            return false;
+    return true;
+}
+
+/* Write packets to the file. Packets are freed even if not written. */
+static bool writePackets(std::vector<AVPacket*>& packets, bool write)
+{
+    for (AVPacket*& pkt : packets) {
+        if (write && (av_interleaved_write_frame(formatContext, pkt) < 0)) {
+            debuglog(LCF_DUMP | LCF_ERROR, "Error writing frame");
+            write = false;
+        }
+        av_packet_free(&pkt);
+    }
+    packets.clear();
+    return write;
+}
+
+/* Write the packets of a frame, video first as when frames were
+ * encoded by the game thread. */
+static bool muxFrame(DumpSlot& slot, bool write)
+{
+    write = writePackets(slot.video_packets, write);
+    return writePackets(slot.audio_packets, write);
+}
+
+/* Write a whole buffer, which may take several calls for pipes */
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* buf = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t ret = write(fd, buf, size);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+/* Write the pixels and the audio samples of a frame to the raw dump */
+static bool writeRawFrame(DumpSlot& slot)
+{
+    if (tasflags.raw_dumping == 2) {
+        RawFrameHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RAW_FRAME_MAGIC, sizeof(header.magic));
+        header.header_size = sizeof(header);
+        header.width = dump_width;
+        header.height = dump_height;
+        header.stride = slot.stride;
+        header.framerate = tasflags.framerate;
+        memcpy(header.pixfmt, raw_pixfmt, sizeof(header.pixfmt));
+        header.pts = slot.pts;
+        header.size = slot.pixels.size();
+        if (!writeAll(raw_video_fd, &header, sizeof(header))) {
+            debuglog(LCF_DUMP | LCF_ERROR, "Error writing raw video frame");
+            return false;
+        }
+    }
+
+    if (!writeAll(raw_video_fd, slot.pixels.data(), slot.pixels.size())) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Error writing raw video frame");
+        return false;
+    }
+    if (!writeAll(raw_audio_fd, slot.audio.data(), slot.audio.size())) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Error writing raw audio samples");
+        return false;
+    }
+    return true;
+}
+
+static bool runStage(int stage, DumpSlot& slot, bool skip)
+{
+    /* Raw dumps are written as captured, only the mux stage has work */
+    if (tasflags.raw_dumping) {
+        if (stage == STAGE_MUX)
+            return skip || writeRawFrame(slot);
+        return true;
+    }
+
+    switch (stage) {
+        case STAGE_CONVERT:
+            return skip || convertFrame(slot);
+        case STAGE_VIDEO:
+            return skip || encodeVideo(slot);
+        case STAGE_AUDIO:
+            return skip || encodeAudio(slot);
+        case STAGE_MUX:
+            return muxFrame(slot, !skip) || skip;
+    }
+    return false;
+}
+
+static void* stageLoop(void* arg)
+{
+    int stage = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+    threadState.setNative(true);
+
+    /* If an external encoder reading the dump exits, we want writes to
+     * fail instead of the game being killed by SIGPIPE */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+    std::unique_lock<std::mutex> lock(pipeline_mutex);
+    while (1) {
+        if (stage_index[stage] < stageInput(stage)) {
+            DumpSlot& slot = slots[stage_index[stage] % DUMP_QUEUE_SIZE];
+            bool skip = pipeline_error;
+
+            /* Each slot is only accessed by one stage at a time */
+            lock.unlock();
+            bool ok = runStage(stage, slot, skip);
+            lock.lock();
+
+            if (!ok)
+                pipeline_error = true;
+            stage_index[stage]++;
+            pipeline_cond.notify_all();
+        }
+        else if (stageInputDone(stage))
+            break;
+        else
+            pipeline_cond.wait(lock);
+    }
+
+    stage_done[stage] = true;
+    pipeline_cond.notify_all();
+    return nullptr;
+}
+
+static int startPipeline(void)
+{
+    capture_index = 0;
+    push_index = 0;
+    pipeline_quit = false;
+    pipeline_error = false;
+    for (int stage = 0; stage < STAGE_NB; stage++) {
+        stage_index[stage] = 0;
+        stage_done[stage] = false;
+    }
+
+    for (int stage = 0; stage < STAGE_NB; stage++) {
+        if (pthread_create_real(&stage_threads[stage], nullptr, stageLoop, reinterpret_cast<void*>(static_cast<intptr_t>(stage))) != 0) {
+            debuglog(LCF_DUMP | LCF_ERROR, "Could not start the encoding threads");
+            /* Terminate the threads already started */
+            {
+                std::lock_guard<std::mutex> lock(pipeline_mutex);
+                pipeline_quit = true;
+            }
+            pipeline_cond.notify_all();
+            for (int s = 0; s < stage; s++)
+                pthread_join_real(stage_threads[s], nullptr);
+            return 1;
+        }
+    }
+    pipeline_running = true;
+    return 0;
+}
+
+/* Wait for all frames to be written and terminate the threads */
+static void stopPipeline(void)
+{
+    if (!pipeline_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(pipeline_mutex);
+        pipeline_quit = true;
+    }
+    pipeline_cond.notify_all();
+
+    for (int stage = 0; stage < STAGE_NB; stage++)
+        pthread_join_real(stage_threads[stage], nullptr);
+    pipeline_running = false;
+}
+
+/* Open an encoder with options given as a list of key=value separated
+ * by commas. Options that the encoder does not know are reported */
+static int openEncoder(AVCodecContext* ctx, const AVCodec* codec, const char* options)
+{
+    AVDictionary* dict = NULL;
+    if (av_dict_parse_string(&dict, options, "=", ",", 0) < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not parse the encoder options ", options);
+        av_dict_free(&dict);
+        return 1;
+    }
+
+    int ret = avcodec_open2(ctx, codec, &dict);
+
+    AVDictionaryEntry* entry = NULL;
+    while ((entry = av_dict_get(dict, "", entry, AV_DICT_IGNORE_SUFFIX)))
+        debuglog(LCF_DUMP | LCF_ERROR, "Unknown option ", entry->key, " for encoder ", codec->name);
+    av_dict_free(&dict);
+
+    if (ret < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not open encoder ", codec->name);
+        return 1;
+    }
+    return 0;
+}
+
+/* Choose the sample format of the audio encoder. We prefer the format
+ * of the mix, otherwise the first format that we can convert to */
+static AVSampleFormat chooseSampleFormat(const AVCodec* codec, AVSampleFormat mix_fmt)
+{
+    if (!codec->sample_fmts)
+        return mix_fmt;
+
+    for (const AVSampleFormat* fmt = codec->sample_fmts; *fmt != AV_SAMPLE_FMT_NONE; fmt++)
+        if (*fmt == mix_fmt)
+            return mix_fmt;
+
+    for (const AVSampleFormat* fmt = codec->sample_fmts; *fmt != AV_SAMPLE_FMT_NONE; fmt++) {
+        switch (av_get_packed_sample_fmt(*fmt)) {
+            case AV_SAMPLE_FMT_U8:
+            case AV_SAMPLE_FMT_S16:
+            case AV_SAMPLE_FMT_S32:
+            case AV_SAMPLE_FMT_FLT:
+            case AV_SAMPLE_FMT_DBL:
+                return *fmt;
+            default:
+                break;
+        }
+    }
+    return AV_SAMPLE_FMT_NONE;
+}
+
+/* Open a file of the raw dump. fd:N designates a file descriptor inherited
+ * by the game, like a pipe to an external encoder. Opening a FIFO waits
+ * for the encoder to open it. */
+static int openRawOutput(const char* path, bool* inherited)
+{
+    *inherited = (strncmp(path, "fd:", 3) == 0);
+    if (*inherited) {
+        int fd = atoi(path + 3);
+        if (fcntl(fd, F_GETFD) < 0)
+            return -1;
+        return fd;
+    }
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+/* Close a file of the raw dump, which signals the end of the stream
+ * to the encoder, unless it was inherited */
+static void closeRawOutput(int* fd, bool inherited)
+{
+    if ((*fd >= 0) && !inherited)
+        close(*fd);
+    *fd = -1;
+}
+
+/* Open the files of a raw dump. Nothing is encoded inside the game,
+ * so no FFmpeg context is allocated */
+static int openRawDumping(const char* dumpfile, AVPixelFormat pixfmt)
+{
+    if (rawAudioFilename.empty()) {
+        debuglog(LCF_DUMP | LCF_ERROR, "No file for the raw audio samples");
+        return 1;
+    }
+
+    const char* pixfmt_name = av_get_pix_fmt_name(pixfmt);
+    memset(raw_pixfmt, 0, sizeof(raw_pixfmt));
+    strncpy(raw_pixfmt, pixfmt_name ? pixfmt_name : "", sizeof(raw_pixfmt) - 1);
+
+    threadState.setOwnCode(true); // We protect the following code because it performs IO that we hook
+    raw_video_fd = openRawOutput(dumpfile, &raw_video_inherited);
+    if (raw_video_fd >= 0)
+        raw_audio_fd = openRawOutput(rawAudioFilename.c_str(), &raw_audio_inherited);
+    threadState.setOwnCode(false);
+
+    if (raw_video_fd < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not open raw video file ", dumpfile);
+        return 1;
+    }
+    if (raw_audio_fd < 0) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not open raw audio file ", rawAudioFilename);
+        closeRawOutput(&raw_video_fd, raw_video_inherited);
+        return 1;
+    }
+
+    /* Print the format of the streams, as options of an ffmpeg input,
+     * like av_dump_format does for encoded dumps */
+    if (tasflags.raw_dumping == 2)
+        fprintf(stderr, "Raw dump: %s %dx%d frames at %u fps into %s, each preceded by a RawFrameHeader\n",
+                raw_pixfmt, dump_width, dump_height, tasflags.framerate, dumpfile);
+    else
+        fprintf(stderr, "Raw dump: -f rawvideo -pix_fmt %s -s %dx%d -r %u -i %s\n",
+                raw_pixfmt, dump_width, dump_height, tasflags.framerate, dumpfile);
+    fprintf(stderr, "Raw dump: -f %s -ar %d -ac %d -i %s\n",
+            (audiocontext.outBitDepth == 8) ? "u8" : "s16le",
+            audiocontext.outFrequency, audiocontext.outNbChannels, rawAudioFilename.c_str());
+
+    return startPipeline();
+}
+
 int openAVDumping(void* window, bool video_opengl, char* dumpfile, int sf) {
 
     if (tasflags.framerate <= 0) {
@@ -65,153 +682,165 @@ int openAVDumping(void* window, bool video_opengl, char* dumpfile, int sf) {
         debuglog(LCF_DUMP | LCF_ERROR, "Unable to initialize video capture");
         return 1;
     }
+    dump_width = width;
+    dump_height = height;
 
+    if (tasflags.raw_dumping)
+        return openRawDumping(dumpfile, pixfmt);
+
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
     /* Initialize AVCodec and AVFormat libraries */
     av_register_all();
+#endif
 
-    /* Initialize AVOutputFormat */
-    outputFormat = av_guess_format(NULL, dumpfile, NULL);
-    if (!outputFormat) {
+    /* Initialize AVFormatContext, guessing the container from the file name */
+    if (avformat_alloc_output_context2(&formatContext, NULL, NULL, dumpfile) < 0) {
         debuglog(LCF_DUMP | LCF_ERROR, "Could not find suitable output format for file ", dumpfile);
         return 1;
     }
 
-    /* Initialize AVFormatContext */
-
-    formatContext = avformat_alloc_context();
-    if (!formatContext) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Could not initialize AVFormatContext");
-        return 1;
-    }
-    formatContext->oformat = outputFormat;
-
     /*** Create video stream ***/
 
     /* Initialize video AVCodec */
-
-    AVCodec *video_codec = NULL;
-    AVCodecID codec_id = AV_CODEC_ID_MPEG4;
-    //int codec_id = AV_CODEC_ID_H264;
-    video_codec = avcodec_find_encoder(codec_id);
+    const char* video_name = videoEncoderName.empty() ? DEFAULT_VIDEO_ENCODER : videoEncoderName.c_str();
+    const AVCodec *video_codec = avcodec_find_encoder_by_name(video_name);
     if (!video_codec) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Video codec not found");
+        debuglog(LCF_DUMP | LCF_ERROR, "Video encoder ", video_name, " not found");
         return 1;
     }
-    outputFormat->video_codec = codec_id;
-
-    /* Initialize video stream */
 
-    video_st = avformat_new_stream(formatContext, video_codec);
+    video_st = avformat_new_stream(formatContext, NULL);
     if (!video_st) {
         debuglog(LCF_DUMP | LCF_ERROR, "Could not initialize video AVStream");
         return 1;
     }
-
-    /* Fill video stream parameters */
     video_st->id = formatContext->nb_streams - 1;
-    video_st->codec->codec_type = AVMEDIA_TYPE_VIDEO;
-    video_st->codec->codec_id = codec_id;
-
-    video_st->codec->bit_rate = 400000;
-    video_st->codec->width = width;
-    video_st->codec->height = height;
-    video_st->time_base = (AVRational){1,(int)tasflags.framerate};
-    video_st->codec->time_base = (AVRational){1,(int)tasflags.framerate};
-    video_st->codec->gop_size = 10; /* emit one intra frame every ten frames */
-    video_st->codec->max_b_frames = 1;
-    video_st->codec->pix_fmt = AV_PIX_FMT_YUV420P;
+
+    video_ctx = avcodec_alloc_context3(video_codec);
+    if (!video_ctx) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate video codec context");
+        return 1;
+    }
+
+    /* Fill video codec parameters */
+    video_ctx->width = width;
+    video_ctx->height = height;
+    video_ctx->time_base = (AVRational){1,(int)tasflags.framerate};
+
+    /* Use the pixel format of the encoder that loses the least
+     * information from the screen. Can be changed with the option
+     * pixel_format */
+    if (video_codec->pix_fmts)
+        video_ctx->pix_fmt = avcodec_find_best_pix_fmt_of_list(video_codec->pix_fmts, pixfmt, 0, NULL);
+    else
+        video_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
 
     /* Some formats want stream headers to be separate. */
     if (formatContext->oformat->flags & AVFMT_GLOBALHEADER)
-        video_st->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+        video_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-    /* Use a preset for h264 */
-    if (codec_id == AV_CODEC_ID_H264)
-        av_opt_set(video_st->codec->priv_data, "preset", "slow", 0);
+    /* Let the codec use its own threads, with as many threads as cores.
+     * Can be changed with the option threads */
+    video_ctx->thread_count = 0;
+    video_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
 
-    /* Open the codec */
-    if (avcodec_open2(video_st->codec, video_codec, NULL) < 0) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Could not open video codec");
+    /* Open the codec with the user options */
+    const char* video_options = (videoEncoderName.empty() && videoEncoderOptions.empty()) ?
+                                DEFAULT_VIDEO_OPTIONS : videoEncoderOptions.c_str();
+    if (openEncoder(video_ctx, video_codec, video_options) != 0)
         return 1;
-    }
-    
+
+    video_st->time_base = video_ctx->time_base;
+    avcodec_parameters_from_context(video_st->codecpar, video_ctx);
+
     /*** Create audio stream ***/
 
     /* Initialize audio AVCodec */
-
-    AVCodec *audio_codec = NULL;
-    AVCodecID audio_codec_id = AV_CODEC_ID_PCM_S16LE;
-    //AVCodecID audio_codec_id = AV_CODEC_ID_VORBIS;
-    audio_codec = avcodec_find_encoder(audio_codec_id);
+    const char* audio_name = audioEncoderName.empty() ? DEFAULT_AUDIO_ENCODER : audioEncoderName.c_str();
+    const AVCodec *audio_codec = avcodec_find_encoder_by_name(audio_name);
     if (!audio_codec) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Audio codec not found");
+        debuglog(LCF_DUMP | LCF_ERROR, "Audio encoder ", audio_name, " not found");
         return 1;
     }
 
-    /* Initialize audio stream */
-
-    audio_st = avformat_new_stream(formatContext, audio_codec);
+    audio_st = avformat_new_stream(formatContext, NULL);
     if (!audio_st) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Could not initialize video AVStream");
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not initialize audio AVStream");
         return 1;
     }
+    audio_st->id = formatContext->nb_streams - 1;
 
-    /* Fill audio stream parameters */
+    audio_ctx = avcodec_alloc_context3(audio_codec);
+    if (!audio_ctx) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate audio codec context");
+        return 1;
+    }
 
-    audio_st->id = formatContext->nb_streams - 1;
-    audio_st->codec->codec_type = AVMEDIA_TYPE_AUDIO;
+    /* Fill audio codec parameters */
+    AVSampleFormat mix_fmt;
     if (audiocontext.outBitDepth == 8)
-        audio_st->codec->sample_fmt = AV_SAMPLE_FMT_U8;
+        mix_fmt = AV_SAMPLE_FMT_U8;
     else if (audiocontext.outBitDepth == 16)
-        audio_st->codec->sample_fmt = AV_SAMPLE_FMT_S16;
+        mix_fmt = AV_SAMPLE_FMT_S16;
     else {
         debuglog(LCF_DUMP | LCF_ERROR, "Unknown audio format");
         return 1;
     }
-    audio_st->codec->bit_rate = 64000;
-    audio_st->codec->sample_rate = audiocontext.outFrequency;
-    audio_st->codec->channels = audiocontext.outNbChannels;
+    audio_ctx->sample_fmt = chooseSampleFormat(audio_codec, mix_fmt);
+    if (audio_ctx->sample_fmt == AV_SAMPLE_FMT_NONE) {
+        debuglog(LCF_DUMP | LCF_ERROR, "Audio encoder ", audio_name, " does not support any of our sample formats");
+        return 1;
+    }
+    audio_ctx->sample_rate = audiocontext.outFrequency;
+#ifdef LIBTAS_AV_CH_LAYOUT
+    av_channel_layout_default(&audio_ctx->ch_layout, audiocontext.outNbChannels);
+#else
+    audio_ctx->channels = audiocontext.outNbChannels;
+    audio_ctx->channel_layout = av_get_default_channel_layout(audiocontext.outNbChannels);
+#endif
+    audio_ctx->time_base = (AVRational){1, audiocontext.outFrequency};
 
     /* Some formats want stream headers to be separate. */
-
     if (formatContext->oformat->flags & AVFMT_GLOBALHEADER)
-        audio_st->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+        audio_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-    /* Open the codec */
-    if (avcodec_open2(audio_st->codec, audio_codec, NULL) < 0) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Could not open audio codec");
+    /* Open the codec with the user options */
+    const char* audio_options = audioEncoderOptions.c_str();
+    if (openEncoder(audio_ctx, audio_codec, audio_options) != 0)
         return 1;
-    }
 
-    /* Initialize video AVFrame */
-
-    video_frame = av_frame_alloc();
-    if (!video_frame) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate AVFrame");
-        return 1;
-    }
-    video_frame->format = video_st->codec->pix_fmt;
-    video_frame->width  = video_st->codec->width;
-    video_frame->height = video_st->codec->height;
+    audio_st->time_base = audio_ctx->time_base;
+    avcodec_parameters_from_context(audio_st->codecpar, audio_ctx);
 
     /* Initialize audio AVFrame */
     audio_frame = av_frame_alloc();
 
-    /* Allocate the image buffer inside the AVFrame */
+    /* Initialize the video AVFrame of each slot of the pipeline,
+     * and allocate the image buffer inside */
+    for (int s = 0; s < DUMP_QUEUE_SIZE; s++) {
+        AVFrame* video_frame = av_frame_alloc();
+        if (!video_frame) {
+            debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate AVFrame");
+            return 1;
+        }
+        video_frame->format = video_ctx->pix_fmt;
+        video_frame->width  = video_ctx->width;
+        video_frame->height = video_ctx->height;
+        slots[s].video_frame = video_frame;
 
-    int ret = av_image_alloc(video_frame->data, video_frame->linesize, video_st->codec->width, video_st->codec->height, video_st->codec->pix_fmt, 32);
-    if (ret < 0) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate raw picture buffer");
-        return 1;
+        int ret = av_image_alloc(video_frame->data, video_frame->linesize, video_ctx->width, video_ctx->height, video_ctx->pix_fmt, 32);
+        if (ret < 0) {
+            debuglog(LCF_DUMP | LCF_ERROR, "Could not allocate raw picture buffer");
+            return 1;
+        }
     }
 
-
     /* Initialize swscale context for pixel format conversion */
 
-    toYUVctx = sws_getContext(video_frame->width, video_frame->height,  
+    toYUVctx = sws_getContext(width, height,
                               pixfmt,
-                              video_frame->width, video_frame->height, 
-                              AV_PIX_FMT_YUV420P,
+                              width, height,
+                              video_ctx->pix_fmt,
                               SWS_LANCZOS | SWS_ACCURATE_RND, NULL,NULL,NULL);
 
     if (toYUVctx == NULL) {
@@ -238,182 +867,170 @@ int openAVDumping(void* window, bool video_opengl, char* dumpfile, int sf) {
     }
 
     threadState.setOwnCode(false);
-    return 0;
+
+    return startPipeline();
+}
+
+/* Copy the pixels of the oldest frame waiting for them, which are only
+ * valid until the next capture, and send it to the encoding threads.
+ * Captured formats are packed, so only the first plane is used. */
+static void pushFrame(const uint8_t* plane, int stride)
+{
+    DumpSlot& slot = slots[push_index % DUMP_QUEUE_SIZE];
+
+    /* Rows are stored from the top, which flips images read from the bottom */
+    int height = dump_height;
+    slot.stride = abs(stride);
+    slot.pixels.resize(slot.stride * height);
+    for (int row = 0; row < height; row++)
+        memcpy(&slot.pixels[row * slot.stride], plane + row * stride, slot.stride);
+
+    {
+        std::lock_guard<std::mutex> lock(pipeline_mutex);
+        push_index++;
+    }
+    pipeline_cond.notify_all();
 }
 
 /*
- * Encode one frame and send it to the muxer
+ * Copy the screen and the audio of the frame, and send it to the encoding
+ * threads. Waits if too many frames are still being encoded.
  * Returns 0 if no error was encountered
  */
 
 int encodeOneFrame(unsigned long fcounter) {
 
-    /*** Video ***/
-    debuglog(LCF_DUMP | LCF_FRAME, "Encode a video frame");
-
-    const uint8_t* orig_plane[4] = {0};
-    int orig_stride[4] = {0};
-
-    /* Access to the screen pixels */
-    captureVideoFrame(orig_plane, orig_stride);
-
-    /* Initialize AVPacket */
-    AVPacket vpkt;
-    vpkt.data = NULL;
-    vpkt.size = 0;
-    av_init_packet(&vpkt);
-
-    /* Change pixel format to YUV420p and copy it into the AVframe */
-    int rets = sws_scale(toYUVctx, orig_plane, orig_stride, 0, 
-                video_frame->height, video_frame->data, video_frame->linesize);
-    if (rets != video_frame->height) {
-        debuglog(LCF_DUMP | LCF_ERROR, "We could only convert ",rets," rows");
-        return 1;
-    }
-
-    video_frame->pts = fcounter - start_frame;
+    /* The dump is closed when the game window is destroyed, and opened
+     * again when the game creates a new one */
+    if (!pipeline_running)
+        return 0;
 
-    /* Encode the image */
-    int got_output;
-    int ret = avcodec_encode_video2(video_st->codec, &vpkt, video_frame, &got_output);
-    if (ret < 0) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Error encoding video frame");
-        return 1;
-    }
+    debuglog(LCF_DUMP | LCF_FRAME, "Encode a frame");
 
-    if (got_output) {
-        /* Rescale output packet timestamp values from codec to stream timebase */
-        vpkt.pts = av_rescale_q_rnd(vpkt.pts, video_st->codec->time_base, video_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-        vpkt.dts = av_rescale_q_rnd(vpkt.dts, video_st->codec->time_base, video_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-        vpkt.duration = av_rescale_q(vpkt.duration, video_st->codec->time_base, video_st->time_base);
-        vpkt.stream_index = video_st->index;
-        if (av_interleaved_write_frame(formatContext, &vpkt) < 0) {
-            debuglog(LCF_DUMP | LCF_ERROR, "Error writing frame");
+    DumpSlot* slot;
+    {
+        std::unique_lock<std::mutex> lock(pipeline_mutex);
+        if (pipeline_error)
             return 1;
-        }
-        av_free_packet(&vpkt);
+
+        /* Wait for a free slot */
+        pipeline_cond.wait(lock, []{return (capture_index - stage_index[STAGE_MUX]) < DUMP_QUEUE_SIZE;});
+        slot = &slots[capture_index % DUMP_QUEUE_SIZE];
     }
 
     /*** Audio ***/
-    debuglog(LCF_DUMP | LCF_FRAME, "Encode an audio frame");
 
-    /* Initialize AVPacket */
-    AVPacket apkt;
-    apkt.data = NULL;
-    apkt.size = 0;
-    av_init_packet(&apkt);
+    /* The audio of this frame may still be mixed by the mixing thread */
+    audiocontext.waitMix();
 
-    int frame_size;
-    if (audio_st->codec->codec->capabilities & CODEC_CAP_VARIABLE_FRAME_SIZE)
-        frame_size = audiocontext.outNbSamples;
-    else {
-        frame_size = audio_st->codec->frame_size;
-        if (frame_size > audiocontext.outNbSamples) {
-            debuglog(LCF_DUMP | LCF_FRAME | LCF_ERROR, "This is bad...");
-            frame_size = audiocontext.outNbSamples;
-        }
-    }
-
-    audio_frame->nb_samples = frame_size;
-    audio_frame->pts = av_rescale_q(accum_samples, (AVRational){1, audio_st->codec->sample_rate}, audio_st->codec->time_base);
-    accum_samples += frame_size;
+    slot->audio.assign(audiocontext.outSamples.begin(), audiocontext.outSamples.begin() + audiocontext.outBytes);
+    slot->audio_samples = audiocontext.outNbSamples;
+    slot->pts = fcounter - start_frame;
+    capture_index++;
 
-    avcodec_fill_audio_frame(audio_frame, audio_st->codec->channels, audio_st->codec->sample_fmt,
-                                             &audiocontext.outSamples[0], frame_size*audiocontext.outAlignSize, 1);
+    /*** Video ***/
+    const uint8_t* orig_plane[4] = {0};
+    int orig_stride[4] = {0};
 
-    ret = avcodec_encode_audio2(audio_st->codec, &apkt, audio_frame, &got_output);
-    if (ret < 0) {
-        debuglog(LCF_DUMP | LCF_ERROR, "Error encoding audio frame");
+    /* Access to the screen pixels, which may be from a previous frame */
+    if (captureVideoFrame(orig_plane, orig_stride) != 0)
         return 1;
-    }
 
-    if (got_output) {
-        /* We have an encoder output to write */
-        apkt.pts = av_rescale_q_rnd(apkt.pts, audio_st->codec->time_base, audio_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-        apkt.dts = av_rescale_q_rnd(apkt.dts, audio_st->codec->time_base, audio_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-        apkt.duration = av_rescale_q(apkt.duration, audio_st->codec->time_base, audio_st->time_base);
-        apkt.stream_index = audio_st->index;
-        if (av_interleaved_write_frame(formatContext, &apkt) < 0) {
-            debuglog(LCF_DUMP | LCF_ERROR, "Error writing frame");
-            return 1;
-        }
-        av_free_packet(&apkt);
-    }
+    if (orig_plane[0])
+        pushFrame(orig_plane[0], orig_stride[0]);
 
     return 0;
 }
 
 
-int closeAVDumping(void) {
-    /* Encode the remaining frames */
-    int got_video = 1;
-    int got_audio = 1;
-    for (; got_video || got_audio;) {
-
-        /* Initialize AVPacket */
-        AVPacket vpkt;
-        vpkt.data = NULL;
-        vpkt.size = 0;
-        av_init_packet(&vpkt);
-
-        int ret = avcodec_encode_video2(video_st->codec, &vpkt, NULL, &got_video);
-        if (ret < 0) {
-            debuglog(LCF_DUMP | LCF_ERROR, "Error encoding frame");
-            return 1;
+/* Get the screen of the frames still being captured. If it cannot be read
+ * anymore, the previous screen is repeated, so that the audio of these
+ * frames is still encoded */
+static void pushRemainingFrames(void)
+{
+    while (push_index < capture_index) {
+        const uint8_t* orig_plane[4] = {0};
+        int orig_stride[4] = {0};
+        if ((captureRemainingFrame(orig_plane, orig_stride) == 0) && orig_plane[0]) {
+            pushFrame(orig_plane[0], orig_stride[0]);
+            continue;
         }
 
-        if (got_video) {
-            vpkt.pts = av_rescale_q_rnd(vpkt.pts, video_st->codec->time_base, video_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-            vpkt.dts = av_rescale_q_rnd(vpkt.dts, video_st->codec->time_base, video_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-            vpkt.duration = av_rescale_q(vpkt.duration, video_st->codec->time_base, video_st->time_base);
-            vpkt.stream_index = video_st->index;
-            if (av_interleaved_write_frame(formatContext, &vpkt) < 0) {
-                debuglog(LCF_DUMP | LCF_ERROR, "Error writing frame");
-                return 1;
-            }
-            av_free_packet(&vpkt);
+        if (push_index == 0) {
+            debuglog(LCF_DUMP | LCF_ERROR, "Could not read the screen, the last ", capture_index, " frames are lost");
+            break;
         }
+        debuglog(LCF_DUMP | LCF_ERROR, "Could not read the screen of a frame, the previous one is repeated");
+        const DumpSlot& prev = slots[(push_index - 1) % DUMP_QUEUE_SIZE];
+        pushFrame(prev.pixels.data(), prev.stride);
+    }
+}
 
-        AVPacket apkt;
-        apkt.data = NULL;
-        apkt.size = 0;
-        av_init_packet(&apkt);
+void flushAVDumping(void)
+{
+    if (pipeline_running)
+        pushRemainingFrames();
+    closeVideoCapture();
+}
 
-        ret = avcodec_encode_audio2(audio_st->codec, &apkt, NULL, &got_audio);
-        if (ret < 0) {
-            debuglog(LCF_DUMP | LCF_ERROR, "Error encoding audio frame");
-            return 1;
-        }
+int closeAVDumping(void) {
+    /* The dump may already be closed with the game window */
+    if (!pipeline_running)
+        return 0;
 
-        if (got_audio) {
-            /* We have an encoder output to write */
-            apkt.pts = av_rescale_q_rnd(apkt.pts, audio_st->codec->time_base, audio_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-            apkt.dts = av_rescale_q_rnd(apkt.dts, audio_st->codec->time_base, audio_st->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-            apkt.duration = av_rescale_q(apkt.duration, audio_st->codec->time_base, audio_st->time_base);
-            apkt.stream_index = audio_st->index;
-            if (av_interleaved_write_frame(formatContext, &apkt) < 0) {
-                debuglog(LCF_DUMP | LCF_ERROR, "Error writing frame");
-                return 1;
-            }
-            av_free_packet(&apkt);
-        }
+    pushRemainingFrames();
+
+    /* Wait for the frames in the pipeline to be written */
+    stopPipeline();
+    closeVideoCapture();
 
+    if (tasflags.raw_dumping) {
+        closeRawOutput(&raw_video_fd, raw_video_inherited);
+        closeRawOutput(&raw_audio_fd, raw_audio_inherited);
+        return pipeline_error ? 1 : 0;
     }
 
+    /* Encode the samples that did not fill a whole audio frame. The
+     * frame is completed with silence if the encoder requires it */
+    bool ok = true;
+    std::vector<AVPacket*> video_packets, audio_packets;
+    if (!audio_fifo.empty()) {
+        int frameSize = audioFrameSize();
+        if ((frameSize == 0) || (audio_ctx->codec->capabilities & AV_CODEC_CAP_SMALL_LAST_FRAME))
+            frameSize = audio_fifo.size() / audiocontext.outAlignSize;
+        ok = sendAudioFrame(frameSize, audio_packets);
+    }
+
+    /* Get the frames still in the encoders */
+    avcodec_send_frame(video_ctx, NULL);
+    ok = receivePackets(video_ctx, video_st, video_packets) && ok;
+    avcodec_send_frame(audio_ctx, NULL);
+    ok = receivePackets(audio_ctx, audio_st, audio_packets) && ok;
+
+    ok = writePackets(video_packets, ok);
+    ok = writePackets(audio_packets, ok);
+
     /* Write file trailer */
     av_write_trailer(formatContext);
 
     /* Free resources */
-    avio_close(formatContext->pb);
-    avcodec_close(video_st->codec);
-    avcodec_close(audio_st->codec);
+    avio_closep(&formatContext->pb);
+    avcodec_free_context(&video_ctx);
+    avcodec_free_context(&audio_ctx);
     avformat_free_context(formatContext);
+    formatContext = NULL;
     sws_freeContext(toYUVctx);
-    av_freep(&video_frame->data[0]);
-    av_frame_free(&video_frame);
+    toYUVctx = NULL;
+    for (int s = 0; s < DUMP_QUEUE_SIZE; s++) {
+        if (slots[s].video_frame) {
+            av_freep(&slots[s].video_frame->data[0]);
+            av_frame_free(&slots[s].video_frame);
+        }
+    }
     av_frame_free(&audio_frame);
+    audio_fifo.clear();
 
-    return 0;
+    return ok ? 0 : 1;
 }
 
 #endif
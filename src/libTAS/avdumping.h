@@ -23,6 +23,38 @@
 #ifdef LIBTAS_ENABLE_AVDUMPING
 
 #include <string>
+#include <stdint.h>
+
+/* Encoders and their options, chosen in linTAS. Options are a list of
+ * key=value separated by commas, passed to the encoder. An empty name
+ * selects the default encoder */
+extern std::string videoEncoderName;
+extern std::string videoEncoderOptions;
+extern std::string audioEncoderName;
+extern std::string audioEncoderOptions;
+
+/* File where the audio samples of a raw dump are written.
+ * Like the dump file, it can be fd:N to write into file descriptor N */
+extern std::string rawAudioFilename;
+
+/* In a raw dump, rows of pixels are stored from the top, and the audio file
+ * contains the interleaved samples of the mix (u8 or s16le). By default
+ * frames have no header, and can be read by ffmpeg as rawvideo.
+ * With linTAS -X, this header is written before the pixels of each frame,
+ * and gives the new dimensions when the dump is restarted. */
+#define RAW_FRAME_MAGIC "LTRF"
+
+struct RawFrameHeader {
+    char magic[4];        /* RAW_FRAME_MAGIC */
+    uint32_t header_size; /* sizeof(RawFrameHeader), for future extensions */
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;      /* Size in bytes of a row */
+    uint32_t framerate;
+    char pixfmt[16];      /* FFmpeg name of the pixel format, like bgra */
+    int64_t pts;          /* Frame number since the start of the dump */
+    uint64_t size;        /* Size in bytes of the pixels that follow */
+};
 
 /* Set up the AV dumping into a file.
  * This consists mainly of getting the dimensions of the screen,
@@ -33,21 +65,29 @@
  * @param video_opengl  Flag indicating if display is done using openGL or
  *                      software SDL rendering
  * @param filename      File where dumping is outputed. File extension
- *                      is important, it is used to guess the file container
+ *                      is important, it is used to guess the file container.
+ *                      For a raw dump, file of the video frames
  * @param start_frame   Frame when init is done. Does matter if dumping is not
  *                      done from the beginning.
  * @return              1 if error, 0 if not
  */
 int openAVDumping(void* window, bool video_opengl, char* filename, int start_frame);
 
-/* Encode a video and audio frame.
+/* Encode a video and audio frame. Does nothing while the dump is closed.
  * @param fconter       Frame counter
  * @param window        SDL Window* (needed for software rendering)
  * @return              1 if error, 0 if not
  */
 int encodeOneFrame(unsigned long fcounter);
 
-/* Close all allocated objects at the end of a av dump
+/* Send the frames whose screen is still being read to the encoding threads,
+ * and free the objects used to read the screen. This must be called
+ * before the OpenGL context of the game is destroyed.
+ */
+void flushAVDumping(void);
+
+/* Close all allocated objects at the end of a av dump.
+ * Does nothing if the dump is already closed.
  * @return              1 if error, 0 if not
  */
 int closeAVDumping(void);
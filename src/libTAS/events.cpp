@@ -24,6 +24,7 @@
 #include "windows.h" // for gameWindow variable
 #include <stdarg.h>
 #include "EventQueue.h"
+#include "hookprofiler.h"
 
 /* Pointers to original functions */
 void (*SDL_PumpEvents_real)(void);
@@ -56,6 +57,7 @@ void pushNativeEvents(void)
 
 /* Override */ int SDL_PeepEvents(SDL_Event* events, int numevents, SDL_eventaction action, Uint32 minType, Uint32 maxType)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS | LCF_FRAME);
 
     /* We need to use a function signature with variable arguments,
@@ -105,6 +107,7 @@ void pushNativeEvents(void)
 
 /* Override */ int SDL_PollEvent(SDL_Event *event)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS | LCF_FRAME);
 
     if (event) {
@@ -133,12 +136,14 @@ void pushNativeEvents(void)
 
 /* Override */ SDL_bool SDL_HasEvent(Uint32 type)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     return SDL_HasEvents(type, type);
 }
 
 /* Override */ SDL_bool SDL_HasEvents(Uint32 minType, Uint32 maxType)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
 
     /* Try to get one event without updating, and return if we got one */
@@ -148,18 +153,21 @@ void pushNativeEvents(void)
 
 /* Override */ void SDL_FlushEvent(Uint32 type)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     return SDL_FlushEvents(type, type);
 }
 
 /* Override */ void SDL_FlushEvents(Uint32 minType, Uint32 maxType)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     sdlEventQueue.flush(minType, maxType);
 }
 
 /* Override */ int SDL_WaitEvent(SDL_Event * event)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
 
     struct timespec mssleep = {0, 1000000};
@@ -182,6 +190,7 @@ void pushNativeEvents(void)
 
 /* Override */ int SDL_WaitEventTimeout(SDL_Event * event, int timeout)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_EVENTS | LCF_TIMEFUNC | LCF_TODO, __func__, " call with timeout ", timeout);
 
     int t;
@@ -209,6 +218,7 @@ void pushNativeEvents(void)
 
 void SDL_SetEventFilter(SDL_EventFilter filter, void *userdata)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
 
     if (SDLver == 1)
@@ -219,6 +229,7 @@ void SDL_SetEventFilter(SDL_EventFilter filter, void *userdata)
 
 void* SDL_GetEventFilter(SDL_EventFilter * filter, void **userdata)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     if (SDLver == 1)
         return (void*)sdlEventQueue.getFilter();
@@ -233,24 +244,28 @@ void* SDL_GetEventFilter(SDL_EventFilter * filter, void **userdata)
 
 void SDL_AddEventWatch(SDL_EventFilter filter, void *userdata)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     sdlEventQueue.addWatch(filter, userdata);
 }
 
 void SDL_DelEventWatch(SDL_EventFilter filter, void *userdata)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     sdlEventQueue.delWatch(filter, userdata);
 }
 
 void SDL_FilterEvents(SDL_EventFilter filter, void *userdata)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     sdlEventQueue.applyFilter(filter, userdata);
 }
 
 Uint8 SDL_EventState(Uint32 type, int state)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS);
     int previousState = sdlEventQueue.isEnabled(type) ? SDL_ENABLE : SDL_DISABLE;
     switch (state) {
@@ -268,6 +283,7 @@ Uint8 SDL_EventState(Uint32 type, int state)
 
 Uint32 SDL_RegisterEvents(int numevents)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_EVENTS | LCF_TODO);
     return SDL_USEREVENT;
 }
@@ -31,6 +31,9 @@
 #include "EventQueue.h"
 #include "events.h"
 #include "windows.h"
+#include "trace.h"
+#include "hookprofiler.h"
+#include "telemetry.h"
 #include <mutex>
 #include <iomanip>
 
@@ -78,7 +81,9 @@ std::mutex frameMutex;
 void frameBoundary(bool drawFB)
 {
     std::lock_guard<std::mutex> guard(frameMutex);
+    TRACE_SCOPE("Frame boundary");
     debuglog(LCF_TIMEFUNC | LCF_FRAME, "Enter frame boundary");
+    telemetryEnterBoundary();
 
     detTimer.enterFrameBoundary();
 
@@ -86,6 +91,8 @@ void frameBoundary(bool drawFB)
 #ifdef LIBTAS_ENABLE_AVDUMPING
     /* Dumping audio and video */
     if (tasflags.av_dumping) {
+        TRACE_SCOPE("Encode");
+        TelemetryTimer telemetryTimer(telemetryEncodeNs);
         /* Write the current frame */
         int enc = encodeOneFrame(frame_counter);
         if (enc != 0) {
@@ -96,6 +103,9 @@ void frameBoundary(bool drawFB)
     }
 #endif
 
+    hookProfileSend();
+    telemetrySend(drawFB);
+
     sendMessage(MSGB_START_FRAMEBOUNDARY);
     sendData(&frame_counter, sizeof(unsigned long));
 
@@ -123,11 +133,13 @@ void frameBoundary(bool drawFB)
     }
 
     detTimer.exitFrameBoundary();
+    telemetryExitBoundary();
     debuglog(LCF_TIMEFUNC | LCF_FRAME, "Leave frame boundary");
 }
 
 void proceed_commands(void)
 {
+    TRACE_SCOPE("Socket wait");
     int message;
     while (1)
     {
@@ -137,6 +149,7 @@ void proceed_commands(void)
         {
             case MSGN_TASFLAGS:
                 receiveData(&tasflags, sizeof(struct TasFlags));
+                updateLogFlags();
                 break;
 
             case MSGN_END_FRAMEBOUNDARY:
@@ -0,0 +1,195 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hookprofiler.h"
+#include "threads.h"
+#include "time.h" // clock_gettime_real
+#include "logging.h"
+#include "socket.h"
+#include "ThreadState.h"
+#include "../shared/messages.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string.h>
+
+/* Sites are indexes in the table of trace event names. The counters
+ * of a thread are allocated by chunks of sites, when a site of the chunk
+ * is first called by the thread.
+ */
+#define HOOKPROFILE_CHUNK_SITES 64
+#define HOOKPROFILE_CHUNKS (TRACE_MAX_NAMES / HOOKPROFILE_CHUNK_SITES)
+
+struct HookSiteStats {
+    std::atomic<uint32_t> calls;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint32_t> histogram[HOOKPROFILE_BUCKETS];
+};
+
+/* Counters of a thread.
+ * Only its thread increments them, and they are collected and reset
+ * by the main thread at each frame boundary.
+ */
+struct HookThreadStats {
+    std::atomic<HookSiteStats*> chunks[HOOKPROFILE_CHUNKS];
+    pthread_t thread;
+
+    /* The thread exited. Its counters are sent one last time at the next
+     * frame boundary, and then freed */
+    bool exited;
+};
+
+static std::vector<HookThreadStats*> threadStats;
+static std::mutex threadStatsMutex;
+
+/* Key whose destructor marks the counters of a thread as exited */
+static pthread_key_t statsKey;
+static pthread_once_t statsKeyOnce = PTHREAD_ONCE_INIT;
+
+static thread_local HookThreadStats* ownStats = nullptr;
+
+uint64_t hookProfileNow(void)
+{
+    /* We can be called before linking the real clock function */
+    if (!clock_gettime_real)
+        return 0;
+
+    struct timespec ts;
+    clock_gettime_real(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+HookScope::HookScope(uint16_t s) : trace(s), site(s)
+{
+    if (tasflags.hook_profiling && !threadState.isNative() && !threadState.isOwnCode())
+        start = hookProfileNow();
+}
+
+static void releaseThreadStats(void* arg)
+{
+    HookThreadStats* stats = static_cast<HookThreadStats*>(arg);
+    ownStats = nullptr;
+
+    std::lock_guard<std::mutex> lock(threadStatsMutex);
+    stats->exited = true;
+}
+
+static void createStatsKey(void)
+{
+    pthread_key_create(&statsKey, releaseThreadStats);
+}
+
+static HookThreadStats* newThreadStats(void)
+{
+    /* Chunk pointers are zero-initialized by value-initialization */
+    HookThreadStats* stats = new HookThreadStats();
+    stats->thread = getThreadId();
+
+    /* Free the counters when the thread exits. The main thread keeps
+     * them, as key destructors are not called when the process exits */
+    pthread_once(&statsKeyOnce, createStatsKey);
+    pthread_setspecific(statsKey, stats);
+
+    std::lock_guard<std::mutex> lock(threadStatsMutex);
+    threadStats.push_back(stats);
+    return stats;
+}
+
+static void deleteThreadStats(HookThreadStats* stats)
+{
+    for (int c = 0; c < HOOKPROFILE_CHUNKS; c++)
+        delete[] stats->chunks[c].load(std::memory_order_relaxed);
+    delete stats;
+}
+
+void hookProfileRecord(uint16_t site, uint64_t ns)
+{
+    if (!ownStats)
+        ownStats = newThreadStats();
+
+    int bucket = 0;
+    if (ns > 0)
+        bucket = 64 - __builtin_clzll(ns);
+    if (bucket >= HOOKPROFILE_BUCKETS)
+        bucket = HOOKPROFILE_BUCKETS - 1;
+
+    std::atomic<HookSiteStats*>& chunk = ownStats->chunks[site / HOOKPROFILE_CHUNK_SITES];
+    HookSiteStats* chunkStats = chunk.load(std::memory_order_relaxed);
+    if (!chunkStats) {
+        chunkStats = new HookSiteStats[HOOKPROFILE_CHUNK_SITES]();
+        chunk.store(chunkStats, std::memory_order_release);
+    }
+
+    HookSiteStats& stats = chunkStats[site % HOOKPROFILE_CHUNK_SITES];
+    stats.calls.fetch_add(1, std::memory_order_relaxed);
+    stats.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    stats.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void hookProfileSend(void)
+{
+    if (!tasflags.hook_profiling)
+        return;
+
+    std::vector<HookProfileEntry> entries;
+    {
+        std::lock_guard<std::mutex> lock(threadStatsMutex);
+        for (HookThreadStats* stats : threadStats) {
+            for (int c = 0; c < HOOKPROFILE_CHUNKS; c++) {
+                HookSiteStats* chunkStats = stats->chunks[c].load(std::memory_order_acquire);
+                if (!chunkStats)
+                    continue;
+
+                for (int i = 0; i < HOOKPROFILE_CHUNK_SITES; i++) {
+                    HookSiteStats& site = chunkStats[i];
+                    uint32_t calls = site.calls.exchange(0, std::memory_order_relaxed);
+                    if (calls == 0)
+                        continue;
+
+                    HookProfileEntry entry;
+                    memset(&entry, 0, sizeof(entry));
+                    strncpy(entry.name, traceGetName(c * HOOKPROFILE_CHUNK_SITES + i), HOOKPROFILE_NAME_LEN - 1);
+                    entry.thread = stats->thread;
+                    entry.is_main = (stats->thread == getMainThreadId());
+                    entry.calls = calls;
+                    entry.total_ns = site.total_ns.exchange(0, std::memory_order_relaxed);
+                    for (int b = 0; b < HOOKPROFILE_BUCKETS; b++)
+                        entry.histogram[b] = site.histogram[b].exchange(0, std::memory_order_relaxed);
+                    entries.push_back(entry);
+                }
+            }
+        }
+
+        /* The counters of exited threads were collected above */
+        for (auto it = threadStats.begin(); it != threadStats.end(); ) {
+            if ((*it)->exited) {
+                deleteThreadStats(*it);
+                it = threadStats.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    sendMessage(MSGB_HOOK_PROFILE);
+    int n_entries = entries.size();
+    sendData(&n_entries, sizeof(int));
+    if (n_entries > 0)
+        sendData(entries.data(), n_entries * sizeof(HookProfileEntry));
+}
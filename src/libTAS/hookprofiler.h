@@ -0,0 +1,73 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_HOOKPROFILER_H_INCL
+#define LIBTAS_HOOKPROFILER_H_INCL
+
+#include "../shared/hookprofile.h"
+#include "../shared/tasflags.h"
+#include "trace.h"
+
+/* Instrumentation of the hooked functions.
+ *
+ * Each hook instrumented with PROFILE_HOOK() registers its name once in
+ * the table of trace event names, and the same index is used by the
+ * tracer and by the profiler:
+ * - when tracing, a begin and an end event are recorded around the hook;
+ * - when tasflags.hook_profiling is set, the calls from the game are
+ *   counted and their duration sampled into a histogram, separately for
+ *   each thread. At each frame boundary, the counters of the frame are
+ *   sent to linTAS and reset, and the counters of exited threads are freed.
+ *
+ * Calls made by our own code or in native mode are not profiled.
+ * Hooks that enter the frame boundary also count the time spent in it.
+ */
+
+/* Current time in nanoseconds, or 0 if not available yet */
+uint64_t hookProfileNow(void);
+
+/* Count a call of duration ns in the current thread */
+void hookProfileRecord(uint16_t site, uint64_t ns);
+
+/* Send the counters of the frame to linTAS and reset them */
+void hookProfileSend(void);
+
+/* Trace and time a hook call from construction to destruction */
+class HookScope
+{
+    public:
+        HookScope(uint16_t s);
+
+        ~HookScope()
+        {
+            if (start)
+                hookProfileRecord(site, hookProfileNow() - start);
+        }
+
+    private:
+        TraceScope trace;
+        uint16_t site;
+        uint64_t start = 0;
+};
+
+#define PROFILE_HOOK() \
+    static const uint16_t hook_site = traceRegisterName(__func__); \
+    HookScope hook_scope(hook_site)
+
+#endif
@@ -24,6 +24,7 @@
 #include "../EventQueue.h"
 #include "../../shared/AllInputs.h"
 #include "../../shared/tasflags.h"
+#include "../hookprofiler.h"
 #include <stdlib.h>
 
 SDL_GameController gcids[4] = {-1, -1, -1, -1};
@@ -31,6 +32,7 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ SDL_bool SDL_IsGameController(int joystick_index)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with id ", joystick_index);
     if (joystick_index >= 0 && joystick_index < tasflags.numControllers)
         return SDL_TRUE;
@@ -40,6 +42,7 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ SDL_GameController *SDL_GameControllerOpen(int joystick_index)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with id ", joystick_index);
     if (joystick_index < 0 || joystick_index >= tasflags.numControllers)
         return NULL;
@@ -51,18 +54,21 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ const char *SDL_GameControllerNameForIndex(int joystick_index)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with id ", joystick_index);
     return joy_name;
 }
 
 /* Override */ const char *SDL_GameControllerName(SDL_GameController *gamecontroller)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with id ", *gamecontroller);
     return joy_name;
 }
 
 /* Override */ SDL_Joystick* SDL_GameControllerGetJoystick(SDL_GameController* gamecontroller)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with id ", *gamecontroller);
     /* We simply return the same id */
     return (SDL_Joystick*) gamecontroller;
@@ -70,6 +76,7 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ SDL_GameController* SDL_GameControllerFromInstanceID(SDL_JoystickID joy)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK | LCF_TODO, __func__, " call with id ", joy);
     if (joy < 0 || joy >= tasflags.numControllers)
         return NULL;
@@ -80,6 +87,7 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ SDL_bool SDL_GameControllerGetAttached(SDL_GameController *gamecontroller)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK | LCF_FRAME, __func__, " call with id ", *gamecontroller);
     if (*gamecontroller < 0 || *gamecontroller >= tasflags.numControllers)
         return SDL_FALSE;
@@ -91,6 +99,7 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ int SDL_GameControllerEventState(int state)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with state ", state);
     const int gcevents[] = {
         SDL_CONTROLLERDEVICEADDED,
@@ -124,6 +133,7 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ void SDL_GameControllerUpdate(void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     SDL_JoystickUpdate();
 }
@@ -131,6 +141,7 @@ const char joy_name[] = "XInput Controller";
 /* Override */ Sint16 SDL_GameControllerGetAxis(SDL_GameController *gamecontroller,
                                           SDL_GameControllerAxis axis)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK | LCF_FRAME, __func__, " call with id ", *gamecontroller, " and axis ", axis);
 
     if (*gamecontroller < 0 || *gamecontroller >= tasflags.numControllers)
@@ -152,6 +163,7 @@ const char joy_name[] = "XInput Controller";
 /* Override */ Uint8 SDL_GameControllerGetButton(SDL_GameController *gamecontroller,
                                                  SDL_GameControllerButton button)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK | LCF_FRAME, __func__, " call with id ", *gamecontroller, " and button ", button);
 
     if (*gamecontroller < 0 || *gamecontroller >= tasflags.numControllers)
@@ -172,6 +184,7 @@ const char joy_name[] = "XInput Controller";
 
 /* Override */ void SDL_GameControllerClose(SDL_GameController *gamecontroller)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK | LCF_FRAME, __func__, " call with id ", *gamecontroller);
 
     if (*gamecontroller < 0 || *gamecontroller >= tasflags.numControllers)
@@ -19,33 +19,39 @@
 
 #include "sdlhaptic.h"
 #include "../logging.h"
+#include "../hookprofiler.h"
 
 int SDL_NumHaptics(void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
 	return 0;
 }
 
 SDL_Haptic * SDL_HapticOpen(int device_index)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
 	return NULL;
 }
 
 int SDL_JoystickIsHaptic(SDL_Joystick * joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
 	return 0;
 }
 
 SDL_Haptic *SDL_HapticOpenFromJoystick(SDL_Joystick *joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
 	return NULL;
 }
 
 void SDL_HapticClose(SDL_Haptic * haptic)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
 }
 
@@ -24,10 +24,12 @@
 #include "../EventQueue.h"
 #include "../../shared/AllInputs.h"
 #include "../../shared/tasflags.h"
+#include "../hookprofiler.h"
 #include <stdlib.h>
 
 /* Override */ int SDL_NumJoysticks(void)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call.");
     /* For now, we declare one joystick */
     return tasflags.numControllers;
@@ -37,6 +39,7 @@ const char* joyname = "Microsoft X-Box 360 pad";
 
 /* Override */ const char *SDL_JoystickNameForIndex(int device_index)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     if (device_index < tasflags.numControllers)
         return joyname;
@@ -45,6 +48,7 @@ const char* joyname = "Microsoft X-Box 360 pad";
 
 /* Override */ const char* SDL_JoystickName(SDL_Joystick* joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     /* Do not use joystick argument unless you know what you are doing.
      * Because SDL 1.2 can call this function, but the argument is 
@@ -78,6 +82,7 @@ static bool isIdValidOpen(SDL_Joystick* joy)
 
 /* Override */ SDL_Joystick *SDL_JoystickOpen(int device_index)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with joy ", device_index);
     if ((device_index < 0) || (device_index >= MAX_SDLJOYS))
         return NULL;
@@ -94,6 +99,7 @@ static bool isIdValidOpen(SDL_Joystick* joy)
 
 /* Override */ SDL_Joystick *SDL_JoystickFromInstanceID(SDL_JoystickID joyid)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with joy id ", joyid);
 
     if ((joyid < 0) || (joyid >= MAX_SDLJOYS))
@@ -113,6 +119,7 @@ SDL_JoystickGUID nullGUID   = {{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}};
 
 /* Override */ SDL_JoystickGUID SDL_JoystickGetDeviceGUID(int device_index)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with device ", device_index);
     if (device_index >= tasflags.numControllers)
 	    return nullGUID;
@@ -122,6 +129,7 @@ SDL_JoystickGUID nullGUID   = {{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}};
 
 /* Override */ SDL_JoystickGUID SDL_JoystickGetGUID(SDL_Joystick * joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     if (!isIdValid(joystick))
         return nullGUID;
@@ -131,6 +139,7 @@ SDL_JoystickGUID nullGUID   = {{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}};
 
 /* Override */ SDL_bool SDL_JoystickGetAttached(SDL_Joystick * joystick)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with joy ", *joystick);
     if (!isIdValidOpen(joystick))
         return SDL_FALSE;
@@ -140,6 +149,7 @@ SDL_JoystickGUID nullGUID   = {{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}};
 
 /* Override */ int SDL_JoystickOpened(int device_index)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with joy ", device_index);
     if (!isIdValidOpen(&device_index))
         return 0;
@@ -149,6 +159,7 @@ SDL_JoystickGUID nullGUID   = {{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}};
 
 /* Override */ SDL_JoystickID SDL_JoystickInstanceID(SDL_Joystick * joystick)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with joy ", *joystick);
     if (!isIdValidOpen(joystick))
         return -1;
@@ -158,6 +169,7 @@ SDL_JoystickGUID nullGUID   = {{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}};
 
 int SDL_JoystickIndex(SDL_Joystick *joystick)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with joy ", *joystick);
     if (!isIdValidOpen(joystick))
         return -1;
@@ -167,6 +179,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ int SDL_JoystickNumAxes(SDL_Joystick* joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     if (!isIdValid(joystick))
         return 0;
@@ -175,6 +188,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ int SDL_JoystickNumBalls(SDL_Joystick* joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     if (!isIdValid(joystick))
         return 0;
@@ -183,6 +197,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ int SDL_JoystickNumButtons(SDL_Joystick* joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     if (!isIdValid(joystick))
         return 0;
@@ -191,6 +206,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ int SDL_JoystickNumHats(SDL_Joystick* joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
     if (!isIdValid(joystick))
         return 0;
@@ -199,6 +215,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ void SDL_JoystickUpdate(void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK);
 
     for (int j=0; j<tasflags.numControllers; j++) {
@@ -210,6 +227,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ int SDL_JoystickEventState(int state)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with state ", state);
     const int joyevents1[] = {
         SDL1::SDL_JOYAXISMOTION,
@@ -264,6 +282,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ Sint16 SDL_JoystickGetAxis(SDL_Joystick * joystick, int axis)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with axis ", axis);
 
     if (!isIdValidOpen(joystick))
@@ -277,6 +296,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ Uint8 SDL_JoystickGetHat(SDL_Joystick * joystick, int hat)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with hat ", hat);
 
     if (!isIdValidOpen(joystick))
@@ -300,12 +320,14 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ int SDL_JoystickGetBall(SDL_Joystick * joystick, int ball, int *dx, int *dy)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with ball ", ball);
     return 0;
 }
 
 /* Override */ Uint8 SDL_JoystickGetButton(SDL_Joystick * joystick, int button)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with button ", button);
 
     if (!isIdValidOpen(joystick))
@@ -319,6 +341,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ void SDL_JoystickClose(SDL_Joystick * joystick)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_JOYSTICK, __func__, " call with joy ", *joystick);
     if (!isIdValidOpen(joystick))
         return;
@@ -328,6 +351,7 @@ int SDL_JoystickIndex(SDL_Joystick *joystick)
 
 /* Override */ SDL_JoystickPowerLevel SDL_JoystickCurrentPowerLevel(SDL_Joystick * joystick)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_JOYSTICK | LCF_TODO);
 	return SDL_JOYSTICK_POWER_WIRED;
 }
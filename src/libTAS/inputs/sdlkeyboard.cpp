@@ -22,12 +22,14 @@
 #include "keyboard_helper.h"
 #include "../logging.h"
 #include "../../shared/AllInputs.h"
+#include "../hookprofiler.h"
 
 Uint8 SDL_keyboard[SDL_NUM_SCANCODES] = {0};
 Uint8 SDL1_keyboard[SDL1::SDLK_LAST] = {0};
 
 /* Override */ Uint8* SDL_GetKeyboardState( int* numkeys)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_KEYBOARD | LCF_FRAME, __func__, " call.");
 
     if (numkeys)
@@ -40,6 +42,7 @@ Uint8 SDL1_keyboard[SDL1::SDLK_LAST] = {0};
 
 /* Override */ Uint8* SDL_GetKeyState( int* numkeys)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_KEYBOARD | LCF_FRAME, __func__, " call.");
 
     if (numkeys)
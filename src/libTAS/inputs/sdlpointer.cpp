@@ -26,15 +26,18 @@
 #include "../windows.h" // gameWindow
 #include <X11/X.h>
 #include "../EventQueue.h"
+#include "../hookprofiler.h"
 
 SDL_Window *SDL_GetMouseFocus(void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_MOUSE);
     return gameWindow;
 }
 
 Uint32 SDL_GetMouseState(int *x, int *y)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_MOUSE);
     if (x != NULL)
         *x = ai.pointer_x;
@@ -58,6 +61,7 @@ Uint32 SDL_GetMouseState(int *x, int *y)
 
 Uint32 SDL_GetGlobalMouseState(int *x, int *y)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_MOUSE);
     /* We don't support global mouse state. We consider that the window
      * is located at the bottom left of the screen and just output the 
@@ -69,6 +73,7 @@ Uint32 SDL_GetGlobalMouseState(int *x, int *y)
 
 Uint32 SDL_GetRelativeMouseState(int *x, int *y)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_MOUSE);
 
     static bool first = true;
@@ -109,12 +114,14 @@ Uint32 SDL_GetRelativeMouseState(int *x, int *y)
 
 void SDL_WarpMouseInWindow(SDL_Window * window, int x, int y)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_MOUSE, __func__, " call to pos (",x,",",y,")");
     /* We should not support that I guess */
 }
 
 int SDL_WarpMouseGlobal(int x, int y)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_MOUSE, __func__, " call to pos (",x,",",y,")");
     /* We should not support that I guess */
     return -1;
@@ -122,6 +129,7 @@ int SDL_WarpMouseGlobal(int x, int y)
 
 void SDL_WarpMouse(Uint16 x, Uint16 y)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_MOUSE, __func__, " call to pos (",x,",",y,")");
     game_ai.pointer_x = x;
     game_ai.pointer_y = y;
@@ -155,6 +163,7 @@ SDL_bool relativeMode = SDL_FALSE;
 
 int SDL_SetRelativeMouseMode(SDL_bool enabled)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_MOUSE, __func__, " call with ", enabled);
     relativeMode = enabled;
     return 0;
@@ -162,6 +171,7 @@ int SDL_SetRelativeMouseMode(SDL_bool enabled)
 
 int SDL_CaptureMouse(SDL_bool enabled)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_MOUSE, __func__, " call with ", enabled);
     /* We should disable capture anyway */
     return 0;
@@ -169,6 +179,7 @@ int SDL_CaptureMouse(SDL_bool enabled)
 
 SDL_bool SDL_GetRelativeMouseMode(void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_MOUSE);
     return relativeMode;
 }
@@ -176,6 +187,7 @@ SDL_bool SDL_GetRelativeMouseMode(void)
 
 int SDL_ShowCursor(int toggle)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_MOUSE, __func__, " call with ", toggle);
 
     /* We keep the state of the cursor, but we keep it shown. */
@@ -29,12 +29,14 @@
 #include "logging.h"
 #include "NonDeterministicTimer.h"
 #include "DeterministicTimer.h"
+#include "trace.h"
 #include "../shared/messages.h"
 #include "../shared/tasflags.h"
 #include "../shared/AllInputs.h"
 #include "hook.h"
 #include "inputs/inputs.h"
 #include "fileio.h"
+#include "audio/AudioContext.h"
 #ifdef LIBTAS_ENABLE_AVDUMPING
 #include "avdumping.h"
 #endif
@@ -78,6 +80,7 @@ void __attribute__((constructor)) init(void)
             case MSGN_TASFLAGS:
                 debuglog(LCF_SOCKET, "Receiving tas flags");
                 receiveData(&tasflags, sizeof(struct TasFlags));
+                updateLogFlags();
                 break;
             case MSGN_DUMP_FILE:
                 debuglog(LCF_SOCKET, "Receiving dump filename");
@@ -89,6 +92,65 @@ void __attribute__((constructor)) init(void)
                 av_filename[dump_len] = '\0';
                 debuglog(LCF_SOCKET, "File ", av_filename);
                 break;
+            case MSGN_VIDEO_ENCODER:
+            case MSGN_AUDIO_ENCODER: {
+                debuglog(LCF_SOCKET, "Receiving encoder");
+                /* Encoder name, then options */
+                std::string encoder[2];
+                for (std::string& str : encoder) {
+                    size_t str_len;
+                    receiveData(&str_len, sizeof(size_t));
+                    buf.assign(str_len, 0x00);
+                    if (str_len > 0)
+                        receiveData(&(buf[0]), str_len);
+                    str.assign(buf.begin(), buf.end());
+                }
+#ifdef LIBTAS_ENABLE_AVDUMPING
+                if (message == MSGN_VIDEO_ENCODER) {
+                    videoEncoderName = encoder[0];
+                    videoEncoderOptions = encoder[1];
+                }
+                else {
+                    audioEncoderName = encoder[0];
+                    audioEncoderOptions = encoder[1];
+                }
+#endif
+                debuglog(LCF_SOCKET, "Encoder ", encoder[0], " with options ", encoder[1]);
+                break;
+            }
+            case MSGN_RAW_AUDIO_FILE:
+                debuglog(LCF_SOCKET, "Receiving raw audio filename");
+                size_t raw_len;
+                receiveData(&raw_len, sizeof(size_t));
+                buf.assign(raw_len, 0x00);
+                if (raw_len > 0)
+                    receiveData(&(buf[0]), raw_len);
+                libstring.assign(buf.begin(), buf.end());
+#ifdef LIBTAS_ENABLE_AVDUMPING
+                rawAudioFilename = libstring;
+#endif
+                debuglog(LCF_SOCKET, "File ", libstring.c_str());
+                break;
+            case MSGN_TRACE_FILE:
+                debuglog(LCF_SOCKET, "Receiving trace filename");
+                size_t trace_len;
+                receiveData(&trace_len, sizeof(size_t));
+                buf.resize(trace_len, 0x00);
+                receiveData(&(buf[0]), trace_len);
+                libstring.assign(&(buf[0]), buf.size());
+                traceInit(libstring.c_str());
+                debuglog(LCF_SOCKET, "Trace file ", libstring.c_str());
+                break;
+            case MSGN_LOG_FILE:
+                debuglog(LCF_SOCKET, "Receiving log filename");
+                size_t log_len;
+                receiveData(&log_len, sizeof(size_t));
+                buf.resize(log_len, 0x00);
+                receiveData(&(buf[0]), log_len);
+                libstring.assign(&(buf[0]), buf.size());
+                logSink.openFile(libstring.c_str());
+                debuglog(LCF_SOCKET, "Log file ", libstring.c_str());
+                break;
             case MSGN_LIB_FILE:
                 debuglog(LCF_SOCKET, "Receiving lib filename");
                 size_t lib_len;
@@ -122,15 +184,23 @@ void __attribute__((constructor)) init(void)
 
     libTAS_init = true;
 
+    /* From now, logs are written by a separate thread */
+    logSink.start();
 }
 
 void __attribute__((destructor)) term(void)
 {
     dlhook_end();
 
+    audiocontext.stopMixThread();
+
+    traceDump();
+
     closeSocket();
 
     debuglog(LCF_SOCKET, "Exiting.");
+
+    logSink.stop();
 }
 
 /* Override */ void SDL_Init(unsigned int flags){
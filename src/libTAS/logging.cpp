@@ -21,49 +21,60 @@
 #include <stdlib.h>
 #include "threads.h"
 #include "../shared/tasflags.h"
-#include "unistd.h" // For isatty
+#include "LogSink.h"
 #include <cstdarg>
 
+/* tasflags is statically initialized, so its default values are
+ * already set here */
+std::atomic<LogCategoryFlag> logIncludeFlags(tasflags.includeFlags);
+std::atomic<LogCategoryFlag> logExcludeFlags(tasflags.excludeFlags);
+
+void updateLogFlags(void)
+{
+    logIncludeFlags.store(tasflags.includeFlags, std::memory_order_relaxed);
+    logExcludeFlags.store(tasflags.excludeFlags, std::memory_order_relaxed);
+}
+
 void debuglogverbose(LogCategoryFlag lcf, std::string str, std::string &outstr)
 {
     std::ostringstream oss;
 
-    /* Use the extern variable tasflags */
-    if ( (lcf & tasflags.includeFlags) && !(lcf & tasflags.excludeFlags) ) {
-        /* We only print colors if displayed on a terminal */
-        bool isTerm = isatty(/*cerr*/ 2);
-        if (isTerm) {
-            if (lcf & LCF_ERROR)
-                /* Write the header text in red */
-                oss << ANSI_COLOR_RED;
-            else if (lcf & LCF_TODO)
-                /* Write the header text in light red */
-                oss << ANSI_COLOR_LIGHT_RED;
-            else
-                /* Write the header text in white */
-                oss << ANSI_COLOR_LIGHT_GRAY;
-        }
-        oss << "[libTAS f:" << frame_counter << "] ";
-
-        std::string thstr = stringify(getThreadId());
-        if (isMainThread())
-            oss << "Thread " << thstr << " (main) ";
+    /* We only print colors if displayed on a terminal */
+    bool isTerm = logSink.isTerminal();
+    if (isTerm) {
+        if (lcf & LCF_ERROR)
+            /* Write the header text in red */
+            oss << ANSI_COLOR_RED;
+        else if (lcf & LCF_TODO)
+            /* Write the header text in light red */
+            oss << ANSI_COLOR_LIGHT_RED;
         else
-            oss << "Thread " << thstr << "        ";
-
-        if (isTerm) {
-            /* Reset color change */
-            oss << ANSI_COLOR_RESET;
-        }
+            /* Write the header text in white */
+            oss << ANSI_COLOR_LIGHT_GRAY;
+    }
+    oss << "[libTAS f:" << frame_counter << "] ";
+
+    /* The thread id of a thread never changes, so we build its string once */
+    static thread_local std::string thstr;
+    if (thstr.empty())
+        thstr = stringify(getThreadId());
+    if (isMainThread())
+        oss << "Thread " << thstr << " (main) ";
+    else
+        oss << "Thread " << thstr << "        ";
+
+    if (isTerm) {
+        /* Reset color change */
+        oss << ANSI_COLOR_RESET;
+    }
 
-        /* Output arguments */
-        oss << str << std::endl;
+    /* Output arguments */
+    oss << str << '\n';
 
-        outstr = oss.str();
-    }
+    outstr = oss.str();
 }
 
-void debuglogstdio(LogCategoryFlag lcf, const char* fmt, ...)
+void debuglogstdiofull(LogCategoryFlag lcf, const char* fmt, ...)
 {
     /* Not printing anything if thread state is set to NOLOG */
     if (threadState.isNoLog())
@@ -83,7 +94,7 @@ void debuglogstdio(LogCategoryFlag lcf, const char* fmt, ...)
     std::string str(s);
     std::string outstr;
     debuglogverbose(lcf, str, outstr);
-    fprintf(stderr, outstr.c_str());
+    logSink.write(outstr, lcf & LCF_ERROR);
     threadState.setNoLog(false);
 }
 
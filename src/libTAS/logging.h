@@ -28,7 +28,9 @@
 #include "hook.h" // For pthread_self_real
 #include "time.h" // For frame_counter
 #include "ThreadState.h"
+#include "LogSink.h"
 #include <cstdio>
+#include <atomic>
 
 /* Color printing
  * Taken from http://stackoverflow.com/questions/3219393/stdlib-and-colored-output-in-c
@@ -58,9 +60,31 @@
  */
 std::string stringify(unsigned long int id);
 
-/* Main function to print the debug message str (or not), and additional
- * information, based on the LogCategoryFlag value
+/* Log categories that are removed at compile time. A message that has
+ * any of these categories is never printed, and its arguments are never
+ * evaluated. Set with cmake -DLOG_EXCLUDE_FLAGS="LCF_FREQUENT"
  */
+#ifndef LIBTAS_LOG_EXCLUDE_FLAGS
+#define LIBTAS_LOG_EXCLUDE_FLAGS LCF_NONE
+#endif
+
+/* Copies of tasflags.includeFlags and tasflags.excludeFlags,
+ * that any thread can check without formatting the message first.
+ */
+extern std::atomic<LogCategoryFlag> logIncludeFlags;
+extern std::atomic<LogCategoryFlag> logExcludeFlags;
+
+/* Update the log categories after receiving new tasflags */
+void updateLogFlags(void);
+
+/* Is a message with this category printed? */
+inline bool debuglogEnabled(LogCategoryFlag lcf)
+{
+    return (lcf & logIncludeFlags.load(std::memory_order_relaxed)) &&
+        !(lcf & logExcludeFlags.load(std::memory_order_relaxed));
+}
+
+/* Main function to add additional information to the debug message str */
 void debuglogverbose(LogCategoryFlag lcf, std::string str, std::string& outstr);
 
 /* Helper functions to concatenate different arguments arbitrary types into
@@ -84,11 +108,10 @@ inline void catlog (std::ostringstream &oss, First && first, Rest && ...rest)
     catlog(oss, std::forward<Rest>(rest)...);
 }
 
-/* Print a variable list of arguments and other information based on the
- * value of lcf compared to the values in tasflags.includeFlags
- * and tasflags.excludeFlags.
+/* Print a variable list of arguments and other information.
  *
- * This function is the one called by other source files.
+ * This function is not called directly, but through the debuglog() macro
+ * below, which first checks the category of the message.
  * It uses variadic templates so the above comment does apply here also.
  *
  * The content is kept as minimal as possible and everything that does not
@@ -96,9 +119,9 @@ inline void catlog (std::ostringstream &oss, First && first, Rest && ...rest)
  * to keep increased size as low as possible.
  */
 template<typename ...Args>
-void debuglog(LogCategoryFlag lcf, Args ...args);
+void debuglogfull(LogCategoryFlag lcf, Args ...args);
 template<typename ...Args>
-inline void debuglog(LogCategoryFlag lcf, Args ...args)
+inline void debuglogfull(LogCategoryFlag lcf, Args ...args)
 {
     /* Not printing anything if thread state is set to NOLOG */
     if (threadState.isNoLog())
@@ -112,12 +135,33 @@ inline void debuglog(LogCategoryFlag lcf, Args ...args)
     catlog(oss, std::forward<Args>(args)...);
     std::string outstr;
     debuglogverbose(lcf, oss.str(), outstr);
-    std::cerr << outstr;
+    logSink.write(outstr, lcf & LCF_ERROR);
     threadState.setNoLog(false);
 }
 
+/* Print a variable list of arguments and other information based on the
+ * value of lcf compared to the values in tasflags.includeFlags
+ * and tasflags.excludeFlags.
+ *
+ * This is the one called by other source files. The category is checked
+ * before the arguments are evaluated, so a message that is not printed
+ * costs almost nothing. When lcf is a constant, messages excluded at
+ * compile time are removed entirely.
+ */
+#define debuglog(lcf, ...) \
+    do { \
+        if (!((lcf) & (LIBTAS_LOG_EXCLUDE_FLAGS)) && debuglogEnabled(lcf)) \
+            debuglogfull(lcf, __VA_ARGS__); \
+    } while (0)
+
 /* Print the debug message using stdio functions */
-void debuglogstdio(LogCategoryFlag lcf, const char* fmt, ...);
+void debuglogstdiofull(LogCategoryFlag lcf, const char* fmt, ...);
+
+#define debuglogstdio(lcf, ...) \
+    do { \
+        if (!((lcf) & (LIBTAS_LOG_EXCLUDE_FLAGS)) && debuglogEnabled(lcf)) \
+            debuglogstdiofull(lcf, __VA_ARGS__); \
+    } while (0)
 
 /* If we only want to print the function name... */
 #define DEBUGLOGCALL(lcf) debuglog(lcf, __func__, " call.")
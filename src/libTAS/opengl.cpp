@@ -0,0 +1,349 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "opengl.h"
+#include "hook.h"
+#include "logging.h"
+#include "../shared/tasflags.h"
+#include <string.h>
+#ifdef LIBTAS_ENABLE_AVDUMPING
+#include "avdumping.h"
+#endif
+
+/* Are the draw calls of the current frame elided? */
+static bool skipGLDraw = false;
+
+/* Framebuffers bound by the game for drawing and reading. Only the draws
+ * into the window (framebuffer 0) are elided, because framebuffer objects
+ * may be used as textures in the next frames. */
+static GLuint drawFramebuffer = 0;
+static GLuint readFramebuffer = 0;
+
+/* Did the game read the results of its rendering during this fast-forward */
+static bool gameReadsGL = false;
+
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#define GL_FRAMEBUFFER 0x8D40
+
+/* Is this draw call elided */
+static inline bool elideDraw(void)
+{
+    return skipGLDraw && (drawFramebuffer == 0);
+}
+
+/* The game reads something that depends on its draws to the window (pixels,
+ * query results). Stop eliding for the rest of this frame and of the
+ * fast-forward, so that it reads what it drew from then on. */
+static void readsGL(void)
+{
+    if (skipGLDraw)
+        debuglog(LCF_OGL, "The game reads back the rendering, draw calls are not elided anymore");
+    gameReadsGL = true;
+    skipGLDraw = false;
+}
+
+/* Original function pointers */
+static __GLXextFuncPtr (*glXGetProcAddress_real)(const GLubyte*);
+static __GLXextFuncPtr (*glXGetProcAddressARB_real)(const GLubyte*);
+static void* (*SDL_GL_GetProcAddress_real)(const char*);
+static void (*glXDestroyContext_real)(void*, void*);
+
+static void (*glClear_real)(GLbitfield);
+static void (*glDrawArrays_real)(GLenum, GLint, GLsizei);
+static void (*glDrawElements_real)(GLenum, GLsizei, GLenum, const void*);
+static void (*glDrawRangeElements_real)(GLenum, GLuint, GLuint, GLsizei, GLenum, const void*);
+static void (*glDrawArraysInstanced_real)(GLenum, GLint, GLsizei, GLsizei);
+static void (*glDrawElementsInstanced_real)(GLenum, GLsizei, GLenum, const void*, GLsizei);
+static void (*glDrawElementsBaseVertex_real)(GLenum, GLsizei, GLenum, const void*, GLint);
+static void (*glMultiDrawArrays_real)(GLenum, const GLint*, const GLsizei*, GLsizei);
+static void (*glMultiDrawElements_real)(GLenum, const GLsizei*, GLenum, const void* const*, GLsizei);
+static void (*glBindFramebuffer_real)(GLenum, GLuint);
+static void (*glBindFramebufferEXT_real)(GLenum, GLuint);
+static void (*glReadPixels_real)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*);
+static void (*glCopyTexImage2D_real)(GLenum, GLint, GLenum, GLint, GLint, GLsizei, GLsizei, GLint);
+static void (*glCopyTexSubImage2D_real)(GLenum, GLint, GLint, GLint, GLint, GLint, GLsizei, GLsizei);
+static void (*glBlitFramebuffer_real)(GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum);
+static void (*glBeginQuery_real)(GLenum, GLuint);
+
+/* List of the functions that we wrap, with their original and
+ * replacement function pointers.
+ */
+struct GLDrawFunction {
+    const char* name;
+    void** real;
+    void* wrapper;
+};
+
+#define GL_DRAW_FUNCTION(FUNC) {#FUNC, (void**)&FUNC##_real, (void*)FUNC}
+
+static GLDrawFunction drawFunctions[] = {
+    GL_DRAW_FUNCTION(glClear),
+    GL_DRAW_FUNCTION(glDrawArrays),
+    GL_DRAW_FUNCTION(glDrawElements),
+    GL_DRAW_FUNCTION(glDrawRangeElements),
+    GL_DRAW_FUNCTION(glDrawArraysInstanced),
+    GL_DRAW_FUNCTION(glDrawElementsInstanced),
+    GL_DRAW_FUNCTION(glDrawElementsBaseVertex),
+    GL_DRAW_FUNCTION(glMultiDrawArrays),
+    GL_DRAW_FUNCTION(glMultiDrawElements),
+    GL_DRAW_FUNCTION(glBindFramebuffer),
+    GL_DRAW_FUNCTION(glBindFramebufferEXT),
+    GL_DRAW_FUNCTION(glReadPixels),
+    GL_DRAW_FUNCTION(glCopyTexImage2D),
+    GL_DRAW_FUNCTION(glCopyTexSubImage2D),
+    GL_DRAW_FUNCTION(glBlitFramebuffer),
+    GL_DRAW_FUNCTION(glBeginQuery)
+};
+
+void setGLDrawSkip(bool skip)
+{
+    if (!tasflags.fastforward)
+        gameReadsGL = false;
+
+    /* Never elide a frame that is encoded */
+    skipGLDraw = skip && tasflags.fastforward_skip_draws && !tasflags.av_dumping && !gameReadsGL;
+}
+
+void link_glfunction(void** function, const char* name)
+{
+    if (link_function(function, name, "libGL"))
+        return;
+
+    LINK_SUFFIX(glXGetProcAddressARB, "libGL");
+    if (glXGetProcAddressARB_real)
+        *function = (void*) glXGetProcAddressARB_real(reinterpret_cast<const GLubyte*>(name));
+}
+
+/* If the game asks for a function that we elide, store the original
+ * function and return our own.
+ */
+static void* wrapGLFunction(const char* name, void* real)
+{
+    if (!real)
+        return real;
+
+    for (auto& func : drawFunctions) {
+        if (strcmp(name, func.name) == 0) {
+            debuglog(LCF_OGL | LCF_HOOK, "   replace GL function ", name);
+            *func.real = real;
+            return func.wrapper;
+        }
+    }
+    return real;
+}
+
+/* Override */ __GLXextFuncPtr glXGetProcAddress (const GLubyte *procName)
+{
+    debuglog(LCF_OGL, __func__, " call with symbol ", procName);
+    LINK_SUFFIX(glXGetProcAddress, "libGL");
+    if (!glXGetProcAddress_real)
+        return nullptr;
+
+    return (__GLXextFuncPtr) wrapGLFunction(reinterpret_cast<const char*>(procName),
+        (void*) glXGetProcAddress_real(procName));
+}
+
+/* Override */ __GLXextFuncPtr glXGetProcAddressARB (const GLubyte *procName)
+{
+    debuglog(LCF_OGL, __func__, " call with symbol ", procName);
+    LINK_SUFFIX(glXGetProcAddressARB, "libGL");
+    if (!glXGetProcAddressARB_real)
+        return nullptr;
+
+    return (__GLXextFuncPtr) wrapGLFunction(reinterpret_cast<const char*>(procName),
+        (void*) glXGetProcAddressARB_real(procName));
+}
+
+/* Override */ void glXDestroyContext(void* dpy, void* ctx)
+{
+    DEBUGLOGCALL(LCF_OGL);
+    LINK_SUFFIX(glXDestroyContext, "libGL");
+    if (!glXDestroyContext_real)
+        return;
+
+#ifdef LIBTAS_ENABLE_AVDUMPING
+    /* Get the frames that are still being read from the screen */
+    if (tasflags.av_dumping)
+        flushAVDumping();
+#endif
+    glXDestroyContext_real(dpy, ctx);
+}
+
+/* Override */ void* SDL_GL_GetProcAddress(const char* proc)
+{
+    debuglog(LCF_SDL | LCF_OGL, __func__, " call with symbol ", proc);
+    LINK_SUFFIX_SDLX(SDL_GL_GetProcAddress);
+    if (!SDL_GL_GetProcAddress_real)
+        return nullptr;
+
+    return wrapGLFunction(proc, SDL_GL_GetProcAddress_real(proc));
+}
+
+/* Override */ void glClear(GLbitfield mask)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glClear);
+    glClear_real(mask);
+}
+
+/* Override */ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glDrawArrays);
+    glDrawArrays_real(mode, first, count);
+}
+
+/* Override */ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glDrawElements);
+    glDrawElements_real(mode, count, type, indices);
+}
+
+/* Override */ void glDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const void *indices)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glDrawRangeElements);
+    glDrawRangeElements_real(mode, start, end, count, type, indices);
+}
+
+/* Override */ void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glDrawArraysInstanced);
+    glDrawArraysInstanced_real(mode, first, count, instancecount);
+}
+
+/* Override */ void glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glDrawElementsInstanced);
+    glDrawElementsInstanced_real(mode, count, type, indices, instancecount);
+}
+
+/* Override */ void glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glDrawElementsBaseVertex);
+    glDrawElementsBaseVertex_real(mode, count, type, indices, basevertex);
+}
+
+/* Override */ void glMultiDrawArrays(GLenum mode, const GLint *first, const GLsizei *count, GLsizei drawcount)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glMultiDrawArrays);
+    glMultiDrawArrays_real(mode, first, count, drawcount);
+}
+
+/* Override */ void glMultiDrawElements(GLenum mode, const GLsizei *count, GLenum type, const void *const*indices, GLsizei drawcount)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (elideDraw())
+        return;
+    LINK_GL(glMultiDrawElements);
+    glMultiDrawElements_real(mode, count, type, indices, drawcount);
+}
+
+static void bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    if ((target == GL_FRAMEBUFFER) || (target == GL_DRAW_FRAMEBUFFER))
+        drawFramebuffer = framebuffer;
+    if ((target == GL_FRAMEBUFFER) || (target == GL_READ_FRAMEBUFFER))
+        readFramebuffer = framebuffer;
+}
+
+/* Override */ void glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    LINK_GL(glBindFramebuffer);
+    bindFramebuffer(target, framebuffer);
+    glBindFramebuffer_real(target, framebuffer);
+}
+
+/* Override */ void glBindFramebufferEXT(GLenum target, GLuint framebuffer)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    LINK_GL(glBindFramebufferEXT);
+    bindFramebuffer(target, framebuffer);
+    glBindFramebufferEXT_real(target, framebuffer);
+}
+
+/* Override */ void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *data)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (readFramebuffer == 0)
+        readsGL();
+    LINK_GL(glReadPixels);
+    glReadPixels_real(x, y, width, height, format, type, data);
+}
+
+/* Override */ void glCopyTexImage2D(GLenum target, GLint level, GLenum internalformat, GLint x, GLint y, GLsizei width, GLsizei height, GLint border)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (readFramebuffer == 0)
+        readsGL();
+    LINK_GL(glCopyTexImage2D);
+    glCopyTexImage2D_real(target, level, internalformat, x, y, width, height, border);
+}
+
+/* Override */ void glCopyTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (readFramebuffer == 0)
+        readsGL();
+    LINK_GL(glCopyTexSubImage2D);
+    glCopyTexSubImage2D_real(target, level, xoffset, yoffset, x, y, width, height);
+}
+
+/* Override */ void glBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    if (readFramebuffer == 0)
+        readsGL();
+    if (elideDraw())
+        return;
+    LINK_GL(glBlitFramebuffer);
+    glBlitFramebuffer_real(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+}
+
+/* Override */ void glBeginQuery(GLenum target, GLuint id)
+{
+    DEBUGLOGCALL(LCF_OGL | LCF_FREQUENT);
+    /* Queries count the results of the following draws */
+    readsGL();
+    LINK_GL(glBeginQuery);
+    glBeginQuery_real(target, id);
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_OPENGL_H_INCL
+#define LIBTAS_OPENGL_H_INCL
+
+#include "global.h"
+#include "../external/gl.h"
+
+/* During fast-forward, most frames are never displayed. Instead of only
+ * skipping the buffer swap, we also elide the draw calls of the game for
+ * these frames, which removes most of the GPU work.
+ *
+ * Only clears and draws into the window (framebuffer 0) are elided. Draws
+ * into framebuffer objects, which can be used as textures by later frames,
+ * state changes, buffer and texture uploads and shader binds are always
+ * passed through. If the game reads back what it drew into the window
+ * (glReadPixels, copies and blits from it) or uses queries, we stop eliding
+ * for the rest of the fast-forward, so that it gets the same results as if
+ * all frames were drawn. Only the reads of the frame in which this is
+ * detected can see an incomplete window.
+ *
+ * The game can access GL functions either by linking to them, or by
+ * getting a pointer from glXGetProcAddress(ARB) or SDL_GL_GetProcAddress.
+ * We hook both ways.
+ */
+
+/* Set if the draw calls of the current frame must be elided.
+ * This must be called at a frame boundary.
+ */
+void setGLDrawSkip(bool skip);
+
+/* Link a GL function. Functions that are not exported by libGL
+ * (newer GL versions, extensions) are accessed using glXGetProcAddressARB.
+ */
+void link_glfunction(void** function, const char* name);
+
+#define LINK_GL(FUNC) if (!FUNC##_real) link_glfunction((void**)&FUNC##_real, #FUNC)
+
+typedef void (*__GLXextFuncPtr)(void);
+
+OVERRIDE __GLXextFuncPtr glXGetProcAddress (const GLubyte *procName);
+OVERRIDE __GLXextFuncPtr glXGetProcAddressARB (const GLubyte *procName);
+OVERRIDE void* SDL_GL_GetProcAddress(const char* proc);
+
+/* Arguments are a Display* and a GLXContext */
+OVERRIDE void glXDestroyContext(void* dpy, void* ctx);
+
+OVERRIDE void glClear(GLbitfield mask);
+OVERRIDE void glDrawArrays(GLenum mode, GLint first, GLsizei count);
+OVERRIDE void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices);
+OVERRIDE void glDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const void *indices);
+OVERRIDE void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+OVERRIDE void glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount);
+OVERRIDE void glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex);
+OVERRIDE void glMultiDrawArrays(GLenum mode, const GLint *first, const GLsizei *count, GLsizei drawcount);
+OVERRIDE void glMultiDrawElements(GLenum mode, const GLsizei *count, GLenum type, const void *const*indices, GLsizei drawcount);
+OVERRIDE void glBindFramebuffer(GLenum target, GLuint framebuffer);
+OVERRIDE void glBindFramebufferEXT(GLenum target, GLuint framebuffer);
+OVERRIDE void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *data);
+OVERRIDE void glCopyTexImage2D(GLenum target, GLint level, GLenum internalformat, GLint x, GLint y, GLsizei width, GLsizei height, GLint border);
+OVERRIDE void glCopyTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height);
+OVERRIDE void glBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter);
+OVERRIDE void glBeginQuery(GLenum target, GLuint id);
+
+#endif
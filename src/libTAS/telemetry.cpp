@@ -0,0 +1,87 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "telemetry.h"
+#include "time.h" // clock_gettime_real, frame_counter
+#include "socket.h"
+#include "DeterministicTimer.h"
+#include "EventQueue.h"
+#include "FramePacer.h"
+#include "../shared/messages.h"
+
+std::atomic<uint64_t> telemetryAudioMixNs(0);
+std::atomic<uint64_t> telemetryEncodeNs(0);
+
+/* Real and CPU time at the end of the last frame boundary */
+static uint64_t exitRealTime = 0;
+static uint64_t exitCpuTime = 0;
+
+/* Real and CPU time at the start of the current frame boundary */
+static uint64_t enterRealTime = 0;
+static uint64_t enterCpuTime = 0;
+
+/* Duration of the last frame boundary */
+static uint64_t boundaryTime = 0;
+
+uint64_t telemetryNow(clockid_t clock)
+{
+    /* We can be called before linking the real clock function */
+    if (!clock_gettime_real)
+        return 0;
+
+    struct timespec ts;
+    clock_gettime_real(clock, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void telemetryEnterBoundary(void)
+{
+    enterRealTime = telemetryNow(CLOCK_MONOTONIC);
+    enterCpuTime = telemetryNow(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void telemetrySend(bool drawFB)
+{
+    struct FrameTelemetry telemetry = {};
+    telemetry.frame = frame_counter;
+
+    /* Nothing to measure on the first frame */
+    if (exitRealTime != 0) {
+        telemetry.frame_ns = enterRealTime - exitRealTime;
+        telemetry.frame_cpu_ns = enterCpuTime - exitCpuTime;
+        telemetry.boundary_ns = boundaryTime;
+    }
+
+    telemetry.audio_mix_ns = telemetryAudioMixNs.exchange(0, std::memory_order_relaxed);
+    telemetry.encode_ns = telemetryEncodeNs.exchange(0, std::memory_order_relaxed);
+    telemetry.event_queue_length = sdlEventQueue.size();
+    telemetry.forced_advances = detTimer.popForcedAdvances();
+    telemetry.draw = drawFB;
+    telemetry.paced = framePacer.popJitter(&telemetry.pacing_jitter_ns);
+
+    sendMessage(MSGB_FRAME_TELEMETRY);
+    sendData(&telemetry, sizeof(struct FrameTelemetry));
+}
+
+void telemetryExitBoundary(void)
+{
+    exitRealTime = telemetryNow(CLOCK_MONOTONIC);
+    exitCpuTime = telemetryNow(CLOCK_THREAD_CPUTIME_ID);
+    boundaryTime = exitRealTime - enterRealTime;
+}
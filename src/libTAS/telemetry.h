@@ -0,0 +1,67 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_TELEMETRY_H_INCL
+#define LIBTAS_TELEMETRY_H_INCL
+
+#include "../shared/frametelemetry.h"
+#include <atomic>
+#include <time.h>
+
+/* Per-frame telemetry, sent to linTAS at each frame boundary.
+ *
+ * The frame boundary calls telemetryEnterBoundary() when starting,
+ * telemetrySend() just before notifying linTAS, and
+ * telemetryExitBoundary() when leaving. Other measurements are
+ * accumulated in the counters below, from any thread.
+ */
+
+/* Time spent mixing audio */
+extern std::atomic<uint64_t> telemetryAudioMixNs;
+
+/* Time spent encoding */
+extern std::atomic<uint64_t> telemetryEncodeNs;
+
+/* Current time of a real clock in nanoseconds, or 0 if not available yet */
+uint64_t telemetryNow(clockid_t clock);
+
+void telemetryEnterBoundary(void);
+void telemetrySend(bool drawFB);
+void telemetryExitBoundary(void);
+
+/* Add the real time spent in a scope to a counter */
+class TelemetryTimer
+{
+    public:
+        TelemetryTimer(std::atomic<uint64_t>& c) : counter(c)
+        {
+            start = telemetryNow(CLOCK_MONOTONIC);
+        }
+
+        ~TelemetryTimer()
+        {
+            counter.fetch_add(telemetryNow(CLOCK_MONOTONIC) - start, std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint64_t>& counter;
+        uint64_t start;
+};
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "threads.h"
 #include "logging.h"
+#include "ThreadState.h"
 #include <errno.h>
 #include <unistd.h>
 
@@ -71,6 +72,11 @@ int isMainThread(void)
     return 1;
 }
 
+pthread_t getMainThreadId(void)
+{
+    return mainThread;
+}
+
 /* Override */ SDL_Thread* SDL_CreateThread(SDL_ThreadFunction fn, const char *name, void *data)
 {
     debuglog(LCF_THREAD, "SDL Thread ", name, " was created.");
@@ -95,9 +101,32 @@ void link_pthread(void)
     LINK_SUFFIX(pthread_self, "pthread");
 }
 
+/* Threads created by our own code, or by a library on behalf of it,
+ * are native from the start, so that their waits stay in real time */
+struct NativeThreadStart {
+    void * (* start_routine) (void *);
+    void * arg;
+};
+
+static void *nativeThreadStart(void *arg)
+{
+    NativeThreadStart start = *static_cast<NativeThreadStart*>(arg);
+    delete static_cast<NativeThreadStart*>(arg);
+    threadState.setNative(true);
+    return start.start_routine(start.arg);
+}
+
 /* Override */ int pthread_create (pthread_t * thread, const pthread_attr_t * attr, void * (* start_routine) (void *), void * arg) throw()
 {
     link_pthread();
+    if (threadState.isNative() || threadState.isOwnCode()) {
+        NativeThreadStart *start = new NativeThreadStart{start_routine, arg};
+        int ret = pthread_create_real(thread, attr, nativeThreadStart, start);
+        if (ret != 0)
+            delete start;
+        return ret;
+    }
+
     char name[16];
     name[0] = '\0';
     int ret = pthread_create_real(thread, attr, start_routine, arg);
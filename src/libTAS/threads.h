@@ -26,6 +26,8 @@
 typedef unsigned long int pthread_t;
 
 extern pthread_t (*pthread_self_real)(void);
+extern int (*pthread_create_real) (pthread_t * thread, const pthread_attr_t * attr, void * (* start_routine) (void *), void * arg);
+extern int (*pthread_join_real) (unsigned long int thread, void **thread_return);
 
 typedef int (*SDL_ThreadFunction) (void *data);
 /* Opaque struct of a SDL thread */
@@ -40,6 +42,9 @@ void setMainThread(void);
 /* Check if we are the main thread */
 int isMainThread(void);
 
+/* Get the id of the main thread */
+pthread_t getMainThreadId(void);
+
 /**
  *  Create a thread.
  */
@@ -25,6 +25,8 @@
 #include "DeterministicTimer.h"
 #include "backtrace.h"
 #include "ThreadState.h"
+#include "TimedWait.h"
+#include "hookprofiler.h"
 
 /* Frame counter */
 unsigned long frame_counter = 0;
@@ -34,6 +36,7 @@ int (*clock_gettime_real) (clockid_t clock_id, struct timespec *tp);
 
 /* Override */ time_t time(time_t* t)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FREQUENT);
     struct timespec ts = detTimer.getTicks(TIMETYPE_TIME);
     debuglog(LCF_TIMEGET | LCF_FREQUENT, "  returning ", ts.tv_sec);
@@ -44,6 +47,7 @@ int (*clock_gettime_real) (clockid_t clock_id, struct timespec *tp);
 
 /* Override */ int gettimeofday(struct timeval* tv, struct timezone* tz) throw()
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FREQUENT);
     struct timespec ts = detTimer.getTicks(TIMETYPE_UNTRACKED);
     //struct timespec ts = detTimer.getTicks(TIMETYPE_GETTIMEOFDAY);
@@ -56,6 +60,7 @@ int (*clock_gettime_real) (clockid_t clock_id, struct timespec *tp);
 
 /* Override */ clock_t clock (void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FREQUENT);
     struct timespec ts = detTimer.getTicks(TIMETYPE_CLOCK);
     clock_t clk = (clock_t)(((double)ts.tv_sec + (double) (ts.tv_nsec) / 1000000000) * CLOCKS_PER_SEC);
@@ -65,6 +70,7 @@ int (*clock_gettime_real) (clockid_t clock_id, struct timespec *tp);
 
 /* Override */ int clock_gettime (clockid_t clock_id, struct timespec *tp)
 {
+    PROFILE_HOOK();
     if (!clock_gettime_real) {
         /* Some libraries can call this *very* early, and trying to link
          * results in a crash.
@@ -91,6 +97,7 @@ int (*nanosleep_real) (const struct timespec *requested_time, struct timespec *r
 
 /* Override */ void SDL_Delay(unsigned int sleep)
 {
+    PROFILE_HOOK();
     bool mainT = isMainThread();
     debuglog(LCF_SDL | LCF_SLEEP | (mainT?LCF_NONE:LCF_FREQUENT), __func__, " call - sleep for ", sleep, " ms.");
 
@@ -109,11 +116,19 @@ int (*nanosleep_real) (const struct timespec *requested_time, struct timespec *r
         ts.tv_nsec = 0;
     }
 
+    /* Other threads sleep until the timer reaches the end of the delay */
+    if (sleep && !mainT && useGameTime()) {
+        TimedWait wait(ts, false);
+        wait.sleep();
+        return;
+    }
+
     nanosleep_real(&ts, NULL);
 }
 
 /* Override */ int usleep(useconds_t usec)
 {
+    PROFILE_HOOK();
     bool mainT = isMainThread();
     debuglog(LCF_SLEEP | (mainT?LCF_NONE:LCF_FREQUENT), __func__, " call - sleep for ", usec, " us.");
 
@@ -132,12 +147,20 @@ int (*nanosleep_real) (const struct timespec *requested_time, struct timespec *r
         ts.tv_nsec = 0;
     }
 
+    /* Other threads sleep until the timer reaches the end of the delay */
+    if (usec && !mainT && useGameTime()) {
+        TimedWait wait(ts, false);
+        wait.sleep();
+        return 0;
+    }
+
     nanosleep_real(&ts, NULL);
     return 0;
 }
 
 /* Override */ int nanosleep (const struct timespec *requested_time, struct timespec *remaining)
 {
+    PROFILE_HOOK();
     bool mainT = isMainThread();
     debuglog(LCF_SLEEP | (mainT?LCF_NONE:LCF_FREQUENT), __func__, " call - sleep for ", requested_time->tv_sec * 1000000000 + requested_time->tv_nsec, " nsec");
 
@@ -152,11 +175,23 @@ int (*nanosleep_real) (const struct timespec *requested_time, struct timespec *r
         return nanosleep_real(&owntime, remaining);
     }
 
+    /* Other threads sleep until the timer reaches the end of the delay */
+    if (useGameTime()) {
+        TimedWait wait(*requested_time, false);
+        wait.sleep();
+        if (remaining) {
+            remaining->tv_sec = 0;
+            remaining->tv_nsec = 0;
+        }
+        return 0;
+    }
+
     return nanosleep_real(requested_time, remaining);
 }
 
 /* Override */ Uint32 SDL_GetTicks(void)
 {
+    PROFILE_HOOK();
     struct timespec ts = detTimer.getTicks(TIMETYPE_SDLGETTICKS);
     Uint32 msec = ts.tv_sec*1000 + ts.tv_nsec/1000000;
     debuglog(LCF_SDL | LCF_TIMEGET | LCF_FRAME, __func__, " call - returning ", msec);
@@ -166,12 +201,14 @@ int (*nanosleep_real) (const struct timespec *requested_time, struct timespec *r
 
 /* Override */ Uint64 SDL_GetPerformanceFrequency(void)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_TIMEGET | LCF_FRAME, __func__, " call.");
     return 1000000000;
 }
 
 /* Override */ Uint64 SDL_GetPerformanceCounter(void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_TIMEGET | LCF_FRAME);
     struct timespec ts = detTimer.getTicks(TIMETYPE_SDLGETPERFORMANCECOUNTER);
     Uint64 counter = ts.tv_nsec + ts.tv_sec * 1000000000ULL;
@@ -187,12 +224,14 @@ SDL_bool (*SDL_RemoveTimer_real)(SDL_TimerID id);
 
 /* Override */ SDL_TimerID SDL_AddTimer(Uint32 interval, SDL_NewTimerCallback callback, void *param)
 {
+    PROFILE_HOOK();
     debuglog(LCF_TIMEFUNC | LCF_SDL | LCF_TODO, "Add SDL Timer with call after ", interval, " ms");
     return SDL_AddTimer_real(interval, callback, param);
 }
 
 /* Override */ SDL_bool SDL_RemoveTimer(SDL_TimerID id)
 {
+    PROFILE_HOOK();
     debuglog(LCF_TIMEFUNC | LCF_SDL | LCF_TODO, "Remove SDL Timer.");
     return SDL_RemoveTimer_real(id);
 }
@@ -0,0 +1,251 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+#include "threads.h"
+#include "time.h" // clock_gettime_real
+#include "logging.h"
+#include "ThreadState.h"
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+std::atomic<bool> tracing(false);
+
+static std::string traceFilename;
+
+/* Table of event names */
+static const char* traceNames[TRACE_MAX_NAMES];
+static unsigned int traceNameCount = 0;
+static std::mutex traceNameMutex;
+
+/* Ring buffer of events of a thread.
+ * Only its thread writes events, and the head is only read when dumping.
+ */
+struct TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    std::atomic<uint64_t> head;
+    uint32_t tid;
+    pthread_t thread;
+};
+
+/* Events of an exited thread, in order */
+struct RetiredTrace {
+    std::vector<TraceEvent> events;
+    uint64_t dropped;
+    uint32_t tid;
+    pthread_t thread;
+};
+
+static std::vector<TraceBuffer*> traceBuffers;
+static std::deque<RetiredTrace> retiredTraces;
+static uint64_t retiredEventCount = 0;
+static std::mutex traceBufferMutex;
+
+static thread_local TraceBuffer* threadBuffer = nullptr;
+
+/* Key whose destructor retires the buffer of a thread */
+static pthread_key_t traceBufferKey;
+static pthread_once_t traceBufferKeyOnce = PTHREAD_ONCE_INIT;
+
+void traceInit(const char* filename)
+{
+    traceFilename = filename;
+    tracing = true;
+}
+
+uint16_t traceRegisterName(const char* name)
+{
+    std::lock_guard<std::mutex> lock(traceNameMutex);
+
+    if (traceNameCount == TRACE_MAX_NAMES) {
+        debuglog(LCF_ERROR, "Too many trace event names");
+        return TRACE_MAX_NAMES - 1;
+    }
+
+    traceNames[traceNameCount] = name;
+    return traceNameCount++;
+}
+
+const char* traceGetName(uint16_t name)
+{
+    std::lock_guard<std::mutex> lock(traceNameMutex);
+    return traceNames[name];
+}
+
+/* Number of events in the buffer and index of the first one */
+static uint64_t bufferEvents(uint64_t head, uint64_t* start)
+{
+    uint64_t count = (head < TRACE_BUFFER_EVENTS) ? head : TRACE_BUFFER_EVENTS;
+    *start = (head - count) % TRACE_BUFFER_EVENTS;
+    return count;
+}
+
+/* Move the events of an exiting thread out of its ring buffer,
+ * and free the ring buffer */
+static void retireTraceBuffer(void* arg)
+{
+    TraceBuffer* buffer = static_cast<TraceBuffer*>(arg);
+    threadBuffer = nullptr;
+
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    uint64_t start;
+    uint64_t count = bufferEvents(head, &start);
+
+    RetiredTrace retired;
+    retired.dropped = head - count;
+    retired.tid = buffer->tid;
+    retired.thread = buffer->thread;
+    retired.events.reserve(count);
+    for (uint64_t e = 0; e < count; e++)
+        retired.events.push_back(buffer->events[(start + e) % TRACE_BUFFER_EVENTS]);
+
+    std::lock_guard<std::mutex> lock(traceBufferMutex);
+    for (auto it = traceBuffers.begin(); it != traceBuffers.end(); ++it) {
+        if (*it == buffer) {
+            traceBuffers.erase(it);
+            break;
+        }
+    }
+    delete buffer;
+
+    retiredEventCount += count;
+    retiredTraces.push_back(std::move(retired));
+    while (retiredEventCount > TRACE_RETIRED_EVENTS) {
+        retiredEventCount -= retiredTraces.front().events.size();
+        retiredTraces.pop_front();
+    }
+}
+
+static void createTraceBufferKey(void)
+{
+    pthread_key_create(&traceBufferKey, retireTraceBuffer);
+}
+
+static TraceBuffer* newTraceBuffer(void)
+{
+    TraceBuffer* buffer = new TraceBuffer;
+    buffer->head = 0;
+    buffer->tid = syscall(SYS_gettid);
+    buffer->thread = getThreadId();
+
+    /* Retire the buffer when the thread exits. The main thread keeps
+     * it, as key destructors are not called when the process exits */
+    pthread_once(&traceBufferKeyOnce, createTraceBufferKey);
+    pthread_setspecific(traceBufferKey, buffer);
+
+    std::lock_guard<std::mutex> lock(traceBufferMutex);
+    traceBuffers.push_back(buffer);
+    return buffer;
+}
+
+void traceEvent(uint16_t name, uint8_t phase, uint32_t arg)
+{
+    /* We can be called before linking the real clock function */
+    if (!clock_gettime_real)
+        return;
+
+    if (!threadBuffer)
+        threadBuffer = newTraceBuffer();
+
+    struct timespec ts;
+    clock_gettime_real(CLOCK_MONOTONIC, &ts);
+
+    uint64_t head = threadBuffer->head.load(std::memory_order_relaxed);
+    TraceEvent& event = threadBuffer->events[head % TRACE_BUFFER_EVENTS];
+    event.time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    event.arg = arg;
+    event.name = name;
+    event.phase = phase;
+    event.reserved = 0;
+    threadBuffer->head.store(head + 1, std::memory_order_release);
+}
+
+void traceDump(void)
+{
+    if (!tracing)
+        return;
+    tracing = false;
+
+    threadState.setOwnCode(true);
+
+    FILE* f = fopen(traceFilename.c_str(), "wb");
+    if (!f) {
+        debuglog(LCF_ERROR, "Could not open trace file ", traceFilename);
+        threadState.setOwnCode(false);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lockNames(traceNameMutex);
+    std::lock_guard<std::mutex> lockBuffers(traceBufferMutex);
+
+    struct TraceFileHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.n_names = traceNameCount;
+    header.n_threads = retiredTraces.size() + traceBuffers.size();
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, f);
+
+    for (unsigned int n = 0; n < traceNameCount; n++) {
+        uint32_t len = strlen(traceNames[n]);
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(traceNames[n], 1, len, f);
+    }
+
+    pthread_t mainId = getMainThreadId();
+    for (const RetiredTrace& retired : retiredTraces) {
+        struct TraceThreadHeader thheader;
+        thheader.tid = retired.tid;
+        thheader.is_main = (retired.thread == mainId);
+        thheader.n_events = retired.events.size();
+        thheader.n_dropped = retired.dropped;
+        fwrite(&thheader, sizeof(thheader), 1, f);
+        fwrite(retired.events.data(), sizeof(TraceEvent), retired.events.size(), f);
+    }
+
+    for (TraceBuffer* buffer : traceBuffers) {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t start;
+        uint64_t count = bufferEvents(head, &start);
+
+        struct TraceThreadHeader thheader;
+        thheader.tid = buffer->tid;
+        thheader.is_main = (buffer->thread == mainId);
+        thheader.n_events = count;
+        thheader.n_dropped = head - count;
+        fwrite(&thheader, sizeof(thheader), 1, f);
+
+        /* Write the events in order, the ring buffer may have wrapped */
+        uint64_t first = TRACE_BUFFER_EVENTS - start;
+        if (first > count)
+            first = count;
+        fwrite(&buffer->events[start], sizeof(TraceEvent), first, f);
+        fwrite(&buffer->events[0], sizeof(TraceEvent), count - first, f);
+    }
+
+    fclose(f);
+    debuglog(LCF_HOOK, "Wrote trace file ", traceFilename);
+    threadState.setOwnCode(false);
+}
@@ -0,0 +1,105 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_TRACE_H_INCL
+#define LIBTAS_TRACE_H_INCL
+
+#include "../shared/tracefile.h"
+#include <atomic>
+
+/* Binary tracing of libTAS, for profiling.
+ *
+ * When a trace file is given by linTAS, events are recorded in a ring
+ * buffer for each thread, without any lock. Each buffer keeps the last
+ * TRACE_BUFFER_EVENTS events. When a thread exits, its events are moved
+ * to a smaller buffer and its ring buffer is freed. All buffers are written
+ * to the trace file when the game exits, and the file can then be converted to the Chrome
+ * trace format with the trace2json program.
+ *
+ * Events are recorded with the following macros:
+ *     TRACE_SCOPE("Audio mix");   // from here to the end of the scope
+ *     TRACE_EVENT_INSTANT("Name", arg); // a single event
+ * Names must be string literals or have a static storage duration.
+ * Hooked functions use PROFILE_HOOK() from hookprofiler.h instead, which
+ * also feeds the hook profiler.
+ */
+
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+/* Maximum number of events kept from exited threads. Events of the
+ * threads that exited first are dropped when it is reached */
+#define TRACE_RETIRED_EVENTS (1 << 20)
+#define TRACE_MAX_NAMES 65536
+
+/* Is tracing enabled? */
+extern std::atomic<bool> tracing;
+
+/* Start tracing, the trace will be written in filename at exit */
+void traceInit(const char* filename);
+
+/* Get the index of an event name */
+uint16_t traceRegisterName(const char* name);
+
+/* Get the name of an event index */
+const char* traceGetName(uint16_t name);
+
+/* Record an event in the buffer of the current thread */
+void traceEvent(uint16_t name, uint8_t phase, uint32_t arg);
+
+/* Write all the buffers into the trace file */
+void traceDump(void);
+
+/* Record a begin event when constructed and an end event when destroyed */
+class TraceScope
+{
+    public:
+        TraceScope(uint16_t n) : name(n)
+        {
+            active = tracing.load(std::memory_order_relaxed);
+            if (active)
+                traceEvent(name, TRACE_BEGIN, 0);
+        }
+
+        ~TraceScope()
+        {
+            if (active)
+                traceEvent(name, TRACE_END, 0);
+        }
+
+    private:
+        uint16_t name;
+        bool active;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+#define TRACE_SCOPE(name) \
+    static const uint16_t TRACE_CONCAT(trace_name_, __LINE__) = traceRegisterName(name); \
+    TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(TRACE_CONCAT(trace_name_, __LINE__))
+
+#define TRACE_EVENT_INSTANT(name, arg) \
+    do { \
+        if (tracing.load(std::memory_order_relaxed)) { \
+            static const uint16_t trace_name = traceRegisterName(name); \
+            traceEvent(trace_name, TRACE_INSTANT, arg); \
+        } \
+    } while (0)
+
+#endif
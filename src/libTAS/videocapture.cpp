@@ -23,7 +23,7 @@
 
 #include "hook.h"
 #include "logging.h"
-#include "../external/gl.h" // glReadPixels enum arguments
+#include "opengl.h" // LINK_GL, glReadPixels enum arguments
 #include "../external/SDL.h" // SDL_Surface
 #include <vector>
 #include <string.h> // memcpy
@@ -34,6 +34,23 @@ bool useGL;
 std::vector<uint8_t> glpixels;
 std::vector<uint8_t> winpixels;
 
+/* With openGL, the screen is read into pixel buffer objects, so that
+ * glReadPixels returns without waiting for the GPU. The pixels of a
+ * frame are mapped when capturing the next frame, which leaves the GPU
+ * a whole frame to finish the transfer. If pixel buffer objects are not
+ * supported, the screen is read synchronously. */
+#define CAPTURE_PBO_COUNT 2
+
+static bool usePBO;
+static GLuint pbos[CAPTURE_PBO_COUNT];
+
+/* Number of frames read into the pixel buffer objects, and mapped */
+static uint64_t pboReadFrames;
+static uint64_t pboMappedFrames;
+
+/* Is a pixel buffer object currently mapped */
+static bool pboMapped;
+
 /* Original function pointers */
 void (*SDL_GL_GetDrawableSize_real)(void* window, int* w, int* h);
 SDL_Surface* (*SDL_GetWindowSurface_real)(void* window);
@@ -46,6 +63,14 @@ void* (*SDL_GetRenderer_real)(void* window);
 int (*SDL_GetRendererOutputSize_real)(void* renderer, int* w, int* h);
 
 void (*glReadPixels_real)(int x, int y, int width, int height, unsigned int format, unsigned int type, void* data);
+static void (*glGetIntegerv_real)(GLenum pname, GLint* data);
+static void (*glGenBuffers_real)(GLsizei n, GLuint* buffers);
+static void (*glDeleteBuffers_real)(GLsizei n, const GLuint* buffers);
+static void (*glBindBuffer_real)(GLenum target, GLuint buffer);
+static void (*glBufferData_real)(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+static void* (*glMapBuffer_real)(GLenum target, GLenum access);
+static GLboolean (*glUnmapBuffer_real)(GLenum target);
+static void* (*glXGetCurrentContext_real)(void);
 
 /* Video dimensions */
 int width, height;
@@ -79,8 +104,15 @@ AVPixelFormat initVideoCapture(void* window, bool video_opengl, int *pwidth, int
 
         SDL1::SDL_Surface *surf = SDL_GetVideoSurface_real();
         
-        pixelSize = surf->format->BytesPerPixel;
-        pixfmt = AV_PIX_FMT_RGBA; // TODO
+        if (useGL) {
+            /* We read pixels in the format used by the encoder */
+            pixfmt = AV_PIX_FMT_BGRA;
+            pixelSize = 4;
+        }
+        else {
+            pixelSize = surf->format->BytesPerPixel;
+            pixfmt = AV_PIX_FMT_RGBA; // TODO
+        }
         
         *pwidth = surf->w;
         *pheight = surf->h;
@@ -175,9 +207,7 @@ AVPixelFormat initVideoCapture(void* window, bool video_opengl, int *pwidth, int
     width = *pwidth;
     height = *pheight;
 
-    /* Allocate an array of pixels */
     size = width * height * pixelSize;
-    winpixels.resize(size);
 
     /* Dimensions must be a multiple of 2 */
     if ((width % 1) || (height % 1)) {
@@ -192,40 +222,178 @@ AVPixelFormat initVideoCapture(void* window, bool video_opengl, int *pwidth, int
             return AV_PIX_FMT_NONE;
         }
 
-        /* Allocate another pixels array,
-         * because the image will need to be flipped.
-         */
-        glpixels.resize(size);
+        LINK_GL(glGetIntegerv);
+        LINK_GL(glGenBuffers);
+        LINK_GL(glDeleteBuffers);
+        LINK_GL(glBindBuffer);
+        LINK_GL(glBufferData);
+        LINK_GL(glMapBuffer);
+        LINK_GL(glUnmapBuffer);
+        LINK_SUFFIX(glXGetCurrentContext, "libGL");
+
+        usePBO = glGetIntegerv_real && glGenBuffers_real && glDeleteBuffers_real &&
+                 glBindBuffer_real && glBufferData_real && glMapBuffer_real && glUnmapBuffer_real;
+        if (!usePBO) {
+            debuglog(LCF_DUMP | LCF_OGL, "Pixel buffer objects are not supported, the screen is read synchronously");
+            glpixels.resize(size);
+        }
+
+        /* Pixel buffer objects are created at the first capture */
+        pboReadFrames = 0;
+        pboMappedFrames = 0;
+        pboMapped = false;
+    }
+    else {
+        /* Allocate an array of pixels */
+        winpixels.resize(size);
     }
 
     return pixfmt;
 }
 
-int captureVideoFrame(const uint8_t* orig_plane[], int orig_stride[])
+/* Map the oldest pixel buffer object that was not mapped yet.
+ * The pixel buffer object binding must be saved by the caller. */
+static const uint8_t* mapNextPBO(void)
+{
+    glBindBuffer_real(GL_PIXEL_PACK_BUFFER, pbos[pboMappedFrames % CAPTURE_PBO_COUNT]);
+    const uint8_t* pixels = static_cast<const uint8_t*>(glMapBuffer_real(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+    pboMappedFrames++;
+    if (!pixels) {
+        debuglog(LCF_DUMP | LCF_OGL | LCF_ERROR, "Could not map the pixel buffer object");
+        return nullptr;
+    }
+    pboMapped = true;
+    return pixels;
+}
+
+/* Unmap the pixel buffer object mapped at the previous capture.
+ * The pixel buffer object binding must be saved by the caller. */
+static void unmapPBO(void)
+{
+    if (!pboMapped)
+        return;
+    glBindBuffer_real(GL_PIXEL_PACK_BUFFER, pbos[(pboMappedFrames - 1) % CAPTURE_PBO_COUNT]);
+    glUnmapBuffer_real(GL_PIXEL_PACK_BUFFER);
+    pboMapped = false;
+}
+
+/* Return the pixels of the mapped buffer. OpenGL images start from
+ * the bottom row, so we point to the last row with a negative stride,
+ * which flips the image without any copy. */
+static void setGLPlane(const uint8_t* pixels, const uint8_t* orig_plane[], int orig_stride[])
 {
     int pitch = pixelSize * width;
+    orig_plane[0] = pixels + (height - 1) * pitch;
+    orig_stride[0] = -pitch;
+}
 
-    if (useGL) {
-        /* TODO: Check that the openGL dimensions did not change in between */
+static int captureGLFrame(const uint8_t* orig_plane[], int orig_stride[])
+{
+    orig_plane[0] = nullptr;
 
+    if (!usePBO) {
         /* We access to the image pixels directly using glReadPixels */
-        glReadPixels_real(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &glpixels[0]);
-        /* TODO: I saw this in some examples before calling glReadPixels: glPixelStorei(GL_PACK_ALIGNMENT, 1); */
-
-        /*
-         * Flip image horizontally
-         * This is because OpenGL has a different reference point
-         * Code taken from http://stackoverflow.com/questions/5862097/sdl-opengl-screenshot-is-black
-         * TODO: Could this be done without allocating another array ?
-         */
-
-        for (int line = 0; line < height; line++) {
-            int pos = line * pitch;
-            for (int p=0; p<pitch; p++) {
-                winpixels[pos + p] = glpixels[(size-pos)-pitch + p];
-            }
+        glReadPixels_real(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, &glpixels[0]);
+        setGLPlane(glpixels.data(), orig_plane, orig_stride);
+        return 0;
+    }
+
+    /* Keep the buffer bound by the game */
+    GLint prevBuffer = 0;
+    glGetIntegerv_real(GL_PIXEL_PACK_BUFFER_BINDING, &prevBuffer);
+
+    if (pboReadFrames == 0) {
+        glGenBuffers_real(CAPTURE_PBO_COUNT, pbos);
+        for (int i = 0; i < CAPTURE_PBO_COUNT; i++) {
+            glBindBuffer_real(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData_real(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
         }
+    }
 
+    unmapPBO();
+
+    /* Start the transfer of the current frame */
+    glBindBuffer_real(GL_PIXEL_PACK_BUFFER, pbos[pboReadFrames % CAPTURE_PBO_COUNT]);
+    glReadPixels_real(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+    pboReadFrames++;
+
+    /* Get the oldest frame once all buffers are in use */
+    int ret = 0;
+    if ((pboReadFrames - pboMappedFrames) >= CAPTURE_PBO_COUNT) {
+        const uint8_t* pixels = mapNextPBO();
+        if (pixels)
+            setGLPlane(pixels, orig_plane, orig_stride);
+        else
+            ret = 1;
+    }
+
+    glBindBuffer_real(GL_PIXEL_PACK_BUFFER, prevBuffer);
+    return ret;
+}
+
+/* Our pixel buffer objects can only be accessed with the context of the
+ * game current. If we don't know, we assume that it is. */
+static bool hasGLContext(void)
+{
+    return !glXGetCurrentContext_real || glXGetCurrentContext_real();
+}
+
+int captureRemainingFrame(const uint8_t* orig_plane[], int orig_stride[])
+{
+    orig_plane[0] = nullptr;
+
+    if (!useGL || !usePBO || (pboReadFrames == 0))
+        return 0;
+
+    if (!hasGLContext()) {
+        debuglog(LCF_DUMP | LCF_OGL | LCF_ERROR, "No OpenGL context to read the remaining frames");
+        return 1;
+    }
+
+    GLint prevBuffer = 0;
+    glGetIntegerv_real(GL_PIXEL_PACK_BUFFER_BINDING, &prevBuffer);
+
+    unmapPBO();
+
+    int ret = 0;
+    if (pboMappedFrames < pboReadFrames) {
+        const uint8_t* pixels = mapNextPBO();
+        if (pixels)
+            setGLPlane(pixels, orig_plane, orig_stride);
+        else
+            ret = 1;
+    }
+
+    glBindBuffer_real(GL_PIXEL_PACK_BUFFER, prevBuffer);
+    return ret;
+}
+
+void closeVideoCapture(void)
+{
+    if (!useGL || !usePBO || (pboReadFrames == 0))
+        return;
+
+    /* Without a context, the buffers were destroyed with it */
+    if (hasGLContext()) {
+        GLint prevBuffer = 0;
+        glGetIntegerv_real(GL_PIXEL_PACK_BUFFER_BINDING, &prevBuffer);
+        unmapPBO();
+        glBindBuffer_real(GL_PIXEL_PACK_BUFFER, prevBuffer);
+
+        glDeleteBuffers_real(CAPTURE_PBO_COUNT, pbos);
+    }
+    pboReadFrames = 0;
+    pboMappedFrames = 0;
+    pboMapped = false;
+}
+
+int captureVideoFrame(const uint8_t* orig_plane[], int orig_stride[])
+{
+    int pitch = pixelSize * width;
+
+    if (useGL) {
+        /* TODO: Check that the openGL dimensions did not change in between */
+        return captureGLFrame(orig_plane, orig_stride);
     }
 
     else {
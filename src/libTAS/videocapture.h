@@ -37,10 +37,25 @@ AVPixelFormat initVideoCapture(void* window, bool video_opengl, int *pwidth, int
  * @param stride  Array of 4 elements containing the size in bytes of a
  *                row of pixels for each plane. For non-planar formats,
  *                the first element contains width * (size of a pixel).
+ *                It is negative if the rows are stored from the bottom.
  * @return        0 if successful or 1 if an error occured
+ *
+ * With openGL, the screen is read asynchronously, and the returned pixels
+ * are the ones of a previous frame. The first plane is NULL if no frame
+ * is available yet. The pixels are valid until the next capture call.
  */
 int captureVideoFrame(const uint8_t* orig_plane[], int orig_stride[]);
 
+/* Get the pixels of a frame that was captured but not returned yet,
+ * in the same way as captureVideoFrame(). The first plane is NULL if
+ * there is no such frame.
+ */
+int captureRemainingFrame(const uint8_t* orig_plane[], int orig_stride[]);
+
+/* Free the objects used to capture the screen. Following captures
+ * create them again */
+void closeVideoCapture(void);
+
 #endif
 #endif
 
@@ -0,0 +1,289 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "waits.h"
+#include "hook.h"
+#include "logging.h"
+#include "TimedWait.h"
+#include "ThreadState.h"
+#include "hookprofiler.h"
+#include <errno.h>
+#include <map>
+#include <mutex>
+
+/* Original function pointers */
+int (*pthread_cond_timedwait_real) (pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime) = nullptr;
+int (*pthread_cond_init_real) (pthread_cond_t *cond, const pthread_condattr_t *cond_attr) = nullptr;
+int (*pthread_cond_destroy_real) (pthread_cond_t *cond) = nullptr;
+int (*pthread_cond_clockwait_real) (pthread_cond_t *cond, pthread_mutex_t *mutex, clockid_t clock_id, const struct timespec *abstime) = nullptr;
+int (*sem_timedwait_real) (sem_t *sem, const struct timespec *abstime) = nullptr;
+int (*sem_clockwait_real) (sem_t *sem, clockid_t clock_id, const struct timespec *abstime) = nullptr;
+int (*poll_real) (struct pollfd *fds, nfds_t nfds, int timeout) = nullptr;
+int (*select_real) (int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) = nullptr;
+int (*SDL_CondWaitTimeout_real)(SDL_cond *cond, SDL_mutex *mutex, Uint32 ms) = nullptr;
+
+/* These functions can be called before our constructor, so we link them
+ * on their first call */
+static void link_waits(void)
+{
+    static bool linked = false;
+    if (linked)
+        return;
+
+    LINK_SUFFIX(pthread_cond_init, "pthread");
+    LINK_SUFFIX(pthread_cond_destroy, "pthread");
+    LINK_SUFFIX(pthread_cond_timedwait, "pthread");
+    LINK_SUFFIX(sem_timedwait, "pthread");
+    LINK_SUFFIX(poll, "libc");
+    LINK_SUFFIX(select, "libc");
+
+    /* Only available from glibc 2.30 */
+    LINK_SUFFIX(pthread_cond_clockwait, "pthread");
+    LINK_SUFFIX(sem_clockwait, "pthread");
+    linked = true;
+}
+
+/* Convert a slice of real time in milliseconds, rounded up */
+static int sliceToMs(struct timespec slice)
+{
+    return slice.tv_sec * 1000 + (slice.tv_nsec + 999999) / 1000000;
+}
+
+/* Clock of the condition variables that do not use the default
+ * CLOCK_REALTIME, set with pthread_condattr_setclock */
+static std::map<pthread_cond_t*, clockid_t> condClocks;
+static std::mutex condClocksMutex;
+
+static clockid_t condClock(pthread_cond_t *cond)
+{
+    std::lock_guard<std::mutex> lock(condClocksMutex);
+    auto it = condClocks.find(cond);
+    if (it == condClocks.end())
+        return CLOCK_REALTIME;
+    return it->second;
+}
+
+/* Override */ int pthread_cond_init (pthread_cond_t *cond, const pthread_condattr_t *cond_attr) throw()
+{
+    link_waits();
+    int ret = pthread_cond_init_real(cond, cond_attr);
+    if (ret != 0)
+        return ret;
+
+    clockid_t clock_id = CLOCK_REALTIME;
+    if (cond_attr)
+        pthread_condattr_getclock(cond_attr, &clock_id);
+
+    std::lock_guard<std::mutex> lock(condClocksMutex);
+    if (clock_id == CLOCK_REALTIME)
+        condClocks.erase(cond);
+    else
+        condClocks[cond] = clock_id;
+    return ret;
+}
+
+/* Override */ int pthread_cond_destroy (pthread_cond_t *cond) throw()
+{
+    link_waits();
+    {
+        std::lock_guard<std::mutex> lock(condClocksMutex);
+        condClocks.erase(cond);
+    }
+    return pthread_cond_destroy_real(cond);
+}
+
+/* Wait on a condition variable for a slice of real time.
+ * Waiting on the monotonic clock is preferred when available, otherwise
+ * the end of the slice is expressed in the clock of the condition variable. */
+static int condWaitSlice(pthread_cond_t *cond, pthread_mutex_t *mutex, struct timespec slice)
+{
+    if (pthread_cond_clockwait_real) {
+        struct timespec end = TimedWait::sliceEnd(CLOCK_MONOTONIC, slice);
+        return pthread_cond_clockwait_real(cond, mutex, CLOCK_MONOTONIC, &end);
+    }
+
+    struct timespec end = TimedWait::sliceEnd(condClock(cond), slice);
+    return pthread_cond_timedwait_real(cond, mutex, &end);
+}
+
+/* The absolute time was computed by the game from our own clock functions,
+ * so it is a time of the deterministic timer, whatever the clock is.
+ * Threads of our own code and native threads (the log writer, the audio
+ * mixer and player, the dump stages and the threads they spawn) never get
+ * here, their deadlines are in real time. */
+static int condTimedWait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+    TimedWait wait(*abstime, true);
+    struct timespec slice;
+    while (wait.nextSlice(&slice)) {
+        int ret = condWaitSlice(cond, mutex, slice);
+        if (ret != ETIMEDOUT)
+            return ret;
+    }
+    return ETIMEDOUT;
+}
+
+/* Override */ int pthread_cond_timedwait (pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+    PROFILE_HOOK();
+    link_waits();
+    if (!useGameTime())
+        return pthread_cond_timedwait_real(cond, mutex, abstime);
+
+    debuglog(LCF_WAIT | LCF_FREQUENT, __func__, " call with deadline ", abstime->tv_sec, " sec ", abstime->tv_nsec, " nsec");
+    return condTimedWait(cond, mutex, abstime);
+}
+
+/* Override */ int pthread_cond_clockwait (pthread_cond_t *cond, pthread_mutex_t *mutex, clockid_t clock_id, const struct timespec *abstime)
+{
+    PROFILE_HOOK();
+    link_waits();
+    if (!useGameTime())
+        return pthread_cond_clockwait_real(cond, mutex, clock_id, abstime);
+
+    debuglog(LCF_WAIT | LCF_FREQUENT, __func__, " call with deadline ", abstime->tv_sec, " sec ", abstime->tv_nsec, " nsec");
+    return condTimedWait(cond, mutex, abstime);
+}
+
+/* Override */ int sem_timedwait (sem_t *sem, const struct timespec *abstime)
+{
+    PROFILE_HOOK();
+    link_waits();
+    if (!useGameTime())
+        return sem_timedwait_real(sem, abstime);
+
+    debuglog(LCF_WAIT | LCF_FREQUENT, __func__, " call with deadline ", abstime->tv_sec, " sec ", abstime->tv_nsec, " nsec");
+
+    TimedWait wait(*abstime, true);
+    struct timespec slice;
+    while (wait.nextSlice(&slice)) {
+        int ret;
+        if (sem_clockwait_real) {
+            struct timespec end = TimedWait::sliceEnd(CLOCK_MONOTONIC, slice);
+            ret = sem_clockwait_real(sem, CLOCK_MONOTONIC, &end);
+        }
+        else {
+            struct timespec end = TimedWait::sliceEnd(CLOCK_REALTIME, slice);
+            ret = sem_timedwait_real(sem, &end);
+        }
+        if ((ret == 0) || (errno != ETIMEDOUT))
+            return ret;
+    }
+
+    errno = ETIMEDOUT;
+    return -1;
+}
+
+/* Override */ int poll (struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    PROFILE_HOOK();
+    link_waits();
+
+    /* Only finite timeouts are converted */
+    if ((timeout <= 0) || !useGameTime())
+        return poll_real(fds, nfds, timeout);
+
+    debuglog(LCF_WAIT | LCF_FREQUENT, __func__, " call with timeout ", timeout, " ms");
+
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+
+    TimedWait wait(ts, false);
+    struct timespec slice;
+    while (wait.nextSlice(&slice)) {
+        int ret = poll_real(fds, nfds, sliceToMs(slice));
+        if (ret != 0)
+            return ret;
+    }
+    return 0;
+}
+
+/* Override */ int select (int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    PROFILE_HOOK();
+    link_waits();
+
+    /* Only finite and non-zero timeouts are converted */
+    if (!timeout || ((timeout->tv_sec == 0) && (timeout->tv_usec == 0)) || !useGameTime())
+        return select_real(nfds, readfds, writefds, exceptfds, timeout);
+
+    debuglog(LCF_WAIT | LCF_FREQUENT, __func__, " call with timeout ", timeout->tv_sec, " sec ", timeout->tv_usec, " usec");
+
+    /* select modifies the sets, so we must restore them before each call */
+    fd_set readset, writeset, exceptset;
+    if (readfds) readset = *readfds;
+    if (writefds) writeset = *writefds;
+    if (exceptfds) exceptset = *exceptfds;
+
+    struct timespec ts;
+    ts.tv_sec = timeout->tv_sec;
+    ts.tv_nsec = timeout->tv_usec * 1000;
+
+    TimedWait wait(ts, false);
+    struct timespec slice;
+    while (wait.nextSlice(&slice)) {
+        if (readfds) *readfds = readset;
+        if (writefds) *writefds = writeset;
+        if (exceptfds) *exceptfds = exceptset;
+
+        struct timeval tv;
+        tv.tv_sec = slice.tv_sec;
+        tv.tv_usec = (slice.tv_nsec + 999) / 1000;
+        int ret = select_real(nfds, readfds, writefds, exceptfds, &tv);
+        if (ret != 0) {
+            /* Like Linux, return the remaining time */
+            struct timespec left = wait.remaining();
+            timeout->tv_sec = left.tv_sec;
+            timeout->tv_usec = left.tv_nsec / 1000;
+            return ret;
+        }
+    }
+
+    timeout->tv_sec = 0;
+    timeout->tv_usec = 0;
+    return 0;
+}
+
+/* Override */ int SDL_CondWaitTimeout(SDL_cond *cond, SDL_mutex *mutex, Uint32 ms)
+{
+    PROFILE_HOOK();
+    LINK_SUFFIX_SDLX(SDL_CondWaitTimeout);
+    if ((ms == 0) || !useGameTime())
+        return SDL_CondWaitTimeout_real(cond, mutex, ms);
+
+    debuglog(LCF_SDL | LCF_WAIT | LCF_FREQUENT, __func__, " call with timeout ", ms, " ms");
+
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+
+    TimedWait wait(ts, false);
+    struct timespec slice;
+    while (wait.nextSlice(&slice)) {
+        /* SDL computes the deadline using the clock functions that we hook,
+         * so we make it use the real ones. */
+        threadState.setNative(true);
+        int ret = SDL_CondWaitTimeout_real(cond, mutex, sliceToMs(slice));
+        threadState.setNative(false);
+        if (ret != SDL_MUTEX_TIMEDOUT)
+            return ret;
+    }
+    return SDL_MUTEX_TIMEDOUT;
+}
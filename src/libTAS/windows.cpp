@@ -27,6 +27,8 @@
 #include "libTAS.h"
 #include "renderhud/RenderHUD_GL.h"
 #include "renderhud/RenderHUD_SDL2.h"
+#include "opengl.h"
+#include "hookprofiler.h"
 #ifdef LIBTAS_ENABLE_AVDUMPING
 #include "avdumping.h"
 #endif
@@ -55,6 +57,7 @@ void (*SDL_SetWindowTitle_real)(void * window, const char *title);
 void (*SDL_WM_SetCaption_real)(const char *title, const char *icon);
 SDL_bool (*SDL_GetWindowWMInfo_real)(SDL_Window* window, SDL_SysWMinfo* info);
 void* (*SDL_GL_CreateContext_real)(SDL_Window *window);
+void (*SDL_GL_DeleteContext_real)(void* context);
 int (*SDL_GL_SetSwapInterval_real)(int interval);
 void (*SDL_DestroyWindow_real)(SDL_Window*);
 void (*SDL_SetWindowSize_real)(SDL_Window* window, int w, int h);
@@ -66,8 +69,14 @@ void (*SDL_RenderPresent_real)(SDL_Renderer * renderer);
 SDL1::SDL_Surface *(*SDL_SetVideoMode_real)(int width, int height, int bpp, Uint32 flags);
 void (*SDL_GL_SwapBuffers_real)(void);
 
-/* Deciding if we actually draw the frame */
-static bool skipDraw(void)
+/* Are we skipping the draw of the current frame?
+ * This is decided when the previous frame is drawn, so that we can also
+ * elide the GL draw calls that the game does during the frame.
+ */
+static bool skipDraw = false;
+
+/* Deciding if we actually draw the next frame */
+static void updateSkipDraw(void)
 {
     static int skipCounter = 0;
     if (tasflags.fastforward) {
@@ -77,16 +86,19 @@ static bool skipDraw(void)
     else
         skipCounter = 0;
 
-    return skipCounter;
+    skipDraw = skipCounter;
+    setGLDrawSkip(skipDraw);
 }
 
 /* SDL 1.2 */
 /* Override */ void SDL_GL_SwapBuffers(void)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_FRAME | LCF_OGL | LCF_WINDOW, __func__, " call.");
 
-    if (!skipDraw())
+    if (!skipDraw)
         SDL_GL_SwapBuffers_real();
+    updateSkipDraw();
 
     /* TODO: Fill here same as SDL_GL_SwapWindow */
 
@@ -142,6 +154,7 @@ int sendXid(void)
 
 /* Override */ void SDL_GL_SwapWindow(SDL_Window* window)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_FRAME | LCF_OGL | LCF_WINDOW, __func__, " call.");
 
 #ifdef LIBTAS_ENABLE_HUD
@@ -152,8 +165,9 @@ int sendXid(void)
     renderHUD.renderText(text.c_str(), fg_color, bg_color, 2, 2);
 #endif
 
-    if (!skipDraw())
+    if (!skipDraw)
         SDL_GL_SwapWindow_real(window);
+    updateSkipDraw();
 
     /* 
      * We need to pass the game window identifier to the program
@@ -167,6 +181,7 @@ int sendXid(void)
 
 void* SDL_GL_CreateContext(SDL_Window *window)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_OGL | LCF_WINDOW);
     void* context = SDL_GL_CreateContext_real(window);
 
@@ -178,10 +193,23 @@ void* SDL_GL_CreateContext(SDL_Window *window)
     return context;
 }
 
+void SDL_GL_DeleteContext(void* context)
+{
+    PROFILE_HOOK();
+    DEBUGLOGCALL(LCF_SDL | LCF_OGL | LCF_WINDOW);
+#ifdef LIBTAS_ENABLE_AVDUMPING
+    /* Get the frames that are still being read from the screen */
+    if (tasflags.av_dumping)
+        flushAVDumping();
+#endif
+    SDL_GL_DeleteContext_real(context);
+}
+
 static int swapInterval = 0;
 
 /* Override */ int SDL_GL_SetSwapInterval(int interval)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_OGL | LCF_WINDOW, __func__, " call - setting to ", interval);
 
     /* We save the interval if the game wants it later */
@@ -196,6 +224,7 @@ static int swapInterval = 0;
     
 /* Override */ int SDL_GL_GetSwapInterval(void)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_OGL | LCF_WINDOW);
     return swapInterval;
 }
@@ -204,6 +233,7 @@ std::string origTitle;
 std::string origIcon;
 
 /* Override */ SDL_Window* SDL_CreateWindow(const char* title, int x, int y, int w, int h, Uint32 flags){
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_WINDOW, __func__, " call - title: ", title, ", pos: (", x, ",", y, "), size: (", w, ",", h, "), flags: 0x", std::hex, flags, std::dec);
 
     origTitle = title;
@@ -242,28 +272,33 @@ std::string origIcon;
 }
 
 /* Override */ void SDL_DestroyWindow(SDL_Window* window){
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_WINDOW);
-    SDL_DestroyWindow_real(window);
-    if (gameWindow == window)
-        gameWindow = NULL;
 #ifdef LIBTAS_ENABLE_AVDUMPING
+    /* Close the dump while we can still read the screen */
     if (tasflags.av_dumping)
         closeAVDumping();
 #endif
+    SDL_DestroyWindow_real(window);
+    if (gameWindow == window)
+        gameWindow = NULL;
 }
 
 /* Override */ Uint32 SDL_GetWindowID(SDL_Window* window){
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_WINDOW);
     return SDL_GetWindowID_real(window);
 }
 
 /* Override */ Uint32 SDL_GetWindowFlags(SDL_Window* window){
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_WINDOW);
     return SDL_GetWindowFlags_real(window);
 }
 
 /* Override */ void SDL_SetWindowTitle(SDL_Window * window, const char *title)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_WINDOW, __func__, " call with title ", title);
     if (title != NULL)
         origTitle = title;
@@ -272,6 +307,7 @@ std::string origIcon;
 
 /* Override */ void SDL_WM_SetCaption(const char *title, const char *icon)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_WINDOW, __func__, " call with title ", title);
     if (title != NULL)
         origTitle = title;
@@ -297,18 +333,21 @@ void updateTitle(float fps, float lfps)
 
 /* Override */ int SDL_SetWindowFullscreen(SDL_Window * window, Uint32 flags)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_WINDOW, __func__, " call with flags ", flags);
     return 0; // success
 }
 
 /* Override */ void SDL_SetWindowBordered(SDL_Window * window, SDL_bool bordered)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_WINDOW, __func__, " call with border ", bordered);
     /* Don't do anything */
 }
 
 /* Override */ SDL_Renderer *SDL_CreateRenderer(SDL_Window * window, int index, Uint32 flags)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_WINDOW);
     if (flags & SDL_RENDERER_SOFTWARE)
         debuglog(LCF_SDL | LCF_WINDOW, "  flag SDL_RENDERER_SOFTWARE");
@@ -324,6 +363,7 @@ void updateTitle(float fps, float lfps)
 /* Override */ int SDL_CreateWindowAndRenderer(int width, int height,
         Uint32 window_flags, SDL_Window **window, SDL_Renderer **renderer)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_WINDOW);
     debuglog(LCF_SDL | LCF_WINDOW, "  size ", width, " x ", height);
 
@@ -360,6 +400,7 @@ void updateTitle(float fps, float lfps)
 
 /* Override */ void SDL_RenderPresent(SDL_Renderer * renderer)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_WINDOW);
 
 #ifdef LIBTAS_ENABLE_HUD
@@ -370,8 +411,9 @@ void updateTitle(float fps, float lfps)
     renderHUD.renderText("Test test", fg_color, bg_color, 2, 2);
 #endif
 
-    if (!skipDraw())
+    if (!skipDraw)
         SDL_RenderPresent_real(renderer);
+    updateSkipDraw();
 
     /* 
      * We need to pass the game window identifier to the program
@@ -385,6 +427,7 @@ void updateTitle(float fps, float lfps)
 
 /* Override */ void SDL_SetWindowSize(SDL_Window* window, int w, int h)
 {
+    PROFILE_HOOK();
     DEBUGLOGCALL(LCF_SDL | LCF_WINDOW);
     debuglog(LCF_SDL | LCF_WINDOW, "    New size: ", w, " x ", h);
 
@@ -407,6 +450,7 @@ void updateTitle(float fps, float lfps)
 /* SDL 1.2 */
 /* Override */ SDL1::SDL_Surface *SDL_SetVideoMode(int width, int height, int bpp, Uint32 flags)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_WINDOW, __func__, " call with size (", width, ",", height, "), bpp ", bpp, " and flags ", std::hex, flags, std::dec);
 
     /* Disable fullscreen */
@@ -436,6 +480,7 @@ void updateTitle(float fps, float lfps)
 
 /* Override */ SDL_GrabMode SDL_WM_GrabInput(SDL_GrabMode mode)
 {
+    PROFILE_HOOK();
     debuglog(LCF_SDL | LCF_KEYBOARD | LCF_MOUSE | LCF_WINDOW, __func__, " call with mode ", mode);
     static SDL_GrabMode fakeGrab = SDL_GRAB_OFF;
     if (mode != SDL_GRAB_QUERY)
@@ -463,6 +508,7 @@ void link_sdlwindows(void)
         LINK_SUFFIX_SDL2(SDL_RenderPresent);
         LINK_SUFFIX_SDL2(SDL_SetWindowSize);
         LINK_SUFFIX_SDL2(SDL_GL_CreateContext);
+        LINK_SUFFIX_SDL2(SDL_GL_DeleteContext);
         LINK_SUFFIX_SDL2(SDL_SetWindowTitle);
     }
 }
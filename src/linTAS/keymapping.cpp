@@ -31,6 +31,8 @@ void default_hotkeys(KeySym *hotkeys){
     hotkeys[HOTKEY_READWRITE] = XK_p;
     hotkeys[HOTKEY_SAVESTATE] = XK_s;
     hotkeys[HOTKEY_LOADSTATE] = XK_m;
+    hotkeys[HOTKEY_SLOWDOWN] = XK_KP_Subtract;
+    hotkeys[HOTKEY_SPEEDUP] = XK_KP_Add;
 
     input_mapping[XK_w].type = IT_CONTROLLER1_BUTTON_A;
     input_mapping[XK_w].value = 1;
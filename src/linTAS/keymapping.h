@@ -34,6 +34,8 @@ enum
     HOTKEY_READWRITE, // Switch from read-only recording to write
     HOTKEY_SAVESTATE, // Save the entire state of the game
     HOTKEY_LOADSTATE, // Load the entire state of the game
+    HOTKEY_SLOWDOWN, // Decrease the speed of the game
+    HOTKEY_SPEEDUP, // Increase the speed of the game
     HOTKEY_LEN
 };
 
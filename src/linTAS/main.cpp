@@ -29,6 +29,8 @@
 #include <X11/XKBlib.h>
 #include "../shared/tasflags.h"
 #include "../shared/messages.h"
+#include "../shared/hookprofile.h"
+#include "../shared/frametelemetry.h"
 #include "keymapping.h"
 #include "recording.h"
 //#include "savestates.h"
@@ -53,6 +55,169 @@ pid_t game_pid;
 
 std::vector<std::string> shared_libs;
 
+/* File where the hook profiling summaries are written */
+FILE* profilefp = NULL;
+
+/* File where the frame telemetry is written */
+FILE* telemetryfp = NULL;
+
+/* Telemetry accumulated since the last display of the rolling stats */
+static struct FrameTelemetry telemetrySum;
+static unsigned int telemetryFrames = 0;
+static struct timespec telemetryLastDisplay = {0, 0};
+
+/* Histogram of the frame pacing jitter of the game */
+static unsigned int pacingJitterHistogram[PACING_JITTER_BUCKETS];
+
+/* Available game speeds, as {speed_multiplier, speed_divisor}.
+ * A multiplier of 0 means unbounded speed. */
+static const int speed_levels[][2] = {
+    {1, 8}, {1, 4}, {1, 2}, {1, 1}, {2, 1}, {4, 1}, {8, 1}, {16, 1}, {0, 1}
+};
+static const int speed_levels_len = sizeof(speed_levels) / sizeof(speed_levels[0]);
+static int speed_level = 3;
+
+static void setSpeedLevel(int level)
+{
+    if (level < 0)
+        level = 0;
+    if (level >= speed_levels_len)
+        level = speed_levels_len - 1;
+    speed_level = level;
+
+    tasflags.speed_multiplier = speed_levels[level][0];
+    tasflags.speed_divisor = speed_levels[level][1];
+
+    if (tasflags.speed_multiplier == 0)
+        printf("Speed: unbounded\n");
+    else if (tasflags.speed_divisor == 1)
+        printf("Speed: %dx\n", tasflags.speed_multiplier);
+    else
+        printf("Speed: 1/%dx\n", tasflags.speed_divisor);
+}
+
+/* Upper bound in ns of the latency under which a fraction of
+ * the calls of a hook profiling entry were made */
+static uint64_t profilePercentile(const struct HookProfileEntry* entry, double fraction)
+{
+    uint64_t target = (uint64_t)(entry->calls * fraction);
+    uint64_t count = 0;
+    for (int b = 0; b < HOOKPROFILE_BUCKETS; b++) {
+        count += entry->histogram[b];
+        if (count > target)
+            return (b == 0) ? 0 : (1ULL << b);
+    }
+    return 1ULL << (HOOKPROFILE_BUCKETS - 1);
+}
+
+/* Write the hook profiling summary of a frame, one line per function
+ * and per thread */
+static void writeHookProfile(unsigned long frame, const std::vector<struct HookProfileEntry>& entries)
+{
+    for (auto &entry : entries) {
+        fprintf(profilefp, "%lu,%s,%llx,%u,%u,%llu,%llu,%llu\n",
+                frame, entry.name, (unsigned long long) entry.thread,
+                entry.is_main, entry.calls, (unsigned long long) entry.total_ns,
+                (unsigned long long) profilePercentile(&entry, 0.5),
+                (unsigned long long) profilePercentile(&entry, 0.99));
+    }
+}
+
+/* Write the telemetry of a frame, and display once per second
+ * the average values of the last frames */
+static void updateTelemetry(const struct FrameTelemetry* telemetry)
+{
+    if (telemetryfp) {
+        fprintf(telemetryfp, "%llu,%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%u,%u\n",
+                (unsigned long long) telemetry->frame,
+                (unsigned long long) telemetry->frame_ns,
+                (unsigned long long) telemetry->frame_cpu_ns,
+                (unsigned long long) telemetry->boundary_ns,
+                (unsigned long long) telemetry->audio_mix_ns,
+                (unsigned long long) telemetry->encode_ns,
+                telemetry->event_queue_length, telemetry->forced_advances,
+                telemetry->draw, telemetry->paced, telemetry->pacing_jitter_ns);
+    }
+
+    if (telemetry->paced) {
+        unsigned int jitter_us = telemetry->pacing_jitter_ns / 1000;
+        int bucket = 0;
+        while ((jitter_us > 0) && (bucket < (PACING_JITTER_BUCKETS - 1))) {
+            jitter_us >>= 1;
+            bucket++;
+        }
+        pacingJitterHistogram[bucket]++;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (telemetryLastDisplay.tv_sec == 0) {
+        telemetryLastDisplay = now;
+        memset(&telemetrySum, 0, sizeof(struct FrameTelemetry));
+    }
+
+    telemetrySum.frame_ns += telemetry->frame_ns;
+    telemetrySum.frame_cpu_ns += telemetry->frame_cpu_ns;
+    telemetrySum.boundary_ns += telemetry->boundary_ns;
+    telemetrySum.audio_mix_ns += telemetry->audio_mix_ns;
+    telemetrySum.encode_ns += telemetry->encode_ns;
+    telemetrySum.event_queue_length += telemetry->event_queue_length;
+    telemetrySum.forced_advances += telemetry->forced_advances;
+    telemetrySum.draw += telemetry->draw;
+    telemetryFrames++;
+
+    double elapsed = (now.tv_sec - telemetryLastDisplay.tv_sec) +
+        (now.tv_nsec - telemetryLastDisplay.tv_nsec) / 1e9;
+    if (elapsed < 1.0)
+        return;
+
+    double n = telemetryFrames;
+    printf("%.1f fps | frame %.2f ms (cpu %.2f ms) | boundary %.2f ms | mix %.2f ms | encode %.2f ms | events %.1f | forced %u | draw %.0f%%\n",
+            n / elapsed, telemetrySum.frame_ns / n / 1e6,
+            telemetrySum.frame_cpu_ns / n / 1e6,
+            telemetrySum.boundary_ns / n / 1e6,
+            telemetrySum.audio_mix_ns / n / 1e6,
+            telemetrySum.encode_ns / n / 1e6,
+            telemetrySum.event_queue_length / n,
+            telemetrySum.forced_advances,
+            100.0 * telemetrySum.draw / n);
+
+    telemetryLastDisplay = now;
+    memset(&telemetrySum, 0, sizeof(struct FrameTelemetry));
+    telemetryFrames = 0;
+}
+
+/* Display the histogram of the delays after the frame deadlines
+ * at which the game woke up */
+static void printPacingJitter(void)
+{
+    unsigned int total = 0;
+    for (int b = 0; b < PACING_JITTER_BUCKETS; b++)
+        total += pacingJitterHistogram[b];
+    if (total == 0)
+        return;
+
+    printf("Frame pacing jitter of %u frames:\n", total);
+    for (int b = 0; b < PACING_JITTER_BUCKETS; b++) {
+        if (pacingJitterHistogram[b] == 0)
+            continue;
+        if (b == 0)
+            printf("  [0, 1) us: %u\n", pacingJitterHistogram[b]);
+        else if (b == (PACING_JITTER_BUCKETS - 1))
+            printf("  >= %d us: %u\n", 1 << (b - 1), pacingJitterHistogram[b]);
+        else
+            printf("  [%d, %d) us: %u\n", 1 << (b - 1), 1 << b, pacingJitterHistogram[b]);
+    }
+}
+
+/* Send a string to the game, preceded by its length */
+static void sendString(int socket_fd, const std::string& str)
+{
+    size_t str_size = str.size();
+    send(socket_fd, &str_size, sizeof(size_t), 0);
+    send(socket_fd, str.c_str(), str_size, 0);
+}
+
 static int MyErrorHandler(Display *display, XErrorEvent *theEvent)
 {
     (void) fprintf(stderr,
@@ -69,8 +234,10 @@ int main(int argc, char **argv)
 
     /* Parsing arguments */
     int c;
-    std::string libname, dumpfile;
-    while ((c = getopt (argc, argv, "r:w:d:l:")) != -1)
+    std::string libname, dumpfile, tracefile, logfile;
+    std::string videoencoder, videooptions, audioencoder, audiooptions;
+    std::string rawaudiofile;
+    while ((c = getopt (argc, argv, "r:w:d:l:nt:o:p:m:aq:c:C:k:K:x:Xg:")) != -1)
         switch (c) {
             case 'r':
                 /* Playback movie file */
@@ -92,6 +259,83 @@ int main(int argc, char **argv)
                 libname = optarg;
                 shared_libs.push_back(libname);
                 break;
+            case 'n':
+                /* Keep the game draw calls during fastforward */
+                tasflags.fastforward_skip_draws = 0;
+                break;
+            case 't':
+                /* Trace file */
+                tracefile = optarg;
+                break;
+            case 'o':
+                /* Log file */
+                logfile = optarg;
+                break;
+            case 'p':
+                /* Hook profiling file */
+                profilefp = fopen(optarg, "w");
+                if (!profilefp) {
+                    fprintf(stderr, "Could not open profiling file %s\n", optarg);
+                    return 1;
+                }
+                fprintf(profilefp, "frame,function,thread,main,calls,total_ns,p50_ns,p99_ns\n");
+                tasflags.hook_profiling = 1;
+                break;
+            case 'm':
+                /* Telemetry file */
+                telemetryfp = fopen(optarg, "w");
+                if (!telemetryfp) {
+                    fprintf(stderr, "Could not open telemetry file %s\n", optarg);
+                    return 1;
+                }
+                fprintf(telemetryfp, "frame,frame_ns,frame_cpu_ns,boundary_ns,audio_mix_ns,encode_ns,event_queue_length,forced_advances,draw,paced,pacing_jitter_ns\n");
+                break;
+            case 'a':
+                /* Asynchronous audio mixing */
+                tasflags.async_audio_mix = 1;
+                break;
+            case 'q':
+                /* Audio resampling quality */
+                tasflags.resample_quality = atoi(optarg);
+                break;
+            case 'c':
+                /* Video encoder */
+                videoencoder = optarg;
+                break;
+            case 'C':
+                /* Video encoder options */
+                videooptions = optarg;
+                break;
+            case 'k':
+                /* Audio encoder */
+                audioencoder = optarg;
+                break;
+            case 'K':
+                /* Audio encoder options */
+                audiooptions = optarg;
+                break;
+            case 'x':
+                /* Raw dump, with the audio samples written to this file */
+                if (!tasflags.raw_dumping)
+                    tasflags.raw_dumping = 1;
+                rawaudiofile = optarg;
+                break;
+            case 'X':
+                /* Raw dump with frame headers */
+                tasflags.raw_dumping = 2;
+                break;
+            case 'g':
+                {
+                    /* Frame pacing spin margin, in microseconds */
+                    char* end;
+                    long margin = strtol(optarg, &end, 10);
+                    if ((end == optarg) || (*end != '\0') || (margin < 0) || (margin > 1000000)) {
+                        fprintf(stderr, "The spin margin must be a number of microseconds between 0 and 1000000\n");
+                        return 1;
+                    }
+                    tasflags.pacing_spin_margin = margin;
+                }
+                break;
             case '?':
                 fprintf (stderr, "Unknown option character");
                 break;
@@ -99,6 +343,11 @@ int main(int argc, char **argv)
                 return 1;
         }
 
+    if (tasflags.raw_dumping && (rawaudiofile.empty() || !tasflags.av_dumping)) {
+        fprintf(stderr, "A raw dump needs a dump file with -d and an audio file with -x\n");
+        return 1;
+    }
+
     const struct sockaddr_un addr = { AF_UNIX, SOCKET_FILENAME };
     int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
 
@@ -161,6 +410,45 @@ int main(int argc, char **argv)
         size_t dumpfile_size = dumpfile.size();
         send(socket_fd, &dumpfile_size, sizeof(size_t), 0);
         send(socket_fd, dumpfile.c_str(), dumpfile_size, 0);
+
+        /* Send the encoders and their options */
+        if (!videoencoder.empty() || !videooptions.empty()) {
+            message = MSGN_VIDEO_ENCODER;
+            send(socket_fd, &message, sizeof(int), 0);
+            sendString(socket_fd, videoencoder);
+            sendString(socket_fd, videooptions);
+        }
+        if (!audioencoder.empty() || !audiooptions.empty()) {
+            message = MSGN_AUDIO_ENCODER;
+            send(socket_fd, &message, sizeof(int), 0);
+            sendString(socket_fd, audioencoder);
+            sendString(socket_fd, audiooptions);
+        }
+
+        /* Send the file of the raw audio samples */
+        if (tasflags.raw_dumping) {
+            message = MSGN_RAW_AUDIO_FILE;
+            send(socket_fd, &message, sizeof(int), 0);
+            sendString(socket_fd, rawaudiofile);
+        }
+    }
+
+    /* Send trace file */
+    if (!tracefile.empty()) {
+        message = MSGN_TRACE_FILE;
+        send(socket_fd, &message, sizeof(int), 0);
+        size_t tracefile_size = tracefile.size();
+        send(socket_fd, &tracefile_size, sizeof(size_t), 0);
+        send(socket_fd, tracefile.c_str(), tracefile_size, 0);
+    }
+
+    /* Send log file */
+    if (!logfile.empty()) {
+        message = MSGN_LOG_FILE;
+        send(socket_fd, &message, sizeof(int), 0);
+        size_t logfile_size = logfile.size();
+        send(socket_fd, &logfile_size, sizeof(size_t), 0);
+        send(socket_fd, logfile.c_str(), logfile_size, 0);
     }
 
     /* Send shared library names */
@@ -228,6 +516,25 @@ int main(int argc, char **argv)
             recv(socket_fd, &message, sizeof(int), 0);
         }
 
+        /* Messages sent just before the frame boundary */
+        std::vector<struct HookProfileEntry> profile;
+        struct FrameTelemetry telemetry;
+        int hastelemetry = 0;
+        while ((message == MSGB_HOOK_PROFILE) || (message == MSGB_FRAME_TELEMETRY)) {
+            if (message == MSGB_HOOK_PROFILE) {
+                int n_entries;
+                recv(socket_fd, &n_entries, sizeof(int), MSG_WAITALL);
+                profile.resize(n_entries);
+                if (n_entries > 0)
+                    recv(socket_fd, profile.data(), n_entries * sizeof(struct HookProfileEntry), MSG_WAITALL);
+            }
+            else {
+                recv(socket_fd, &telemetry, sizeof(struct FrameTelemetry), MSG_WAITALL);
+                hastelemetry = 1;
+            }
+            recv(socket_fd, &message, sizeof(int), 0);
+        }
+
         if (message != MSGB_START_FRAMEBOUNDARY) {
             printf("Error in msg socket, waiting for frame boundary\n");
             exit(1);
@@ -235,6 +542,12 @@ int main(int argc, char **argv)
                    
         recv(socket_fd, &frame_counter, sizeof(unsigned long), 0);
 
+        if (profilefp)
+            writeHookProfile(frame_counter, profile);
+
+        if (hastelemetry)
+            updateTelemetry(&telemetry);
+
 
         int isidle = !tasflags.running;
         int tasflagsmod = 0; // register if tasflags have been modified on this frame
@@ -303,6 +616,14 @@ int main(int argc, char **argv)
                     }
                     if (ks == hotkeys[HOTKEY_LOADSTATE]){
                     }
+                    if (ks == hotkeys[HOTKEY_SLOWDOWN]){
+                        setSpeedLevel(speed_level - 1);
+                        tasflagsmod = 1;
+                    }
+                    if (ks == hotkeys[HOTKEY_SPEEDUP]){
+                        setSpeedLevel(speed_level + 1);
+                        tasflagsmod = 1;
+                    }
                     if (ks == hotkeys[HOTKEY_READWRITE]){
                         /* TODO: Use enum instead of values */
                         if (tasflags.recording >= 0)
@@ -428,6 +749,11 @@ int main(int argc, char **argv)
 
     //if (didSave)
         //deallocState(&savestate);
+    printPacingJitter();
+    if (profilefp)
+        fclose(profilefp);
+    if (telemetryfp)
+        fclose(telemetryfp);
     if (tasflags.recording >= 0){
         closeRecording(fp);
     }
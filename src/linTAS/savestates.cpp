@@ -109,7 +109,7 @@ read_mapping (FILE *mapfile,
     sscanf (linestring," %s", device);
     linestring += 6; // Skip the device
 
-    *inode = strtoull(linestring, &linestring, 16);
+    *inode = strtoull(linestring, &linestring, 10);
 
     if (*inode != 0)
     {
@@ -125,19 +125,247 @@ read_mapping (FILE *mapfile,
     return 1;
 }
 
+/* Flags of a /proc/pid/pagemap entry */
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_SWAPPED (1ULL << 62)
+#define PAGEMAP_FILE    (1ULL << 61)
+
+/* Maximum number of iovec structures accepted by process_vm_readv/writev */
+#define MAX_IOV 1024
+
+/* Size of the chunks used when restoring zero pages or file content */
+#define RESTORE_CHUNK (1024*1024)
+
+/*
+ * Read the pagemap entries of n_pages pages starting at addr.
+ * Returns 1 on success, 0 if the pagemap could not be read.
+ */
+static int read_pagemap(int pagemapfd, unsigned long long int addr, size_t pagesize,
+        size_t n_pages, uint64_t* entries)
+{
+    if (pagemapfd < 0)
+        return 0;
+
+    char* buf = (char*) entries;
+    size_t toread = n_pages * sizeof(uint64_t);
+    off_t pos = (addr / pagesize) * sizeof(uint64_t);
+    while (toread > 0) {
+        ssize_t nread = pread(pagemapfd, buf, toread, pos);
+        if (nread <= 0)
+            return 0;
+        buf += nread;
+        toread -= nread;
+        pos += nread;
+    }
+    return 1;
+}
+
+/* Was the page ever populated (it may be swapped out now) */
+static int page_populated(uint64_t entry)
+{
+    return (entry & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) != 0;
+}
+
+/* Is the page of a private file mapping still mapping the page cache,
+ * meaning it was never written and still holds the file content */
+static int page_unmodified_file(uint64_t entry)
+{
+    return (entry & PAGEMAP_PRESENT) && (entry & PAGEMAP_FILE);
+}
+
+static int is_zero_page(const char* page, size_t pagesize)
+{
+    const uint64_t* words = (const uint64_t*) page;
+    for (size_t w = 0; w < pagesize / sizeof(uint64_t); w++)
+        if (words[w])
+            return 0;
+    return 1;
+}
+
+/* Get the size and modification time of the file mapped by a section.
+ * Returns 1 on success, 0 if the file cannot be accessed or is not the
+ * mapped file anymore */
+static int stat_mapped_file(const struct StateSection* section, long long int* size,
+        struct timespec* mtime)
+{
+    struct stat st;
+    if (stat(section->filename, &st) != 0)
+        return 0;
+    if (st.st_ino != section->inode)
+        return 0;
+    *size = st.st_size;
+    *mtime = st.st_mtim;
+    return 1;
+}
+
+/* Return if the savestate policy tells us to skip this section */
+static int policy_skips(const struct SavePolicy* policy, const char* filename)
+{
+    if (policy == NULL)
+        return 0;
+
+    for (int r = 0; r < policy->n_rules; r++) {
+        if (strstr(filename, policy->rules[r].pattern) != NULL)
+            return !policy->rules[r].include;
+    }
+    return 0;
+}
+
+static void print_vm_error(const char* action)
+{
+    switch (errno) {
+        case EINVAL:
+            fprintf(stderr, "The amount of bytes %s is too big!\n", action);
+            break;
+        case EFAULT:
+            fprintf(stderr, "Bad address space of the game process or own process!\n");
+            break;
+        case ENOMEM:
+            fprintf(stderr, "Could not allocate memory for internal copies of the iovec structures.\n");
+            break;
+        case EPERM:
+            fprintf(stderr, "Do not have permission to access the game process memory.\n");
+            break;
+        case ESRCH:
+            fprintf(stderr, "The game PID does not exist.\n");
+            break;
+    }
+}
+
+int loadSavePolicy(const char* policyfile, struct SavePolicy* policy)
+{
+    policy->n_rules = 0;
+    policy->rules = NULL;
+
+    FILE* file = fopen(policyfile, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open savestate policy %s\n", policyfile);
+        return 0;
+    }
+
+    char line[2048];
+    int lineno = 0;
+    while (fgets(line, 2048, file) != NULL) {
+        lineno++;
+
+        /* Strip the end of line */
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if ((line[0] == '\0') || (line[0] == '#'))
+            continue;
+
+        int include;
+        const char* pattern;
+        if (strncmp(line, "include ", 8) == 0) {
+            include = 1;
+            pattern = line + 8;
+        }
+        else if (strncmp(line, "exclude ", 8) == 0) {
+            include = 0;
+            pattern = line + 8;
+        }
+        else {
+            fprintf(stderr, "Savestate policy line %d: unknown rule\n", lineno);
+            continue;
+        }
+
+        struct SavePolicyRule* rules_realloc = (struct SavePolicyRule*) realloc(policy->rules, (policy->n_rules + 1) * sizeof(struct SavePolicyRule));
+        if (rules_realloc == NULL) {
+            fprintf(stderr, "Realloc failed\n");
+            fclose(file);
+            deallocSavePolicy(policy);
+            return 0;
+        }
+        policy->rules = rules_realloc;
+        policy->rules[policy->n_rules].include = include;
+        policy->rules[policy->n_rules].pattern = strdup(pattern);
+        policy->n_rules++;
+    }
+
+    fclose(file);
+    return 1;
+}
+
+void deallocSavePolicy(struct SavePolicy* policy)
+{
+    for (int r = 0; r < policy->n_rules; r++)
+        free(policy->rules[r].pattern);
+    free(policy->rules);
+    policy->rules = NULL;
+    policy->n_rules = 0;
+}
+
+/*
+ * Read the pages of a section flagged as PAGE_SAVED into its mem array.
+ * Contiguous pages are merged into a single remote iovec.
+ * Returns 1 on success, 0 on error.
+ */
+static int read_section_pages(pid_t game_pid, struct StateSection* section,
+        size_t pagesize, size_t n_pages)
+{
+    struct iovec local;
+    struct iovec remote[MAX_IOV];
+    int n_remote = 0;
+    size_t batch_size = 0;
+    char* dst = section->mem;
+
+    for (size_t p = 0; p <= n_pages; p++) {
+        int saved = (p < n_pages) && (section->pageflags[p] == PAGE_SAVED);
+
+        if (saved) {
+            char* pageaddr = (char*)(section->addr + p * pagesize);
+            if ((n_remote > 0) && ((char*)remote[n_remote-1].iov_base + remote[n_remote-1].iov_len == pageaddr)) {
+                remote[n_remote-1].iov_len += pagesize;
+            }
+            else {
+                remote[n_remote].iov_base = pageaddr;
+                remote[n_remote].iov_len = pagesize;
+                n_remote++;
+            }
+            batch_size += pagesize;
+        }
+
+        /* Flush the batch when we are out of iovecs or at the end */
+        if ((n_remote == MAX_IOV) || ((p == n_pages) && (n_remote > 0))) {
+            local.iov_base = dst;
+            local.iov_len = batch_size;
+            ssize_t nread = process_vm_readv(game_pid, &local, 1, remote, n_remote, 0);
+            if (nread != (ssize_t)batch_size) {
+                fprintf(stderr, "Not all memory was read! Only %zd\n", nread);
+                if (nread == -1)
+                    print_vm_error("read");
+                return 0;
+            }
+            dst += batch_size;
+            batch_size = 0;
+            n_remote = 0;
+        }
+    }
+
+    return 1;
+}
+
 /*
  * Access and save all memory regions of the game process that are writable.
+ * Pages that were never populated, or pages of private file mappings that
+ * still hold the file content, are not saved. Pages containing only zeros
+ * are only stored as a flag.
  * Code originally taken from GDB
  */
 
-void saveState(pid_t game_pid, struct State* state)
+void saveState(pid_t game_pid, struct State* state, const struct SavePolicy* policy)
 {
     char mapsfilename[2048];
     FILE *mapsfile;
     unsigned long long int addr, endaddr, size, offset, inode;
     char permissions[8], device[8], filename[2048];
-    int readflag, writeflag, execflag;
+    int readflag, writeflag, execflag, sharedflag;
     int haserror = 0;
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+
+    state->n_sections = 0;
+    state->total_size = 0;
+    state->sections = NULL;
 
     /* Attach to the game process */
     /* 
@@ -154,6 +382,15 @@ void saveState(pid_t game_pid, struct State* state)
         return;
     }
 
+    /* The pagemap tells us which pages are populated. If we cannot access it,
+     * we fall back to saving every page. */
+    char pagemapfilename[2048];
+    sprintf (pagemapfilename, "/proc/%d/pagemap", game_pid);
+    int pagemapfd = open(pagemapfilename, O_RDONLY);
+    if (pagemapfd < 0) {
+        fprintf(stderr, "Could not open %s, saving all pages\n", pagemapfilename);
+    }
+
     /* Count how many lines in maps file to allocate the state */
     int n_sections = 0;
     for (int c = fgetc(mapsfile); c != EOF; c = fgetc(mapsfile)) {
@@ -164,13 +401,11 @@ void saveState(pid_t game_pid, struct State* state)
     /* Allocate the state */
     state->sections = (struct StateSection*) malloc(n_sections * sizeof(struct StateSection));
 
-    /* Allocate the structures to prepare the memory read */
-    struct iovec* local = (struct iovec*) malloc(n_sections * sizeof(struct iovec));
-    struct iovec* remote = (struct iovec*) malloc(n_sections * sizeof(struct iovec));
-
     /* Now iterate until end-of-file. */
     int section_i = 0;
     unsigned long long int total_size = 0;
+    unsigned long long int saved_size = 0;
+    size_t n_unsaved_pages = 0, n_zero_pages = 0;
 
     while (read_mapping (mapsfile, &addr, &endaddr, &permissions[0], 
                 &offset, &device[0], &inode, &filename[0]))
@@ -181,6 +416,7 @@ void saveState(pid_t game_pid, struct State* state)
         readflag  = (strchr (permissions, 'r') != 0);
         writeflag = (strchr (permissions, 'w') != 0);
         execflag  = (strchr (permissions, 'x') != 0);
+        sharedflag = (strchr (permissions, 's') != 0);
 
         
         fprintf(stderr, 
@@ -206,85 +442,139 @@ void saveState(pid_t game_pid, struct State* state)
 
 
         /* Fill the information on the section */
-        state->sections[section_i].addr = addr;
-        state->sections[section_i].endaddr = endaddr;
-        state->sections[section_i].readflag = readflag;
-        state->sections[section_i].writeflag = writeflag;
-        state->sections[section_i].execflag = execflag;
-        state->sections[section_i].offset = offset;
-        strncpy(state->sections[section_i].device, device, 8);
-        state->sections[section_i].inode = inode;
+        struct StateSection* section = &state->sections[section_i];
+        section->addr = addr;
+        section->endaddr = endaddr;
+        section->readflag = readflag;
+        section->writeflag = writeflag;
+        section->execflag = execflag;
+        section->sharedflag = sharedflag;
+        section->offset = offset;
+        strncpy(section->device, device, 8);
+        section->inode = inode;
+        section->skipped = 0;
+        section->pageflags = NULL;
+        section->mem = NULL;
         size_t filename_size = strnlen(filename, 2048);
-        state->sections[section_i].filename = (char*) malloc((filename_size + 1) * sizeof(char));
-        if (state->sections[section_i].filename == NULL) {
+        section->filename = (char*) malloc((filename_size + 1) * sizeof(char));
+        if (section->filename == NULL) {
             fprintf(stderr, "Cound not alloc memory for filename\n");
             haserror = 1;
             break;
         }
-        memcpy(state->sections[section_i].filename, filename, filename_size);
-        state->sections[section_i].filename[filename_size] = '\0';
+        memcpy(section->filename, filename, filename_size);
+        section->filename[filename_size] = '\0';
+        section_i++;
+
+        int isfile = inode && !sharedflag && filename[0];
+        section->filechecked = isfile && stat_mapped_file(section, &section->filesize, &section->filemtime);
+
+        /* Check if the section must be skipped. We still keep it in the
+         * state so that loading does not complain about a missing section. */
+        if (policy_skips(policy, section->filename)) {
+            fprintf(stderr, "Segment skipped by the savestate policy\n");
+            section->skipped = 1;
+            continue;
+        }
+
+        total_size += size;
+
+        size_t n_pages = size / pagesize;
+        section->pageflags = (char*) malloc(n_pages * sizeof(char));
+        uint64_t* entries = (uint64_t*) malloc(n_pages * sizeof(uint64_t));
+        if ((section->pageflags == NULL) || (entries == NULL)) {
+            fprintf(stderr, "Cound not alloc memory for the page flags\n");
+            free(entries);
+            haserror = 1;
+            break;
+        }
+
+        /* 
+         * Decide which pages we must read. Shared mappings may have content
+         * that is not mapped in the game process, so we save all their pages.
+         * Pages of a private file mapping are restored from the file, so we
+         * also save all of them if we cannot check later that it is unchanged.
+         */
+        int use_pagemap = !sharedflag && (!isfile || section->filechecked) &&
+            read_pagemap(pagemapfd, addr, pagesize, n_pages, entries);
+        size_t n_saved = 0;
+        for (size_t p = 0; p < n_pages; p++) {
+            if (use_pagemap && !page_populated(entries[p]))
+                section->pageflags[p] = PAGE_UNSAVED;
+            else if (use_pagemap && isfile && page_unmodified_file(entries[p]))
+                section->pageflags[p] = PAGE_UNSAVED;
+            else {
+                section->pageflags[p] = PAGE_SAVED;
+                n_saved++;
+            }
+        }
+        free(entries);
+        n_unsaved_pages += n_pages - n_saved;
+
+        if (n_saved == 0)
+            continue;
 
         /* Allocate actual memory section */
-        state->sections[section_i].mem = (char*) malloc(size * sizeof(char));
-        if (state->sections[section_i].mem == NULL) {
-            fprintf(stderr, "Cound not alloc memory of size %lld for mem\n", size);
+        section->mem = (char*) malloc(n_saved * pagesize);
+        if (section->mem == NULL) {
+            fprintf(stderr, "Cound not alloc memory of size %zu for mem\n", n_saved * pagesize);
             haserror = 1;
             break;
         }
 
-        /* Prepare the structures for the read call */
-        local[section_i].iov_base = state->sections[section_i].mem;
-        local[section_i].iov_len = size;
-        remote[section_i].iov_base = (void *) addr;
-        remote[section_i].iov_len = size;
+        if (!read_section_pages(game_pid, section, pagesize, n_pages)) {
+            /* Some mappings (e.g. device mappings) cannot be read, skip them */
+            fprintf(stderr, "Could not read the segment, skipping it\n");
+            free(section->mem);
+            free(section->pageflags);
+            section->mem = NULL;
+            section->pageflags = NULL;
+            section->skipped = 1;
+            continue;
+        }
 
-        total_size += size;
+        /* Flag the zero pages and compact the remaining ones */
+        char* src = section->mem;
+        char* dst = section->mem;
+        for (size_t p = 0; p < n_pages; p++) {
+            if (section->pageflags[p] != PAGE_SAVED)
+                continue;
+            if (is_zero_page(src, pagesize)) {
+                section->pageflags[p] = PAGE_ZERO;
+                n_zero_pages++;
+            }
+            else {
+                if (dst != src)
+                    memmove(dst, src, pagesize);
+                dst += pagesize;
+            }
+            src += pagesize;
+        }
 
-        section_i++;
+        size_t mem_size = dst - section->mem;
+        if (mem_size == 0) {
+            free(section->mem);
+            section->mem = NULL;
+        }
+        else if (mem_size < n_saved * pagesize) {
+            char* mem_realloc = (char*) realloc(section->mem, mem_size);
+            if (mem_realloc != NULL)
+                section->mem = mem_realloc;
+        }
+        saved_size += mem_size;
     }
 
+    if (pagemapfd >= 0)
+        close(pagemapfd);
+    fclose(mapsfile);
+
     /* 
      * TODO: deallocating each resource for each error does not seem optimal
      * How to do it better?
      */
     if (haserror) {
-        free(local);
-        free(remote);
-        fclose(mapsfile);
-        detachToGame(game_pid);
-        return;
-    }
-
-    /* Now, making all the reads in one call */
-    fprintf(stderr, "Saving the actual memory, %lld bytes\n", total_size);
-    ssize_t nread = process_vm_readv(game_pid, local, section_i, remote, section_i, 0);
-
-    /* Checking for errors */
-    if (nread != (ssize_t)total_size) {
-        fprintf(stderr, "Not all memory was read! Only %zd\n", nread);
-    }
-
-    if (nread == -1) {
-        switch (errno) {
-            case EINVAL:
-                fprintf(stderr, "The amount of bytes read is too big!\n");
-                break;
-            case EFAULT:
-                fprintf(stderr, "Bad address space of the game process or own process!\n");
-                break;
-            case ENOMEM:
-                fprintf(stderr, "Could not allocate memory for internal copies of the iovec structures.\n");
-                break;
-            case EPERM:
-                fprintf(stderr, "Do not have permission to read the game process memory.\n");
-                break;
-            case ESRCH:
-                fprintf(stderr, "The game PID does not exist.\n");
-                break;
-        }
-        free(local);
-        free(remote);
-        fclose(mapsfile);
+        state->n_sections = section_i;
+        deallocState(state);
         detachToGame(game_pid);
         return;
     }
@@ -298,9 +588,7 @@ void saveState(pid_t game_pid, struct State* state)
     if (section_i == 0) {
         fprintf(stderr, "After filtering, no section are saved!\n");
         free(state->sections);
-        free(local);
-        free(remote);
-        fclose(mapsfile);
+        state->sections = NULL;
         detachToGame(game_pid);
         return;
     }
@@ -308,10 +596,8 @@ void saveState(pid_t game_pid, struct State* state)
     struct StateSection* sections_realloc = (struct StateSection*) realloc(state->sections, section_i * sizeof(struct StateSection));
     if (sections_realloc == NULL) {
         fprintf(stderr, "Realloc failed\n");
-        free(state->sections);
-        free(local);
-        free(remote);
-        fclose(mapsfile);
+        state->n_sections = section_i;
+        deallocState(state);
         detachToGame(game_pid);
         return;
     }
@@ -320,17 +606,205 @@ void saveState(pid_t game_pid, struct State* state)
         state->n_sections = section_i;
     }
 
-    fprintf(stderr, "Wow, we actually did not raise any error. Saved %zd bytes out of %lld\n", nread, total_size);
-    state->total_size = nread;
-
-    free(local);
-    free(remote);
-    fclose(mapsfile);
+    fprintf(stderr, "Saved %lld bytes out of %lld (%zu unpopulated or unmodified file pages, %zu zero pages)\n",
+            saved_size, total_size, n_unsaved_pages, n_zero_pages);
+    state->total_size = saved_size;
 
     /* Detach from the game process */
     detachToGame(game_pid);
 }
 
+/* Buffers used to restore the zero pages and the file content.
+ * They are allocated when first needed, and freed at the end of a load. */
+struct RestoreBuffers {
+    char* zeros;
+    char* file;
+};
+
+/* Write size bytes of zeros at address addr of the game process */
+static ssize_t write_zeros(pid_t game_pid, struct RestoreBuffers* buffers,
+        unsigned long long int addr, size_t size)
+{
+    if (buffers->zeros == NULL) {
+        buffers->zeros = (char*) calloc(RESTORE_CHUNK, sizeof(char));
+        if (buffers->zeros == NULL)
+            return -1;
+    }
+    char* zeros = buffers->zeros;
+
+    size_t written = 0;
+    while (written < size) {
+        size_t len = (size - written) < RESTORE_CHUNK ? (size - written) : RESTORE_CHUNK;
+        struct iovec local = {zeros, len};
+        struct iovec remote = {(void*)(addr + written), len};
+        ssize_t nwrite = process_vm_writev(game_pid, &local, 1, &remote, 1, 0);
+        if (nwrite != (ssize_t)len)
+            return -1;
+        written += len;
+    }
+    return written;
+}
+
+/* Write back the content of the file backing a section, for size bytes at addr */
+static ssize_t write_file_content(pid_t game_pid, struct RestoreBuffers* buffers, int filefd,
+        struct StateSection* section, unsigned long long int addr, size_t size)
+{
+    if (buffers->file == NULL) {
+        buffers->file = (char*) malloc(RESTORE_CHUNK);
+        if (buffers->file == NULL)
+            return -1;
+    }
+    char* buf = buffers->file;
+
+    size_t written = 0;
+    while (written < size) {
+        size_t len = (size - written) < RESTORE_CHUNK ? (size - written) : RESTORE_CHUNK;
+        off_t pos = section->offset + (addr + written - section->addr);
+        ssize_t nread = pread(filefd, buf, len, pos);
+        if (nread < 0)
+            return -1;
+
+        /* Past the end of the file, the mapping is filled with zeros */
+        memset(buf + nread, 0, len - nread);
+
+        struct iovec local = {buf, len};
+        struct iovec remote = {(void*)(addr + written), len};
+        ssize_t nwrite = process_vm_writev(game_pid, &local, 1, &remote, 1, 0);
+        if (nwrite != (ssize_t)len)
+            return -1;
+        written += len;
+    }
+    return written;
+}
+
+/* What we have to do to restore a single page */
+enum PageAction {
+    ACTION_NONE,
+    ACTION_MEM,
+    ACTION_ZERO,
+    ACTION_FILE
+};
+
+/*
+ * Restore a section of the game memory.
+ * entries holds the current pagemap of the section, or NULL if unknown.
+ * Returns the number of bytes written.
+ */
+static unsigned long long int load_section(pid_t game_pid, struct StateSection* section,
+        size_t pagesize, const uint64_t* entries, struct RestoreBuffers* buffers)
+{
+    size_t n_pages = (section->endaddr - section->addr) / pagesize;
+    unsigned long long int loaded = 0;
+
+    /* First, write all saved pages. They are stored contiguously in mem */
+    struct iovec local;
+    struct iovec remote[MAX_IOV];
+    int n_remote = 0;
+    size_t batch_size = 0;
+    char* src = section->mem;
+
+    for (size_t p = 0; p <= n_pages; p++) {
+        if ((p < n_pages) && (section->pageflags[p] == PAGE_SAVED)) {
+            char* pageaddr = (char*)(section->addr + p * pagesize);
+            if ((n_remote > 0) && ((char*)remote[n_remote-1].iov_base + remote[n_remote-1].iov_len == pageaddr)) {
+                remote[n_remote-1].iov_len += pagesize;
+            }
+            else {
+                remote[n_remote].iov_base = pageaddr;
+                remote[n_remote].iov_len = pagesize;
+                n_remote++;
+            }
+            batch_size += pagesize;
+        }
+
+        if ((n_remote == MAX_IOV) || ((p == n_pages) && (n_remote > 0))) {
+            local.iov_base = src;
+            local.iov_len = batch_size;
+            ssize_t nwrite = process_vm_writev(game_pid, &local, 1, remote, n_remote, 0);
+            if (nwrite != (ssize_t)batch_size) {
+                fprintf(stderr, "Not all memory was written! Only %zd\n", nwrite);
+                if (nwrite == -1)
+                    print_vm_error("written");
+            }
+            else {
+                loaded += batch_size;
+            }
+            src += batch_size;
+            batch_size = 0;
+            n_remote = 0;
+        }
+    }
+
+    /* Then, restore the zero pages and the pages that were not saved,
+     * merging contiguous pages with the same action. */
+    int filefd = -1;
+    int isfile = section->inode && !section->sharedflag && section->filename[0];
+    size_t run_start = 0;
+    enum PageAction run_action = ACTION_NONE;
+
+    for (size_t p = 0; p <= n_pages; p++) {
+        enum PageAction action = ACTION_NONE;
+
+        if (p < n_pages) {
+            int populated = (entries == NULL) || page_populated(entries[p]);
+            switch (section->pageflags[p]) {
+                case PAGE_SAVED:
+                    break;
+                case PAGE_ZERO:
+                    /* An unpopulated anonymous page is already zero */
+                    if (populated || isfile)
+                        action = ACTION_ZERO;
+                    break;
+                case PAGE_UNSAVED:
+                    /* The page is still unpopulated, so it is still
+                     * the zero page or the file content */
+                    if (!populated)
+                        break;
+                    if (!isfile)
+                        action = ACTION_ZERO;
+                    else if ((entries == NULL) || !page_unmodified_file(entries[p]))
+                        action = ACTION_FILE;
+                    break;
+            }
+        }
+
+        if ((p < n_pages) && (action == run_action))
+            continue;
+
+        /* Process the previous run */
+        if (run_action != ACTION_NONE) {
+            unsigned long long int run_addr = section->addr + run_start * pagesize;
+            size_t run_size = (p - run_start) * pagesize;
+            ssize_t nwrite = -1;
+
+            if (run_action == ACTION_ZERO) {
+                nwrite = write_zeros(game_pid, buffers, run_addr, run_size);
+            }
+            else {
+                if (filefd < 0)
+                    filefd = open(section->filename, O_RDONLY);
+                if (filefd < 0)
+                    fprintf(stderr, "Could not open %s to restore its content\n", section->filename);
+                else
+                    nwrite = write_file_content(game_pid, buffers, filefd, section, run_addr, run_size);
+            }
+
+            if (nwrite == -1)
+                fprintf(stderr, "Could not restore %zu bytes at 0x%llx\n", run_size, run_addr);
+            else
+                loaded += run_size;
+        }
+
+        run_start = p;
+        run_action = action;
+    }
+
+    if (filefd >= 0)
+        close(filefd);
+
+    return loaded;
+}
+
 void loadState(pid_t game_pid, struct State* state)
 {
     /* Some duplicate code of saveState, factorize it? */
@@ -340,6 +814,7 @@ void loadState(pid_t game_pid, struct State* state)
     unsigned long long int addr, endaddr, size, offset, inode;
     char permissions[8], device[8], filename[2048];
     int readflag, writeflag, execflag;
+    size_t pagesize = sysconf(_SC_PAGESIZE);
 
     /* Attach to the game process */
     attachToGame(game_pid);
@@ -352,34 +827,20 @@ void loadState(pid_t game_pid, struct State* state)
         return;
     }
 
-    /* Count how many lines in maps file to allocate the state */
-    int n_sections = 0;
-    for (int c = fgetc(mapsfile); c != EOF; c = fgetc(mapsfile)) {
-        if (c == '\n') n_sections++;
-    }
-    rewind(mapsfile);
-
-    /* 
-     * Allocate the structures to prepare the memory read
-     * As opposed to memory read, we are doing writes one at a time,
-     * so that we can give more information on the first write error
-     */
-    struct iovec* local = (struct iovec*) malloc(sizeof(struct iovec));
-    struct iovec* remote = (struct iovec*) malloc(sizeof(struct iovec));
+    /* The current pagemap tells us which unsaved pages were modified since
+     * the state was saved. Without it, we restore all of them. */
+    char pagemapfilename[2048];
+    sprintf (pagemapfilename, "/proc/%d/pagemap", game_pid);
+    int pagemapfd = open(pagemapfilename, O_RDONLY);
 
     /* Now iterate until end-of-file. */
     unsigned long long int total_size_loaded = 0;
     int section_i = 0;
+    struct RestoreBuffers buffers = {NULL, NULL};
 
     while (read_mapping (mapsfile, &addr, &endaddr, &permissions[0], 
                 &offset, &device[0], &inode, &filename[0]))
     {
-        /* Check if we reached the end of saved memory early */
-        if (total_size_loaded >= state->total_size) {
-            break;
-        }
-        
-
         size = endaddr - addr;
 
         /* Get the segment's permissions.  */
@@ -400,7 +861,7 @@ void loadState(pid_t game_pid, struct State* state)
            
 
         /* If we cannot write to the section, skip it */
-        if (!writeflag)
+        if (!readflag || !writeflag)
             continue;
 
         /* Find a match section in the savestate */
@@ -420,55 +881,36 @@ void loadState(pid_t game_pid, struct State* state)
             continue;
         }
 
-        /* Match found, preparing the write */
-
-        local[0].iov_base = state->sections[si].mem;
-        local[0].iov_len = size;
-        remote[0].iov_base = (void *) addr;
-        remote[0].iov_len = size;
-
-        /* Now, writing the section to the game process */
-        ssize_t nread = process_vm_writev(game_pid, local, 1, remote, 1, 0);
-
-        /* Checking for errors */
-        if (nread != (ssize_t)size) {
-            fprintf(stderr, "Not all memory was written! Only %zd\n", nread);
-            fprintf(stderr, 
-                    "Current segment has %lld bytes at 0x%llx (%c%c%c)", 
-                    size, addr, 
-                    readflag  ? 'r' : '-', 
-                    writeflag ? 'w' : '-',
-                    execflag  ? 'x' : '-');
-            if (filename[0])
-                fprintf(stderr, " for %s", filename);
-            fprintf(stderr, "\n");
-            fprintf(stderr, "Continue loading the state...\n");
+        section_i++;
+
+        /* Section was not saved */
+        if (state->sections[si].skipped)
+            continue;
+
+        /* Unsaved pages of a file mapping hold the file content */
+        if (state->sections[si].filechecked) {
+            long long int filesize;
+            struct timespec filemtime;
+            if (!stat_mapped_file(&state->sections[si], &filesize, &filemtime) ||
+                    (filesize != state->sections[si].filesize) ||
+                    (filemtime.tv_sec != state->sections[si].filemtime.tv_sec) ||
+                    (filemtime.tv_nsec != state->sections[si].filemtime.tv_nsec))
+                fprintf(stderr, "%s was modified since the state was saved, its unsaved pages cannot be restored!\n", state->sections[si].filename);
         }
 
-        if (nread == -1) {
-            switch (errno) {
-                case EINVAL:
-                    fprintf(stderr, "The amount of bytes read is too big!\n");
-                    break;
-                case EFAULT:
-                    fprintf(stderr, "Bad address space of the game process or own process!\n");
-                    break;
-                case ENOMEM:
-                    fprintf(stderr, "Could not allocate memory for internal copies of the iovec structures.\n");
-                    break;
-                case EPERM:
-                    fprintf(stderr, "Do not have permission to write the game process memory.\n");
-                    break;
-                case ESRCH:
-                    fprintf(stderr, "The game PID does not exist.\n");
-                    break;
+        /* Match found, getting the current state of the pages */
+        size_t n_pages = size / pagesize;
+        uint64_t* entries = NULL;
+        if (!state->sections[si].sharedflag) {
+            entries = (uint64_t*) malloc(n_pages * sizeof(uint64_t));
+            if ((entries != NULL) && !read_pagemap(pagemapfd, addr, pagesize, n_pages, entries)) {
+                free(entries);
+                entries = NULL;
             }
         }
 
-        if (nread >= 0)
-            total_size_loaded += size;
-
-        section_i++;
+        total_size_loaded += load_section(game_pid, &state->sections[si], pagesize, entries, &buffers);
+        free(entries);
     }
 
     /* Test the number of sections */
@@ -478,8 +920,11 @@ void loadState(pid_t game_pid, struct State* state)
 
     fprintf(stderr, "This is the end, loaded %lld bytes.\n", total_size_loaded);
 
-    free(local);
-    free(remote);
+    free(buffers.zeros);
+    free(buffers.file);
+
+    if (pagemapfd >= 0)
+        close(pagemapfd);
     fclose(mapsfile);
 
     /* Detach from the game process */
@@ -492,7 +937,10 @@ void deallocState(struct State* state)
     int si = 0;
     for (si=0; si<state->n_sections; si++) {
         free(state->sections[si].filename);
+        free(state->sections[si].pageflags);
         free(state->sections[si].mem);
     }
     free(state->sections);
+    state->sections = NULL;
+    state->n_sections = 0;
 }
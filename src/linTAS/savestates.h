@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <sys/uio.h>
+#include <sys/stat.h>
 
 /* Store a section of the game memory */
 struct StateSection {
@@ -40,15 +41,42 @@ struct StateSection {
     int readflag;
     int writeflag;
     int execflag;
+    int sharedflag;
     unsigned long long int offset;
     char device[8];
     unsigned long long int inode;
     char* filename;
 
-    /* The actual memory inside this section */
+    /* Section was skipped by the savestate policy or could not be read */
+    int skipped;
+
+    /* Size and modification time of the mapped file when the state was
+     * saved. Pages of a private file mapping are only left unsaved when
+     * they are known, so that we can tell if the file changed before
+     * the state is loaded. */
+    int filechecked;
+    long long int filesize;
+    struct timespec filemtime;
+
+    /* One flag per page of the section, see PageFlag */
+    char* pageflags;
+
+    /* The actual memory inside this section. Only pages flagged
+     * as PAGE_SAVED are stored, in order. */
     char* mem;
 };
 
+/* How a single page of a section was saved */
+enum PageFlag {
+    /* Page was not populated (or was an unmodified page of a private file
+     * mapping), so its content is the zero page or the file content */
+    PAGE_UNSAVED = 0,
+    /* Page was populated but only contained zeros */
+    PAGE_ZERO = 1,
+    /* Page content is stored in mem */
+    PAGE_SAVED = 2
+};
+
 /* Store the full game memory */
 struct State {
     /* Meta data */
@@ -60,6 +88,20 @@ struct State {
     struct StateSection* sections;
 };
 
+/* A rule of the savestate policy. Sections whose filename contains
+ * the pattern are saved (include) or skipped (exclude) */
+struct SavePolicyRule {
+    int include;
+    char* pattern;
+};
+
+/* Per-game list of rules deciding which sections are saved.
+ * The first matching rule wins, sections matching no rule are saved. */
+struct SavePolicy {
+    int n_rules;
+    struct SavePolicyRule* rules;
+};
+
 
 void attachToGame(pid_t game_pid);
 void detachToGame(pid_t game_pid);
@@ -73,7 +115,14 @@ read_mapping (FILE *mapfile,
           unsigned long long int *inode, 
           char *filename);
 
-void saveState(pid_t game_pid, struct State* state);
+/* Load the savestate policy from a file. Each line is either
+ * `include PATTERN` or `exclude PATTERN`, lines starting with # are ignored.
+ * Returns 1 on success, 0 on error. */
+int loadSavePolicy(const char* policyfile, struct SavePolicy* policy);
+void deallocSavePolicy(struct SavePolicy* policy);
+
+/* Save and load the game memory. policy can be NULL to save all sections */
+void saveState(pid_t game_pid, struct State* state, const struct SavePolicy* policy);
 void loadState(pid_t game_pid, struct State* state);
 void deallocState(struct State* state);
 
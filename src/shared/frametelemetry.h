@@ -0,0 +1,72 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_FRAMETELEMETRY_H_INCL
+#define LIBTAS_FRAMETELEMETRY_H_INCL
+
+#include <stdint.h>
+
+/* Number of buckets of the frame pacing jitter histogram.
+ * Bucket 0 is [0,1) us, bucket i is [2^(i-1),2^i) us, and the last
+ * bucket holds everything larger. */
+#define PACING_JITTER_BUCKETS 16
+
+/* Measurements of one frame, sent by the game to linTAS at the start
+ * of each frame boundary. All durations are in real time.
+ */
+struct FrameTelemetry {
+    /* Frame number */
+    uint64_t frame;
+
+    /* Time spent by the game between the end of the previous frame
+     * boundary and the start of this one */
+    uint64_t frame_ns;
+
+    /* CPU time of the main thread during the same interval */
+    uint64_t frame_cpu_ns;
+
+    /* Time spent in the previous frame boundary, mostly blocked
+     * by the frame pacing and by linTAS */
+    uint64_t boundary_ns;
+
+    /* Time spent mixing audio since the previous record */
+    uint64_t audio_mix_ns;
+
+    /* Time spent encoding this frame */
+    uint64_t encode_ns;
+
+    /* Number of events waiting in our event queue */
+    uint32_t event_queue_length;
+
+    /* Number of times the deterministic timer was force-advanced
+     * because the game queried the time too many times */
+    uint32_t forced_advances;
+
+    /* Is the frame boundary triggered by a draw */
+    uint32_t draw;
+
+    /* Was the previous frame boundary paced to the real time, and the
+     * delay after the deadline at which it woke up */
+    uint32_t paced;
+    uint32_t pacing_jitter_ns;
+
+    uint32_t reserved;
+};
+
+#endif
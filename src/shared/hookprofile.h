@@ -0,0 +1,46 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_HOOKPROFILE_H_INCL
+#define LIBTAS_HOOKPROFILE_H_INCL
+
+#include <stdint.h>
+
+/* Per-frame summary of the hooked function calls, sent by the game to
+ * linTAS when hook profiling is enabled.
+ */
+
+/* Number of latency buckets. Bucket 0 holds calls shorter than 1ns,
+ * and bucket b > 0 holds calls between 2^(b-1) and 2^b ns, the last
+ * bucket also holding all longer calls. */
+#define HOOKPROFILE_BUCKETS 32
+
+#define HOOKPROFILE_NAME_LEN 48
+
+/* Calls of one function from one thread during one frame */
+struct HookProfileEntry {
+    char name[HOOKPROFILE_NAME_LEN];
+    uint64_t thread;
+    uint64_t total_ns;
+    uint32_t calls;
+    uint32_t is_main;
+    uint32_t histogram[HOOKPROFILE_BUCKETS];
+};
+
+#endif
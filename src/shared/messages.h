@@ -76,6 +76,26 @@ enum {
      */
     MSGN_DUMP_FILE,
 
+    /*
+     * Send the video encoder and its options to the game
+     * Arguments: size_t (string length) then char[len] for the encoder name,
+     *            then the same for the options
+     */
+    MSGN_VIDEO_ENCODER,
+
+    /*
+     * Send the audio encoder and its options to the game
+     * Arguments: size_t (string length) then char[len] for the encoder name,
+     *            then the same for the options
+     */
+    MSGN_AUDIO_ENCODER,
+
+    /*
+     * Send the file where the audio samples of a raw dump are written
+     * Arguments: size_t (string length) then char[len]
+     */
+    MSGN_RAW_AUDIO_FILE,
+
     /*
      * Send the name of a shared library used by the game
      * Arguments: size_t (string length) then char[len]
@@ -87,6 +107,31 @@ enum {
      * Argument: int
      */
     MSGB_WINDOW_ID,
+
+    /*
+     * Send the trace file to the game, which enables tracing
+     * Arguments: size_t (string length) then char[len]
+     */
+    MSGN_TRACE_FILE,
+
+    /*
+     * Send the log file to the game, where logs are written instead of stderr
+     * Arguments: size_t (string length) then char[len]
+     */
+    MSGN_LOG_FILE,
+
+    /*
+     * The game sends the hook profiling summary of the frame,
+     * just before the frame boundary
+     * Arguments: int (number of entries) then struct HookProfileEntry[n]
+     */
+    MSGB_HOOK_PROFILE,
+
+    /*
+     * The game sends the telemetry of the frame, just before the frame boundary
+     * Argument: struct FrameTelemetry
+     */
+    MSGB_FRAME_TELEMETRY,
 };
 
 #endif
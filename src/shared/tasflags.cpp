@@ -21,14 +21,21 @@
 
 struct TasFlags tasflags = {
     running        : 0,
+    speed_multiplier : 1,
     speed_divisor  : 1,
     recording      : -1,
     fastforward    : 0,
+    fastforward_skip_draws : 1,
     includeFlags   : LCF_SDL | LCF_HOOK | LCF_SOCKET,
     //includeFlags   : LCF_FILEIO | LCF_ERROR,
     excludeFlags   : LCF_NONE,
     av_dumping     : 0,
     framerate      : 60,
-    numControllers : 1
+    numControllers : 1,
+    pacing_spin_margin : 1000,
+    hook_profiling : 0,
+    async_audio_mix : 0,
+    resample_quality : 2,
+    raw_dumping : 0
 }; 
 
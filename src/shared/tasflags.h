@@ -26,7 +26,11 @@ struct TasFlags {
     /* Is the game running or on pause */
     int running;
 
-    /* By how much is the speed reduced */
+    /* Speed of the game, as the ratio speed_multiplier / speed_divisor.
+     * Applied to the frame pacing of both timers.
+     * A speed_multiplier of 0 means that the speed is unbounded.
+     */
+    int speed_multiplier;
     int speed_divisor;
     
     /* Are the input recorded or played back
@@ -39,6 +43,10 @@ struct TasFlags {
     /* Is fastforward enabled */
     int fastforward;
 
+    /* During fastforward, elide the game draw calls of the frames
+     * that are not displayed */
+    int fastforward_skip_draws;
+
     /* Which flags trigger a debug message */
     LogCategoryFlag includeFlags;
 
@@ -56,6 +64,33 @@ struct TasFlags {
 
     /* Number of SDL controllers to (virtually) plug in */
     int numControllers;
+
+    /* When waiting for the next frame, time in microseconds before
+     * the deadline at which we stop sleeping and spin instead */
+    unsigned int pacing_spin_margin;
+
+    /* Count the calls of hooked functions and send a summary
+     * to linTAS at each frame */
+    int hook_profiling;
+
+    /* Mix the audio of a frame in a separate thread, while
+     * the game runs the next frame */
+    int async_audio_mix;
+
+    /* Quality of the audio resampling
+     * 0: nearest sample
+     * 1: linear interpolation
+     * 2: windowed sinc
+     */
+    int resample_quality;
+
+    /* Write the dump as raw frames and samples for an external encoder,
+     * instead of encoding it in the game
+     * 0: encode with FFmpeg
+     * 1: raw frames without header, readable as rawvideo
+     * 2: raw frames, each preceded by a RawFrameHeader
+     */
+    int raw_dumping;
 };
 
 extern struct TasFlags tasflags;
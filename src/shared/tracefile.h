@@ -0,0 +1,83 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_TRACEFILE_H_INCLUDED
+#define LIBTAS_TRACEFILE_H_INCLUDED
+
+#include <stdint.h>
+
+/* Binary format of the trace files written by libTAS.
+ *
+ * Trace events only store the index of their name, names are resolved
+ * when converting the file (see utils/trace2json.cpp). The file contains:
+ * - a TraceFileHeader
+ * - n_names names, each stored as a uint32_t length followed by the
+ *   characters, without the terminating null character
+ * - n_threads blocks, each being a TraceThreadHeader followed by
+ *   n_events TraceEvent, in chronological order
+ */
+
+#define TRACE_MAGIC "LTASTRC1"
+#define TRACE_VERSION 1
+
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_names;
+    uint32_t n_threads;
+    uint32_t reserved;
+};
+
+struct TraceThreadHeader {
+    /* Kernel thread id */
+    uint32_t tid;
+
+    /* Is it the main thread of the game? */
+    uint32_t is_main;
+
+    /* Number of events stored after this header */
+    uint64_t n_events;
+
+    /* Number of older events that were overwritten */
+    uint64_t n_dropped;
+};
+
+enum TracePhase {
+    TRACE_BEGIN = 0,
+    TRACE_END = 1,
+    TRACE_INSTANT = 2
+};
+
+struct TraceEvent {
+    /* Monotonic time in nanoseconds */
+    uint64_t time;
+
+    /* Optional argument of the event */
+    uint32_t arg;
+
+    /* Index of the event name */
+    uint16_t name;
+
+    /* TracePhase */
+    uint8_t phase;
+
+    uint8_t reserved;
+};
+
+#endif
@@ -0,0 +1,477 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark and conformance check of the audio mixing code of libTAS.
+ * Each scenario fills the audio context with synthetic sources of every
+ * sample format, rate and channel count, static or queued, looping or not,
+ * then mixes them for a number of frames. The mixed output is hashed and,
+ * with the default parameters, compared to known hashes so that a change
+ * of the mixing code that alters the sound is detected.
+ * The known hashes were recorded with the float mixer and the built-in
+ * resampler, so they only guard against later changes. They do not show
+ * that the output matches the earlier libswresample based mixer, which
+ * cannot run this benchmark.
+ * Results are printed as a single JSON object on stdout, and the program
+ * exits with an error if a hash does not match.
+ *
+ * Built with cmake -DENABLE_BENCHMARKS=ON
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "../src/libTAS/audio/AudioContext.h"
+#include "../src/libTAS/audio/AudioPlayer.h"
+#include "../src/libTAS/audio/Resampler.h"
+#include "../src/libTAS/DeterministicTimer.h"
+#include "../src/libTAS/LogSink.h"
+#include "../src/libTAS/ThreadState.h"
+#include "../src/libTAS/logging.h"
+#include "../src/libTAS/threads.h"
+#include "../src/libTAS/telemetry.h"
+#include "../src/libTAS/trace.h"
+#include "../src/shared/tasflags.h"
+
+/*
+ * Replacements of the libTAS functions used by the audio code, which is
+ * built here outside of the library. Nothing is logged, traced or sent
+ * to the audio device, and the real thread functions are used.
+ */
+DeterministicTimer detTimer;
+void DeterministicTimer::fakeAdvanceTimer(struct timespec) {}
+
+LogSink logSink;
+void LogSink::write(const std::string&, bool) {}
+
+std::atomic<LogCategoryFlag> logIncludeFlags(LCF_NONE);
+std::atomic<LogCategoryFlag> logExcludeFlags(LCF_NONE);
+void debuglogverbose(LogCategoryFlag, std::string, std::string&) {}
+
+thread_local ThreadState threadState;
+void ThreadState::setNative(bool) {}
+void ThreadState::setNoLog(bool) {}
+bool ThreadState::isNoLog(void) { return true; }
+
+int (*pthread_create_real) (pthread_t*, const pthread_attr_t*, void* (*) (void*), void*) = pthread_create;
+int (*pthread_join_real) (unsigned long int, void**) = pthread_join;
+
+std::atomic<uint64_t> telemetryAudioMixNs(0);
+uint64_t telemetryNow(clockid_t) { return 0; }
+
+std::atomic<bool> tracing(false);
+uint16_t traceRegisterName(const char*) { return 0; }
+void traceEvent(uint16_t, uint8_t, uint32_t) {}
+
+#ifdef LIBTAS_ENABLE_SOUNDPLAYBACK
+AudioPlayer audioplayer;
+AudioPlayer::AudioPlayer() {}
+AudioPlayer::~AudioPlayer() {}
+bool AudioPlayer::play(AudioContext&) { return true; }
+#endif
+
+/* Length of a frame. Chosen so that a frame is an integer number of
+ * samples for the usual frequencies, which makes the mix of a frame
+ * independent of the previous scenarios. */
+#define FRAME_NSEC 20000000
+
+/* Number of samples in a compressed block */
+#define MSADPCM_BLOCK_SAMPLES 128
+
+struct SourceConfig {
+    SampleFormat format;
+    int nbChannels;
+    int frequency;
+    SourceType type;
+    bool looping;
+};
+
+struct Scenario {
+    const char* name;
+    int nbSources;
+    /* Sources cycle through these configurations */
+    std::vector<SourceConfig> configs;
+    /* Hash of the output for the default parameters and each
+     * resampling quality, recorded with the current mixer */
+    uint64_t golden[3];
+};
+
+struct BenchConfig {
+    int n_frames;
+    int quality;
+    int async;
+    int frequency;
+    int channels;
+    int print_hashes;
+};
+
+/* Default parameters, for which the golden hashes are valid */
+#define DEFAULT_FRAMES 3000
+#define DEFAULT_FREQUENCY 44100
+#define DEFAULT_CHANNELS 2
+
+/* Simple deterministic generator, so that runs are comparable */
+static uint64_t lcg_next(uint64_t* state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+/* FNV-1a hash of the mixed samples */
+static uint64_t hash_bytes(uint64_t hash, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Build uncompressed samples of a triangle wave with a bit of noise,
+ * using only exact operations so that the input does not depend on
+ * the math library. */
+static void generate_pcm(std::vector<uint8_t>& data, const SourceConfig& config, int frames, int period, uint64_t* seed)
+{
+    int sampleBytes = 1;
+    switch (config.format) {
+        case SAMPLE_FMT_S16: sampleBytes = 2; break;
+        case SAMPLE_FMT_S32: case SAMPLE_FMT_FLT: sampleBytes = 4; break;
+        case SAMPLE_FMT_DBL: sampleBytes = 8; break;
+        default: break;
+    }
+    data.resize(frames * config.nbChannels * sampleBytes);
+    uint8_t* out = data.data();
+
+    for (int f = 0; f < frames; f++) {
+        for (int ch = 0; ch < config.nbChannels; ch++) {
+            int phase = (f + ch * period / 4) % period;
+            int tri = (phase < period / 2) ? phase : (period - phase);
+            double v = (4.0 * tri / period - 1.0) * 0.5;
+            v += ((int)(lcg_next(seed) % 1001) - 500) * 0.00002;
+
+            switch (config.format) {
+                case SAMPLE_FMT_U8:
+                    *out = (uint8_t)(128 + (int)(v * 127));
+                    break;
+                case SAMPLE_FMT_S16: {
+                    int16_t s = (int16_t)(v * 32767);
+                    memcpy(out, &s, 2);
+                    break;
+                }
+                case SAMPLE_FMT_S32: {
+                    int32_t s = (int32_t)(v * 2147483647.0);
+                    memcpy(out, &s, 4);
+                    break;
+                }
+                case SAMPLE_FMT_FLT: {
+                    float s = (float)v;
+                    memcpy(out, &s, 4);
+                    break;
+                }
+                case SAMPLE_FMT_DBL:
+                    memcpy(out, &v, 8);
+                    break;
+                default:
+                    break;
+            }
+            out += sampleBytes;
+        }
+    }
+}
+
+/* Build MS-ADPCM blocks with valid headers and random nibbles */
+static void generate_msadpcm(std::vector<uint8_t>& data, const SourceConfig& config, int frames, uint64_t* seed)
+{
+    int nbBlocks = frames / MSADPCM_BLOCK_SAMPLES;
+    int blockSize = config.nbChannels * (7 + (MSADPCM_BLOCK_SAMPLES - 2) / 2);
+    data.resize(nbBlocks * blockSize);
+
+    for (int b = 0; b < nbBlocks; b++) {
+        uint8_t* block = data.data() + b * blockSize;
+        int pos = 0;
+        for (int ch = 0; ch < config.nbChannels; ch++)
+            block[pos++] = lcg_next(seed) % 7;
+        for (int ch = 0; ch < config.nbChannels; ch++) {
+            int16_t delta = 16 + lcg_next(seed) % 256;
+            memcpy(block + pos, &delta, 2);
+            pos += 2;
+        }
+        for (int s = 0; s < 2 * config.nbChannels; s++) {
+            int16_t sample = (int16_t)((int)(lcg_next(seed) % 8193) - 4096);
+            memcpy(block + pos, &sample, 2);
+            pos += 2;
+        }
+        for (; pos < blockSize; pos++)
+            block[pos] = lcg_next(seed) & 0xff;
+    }
+}
+
+/* Create a buffer filled with synthetic samples, lasting about
+ * the given number of milliseconds */
+static int create_buffer(const SourceConfig& config, int ms, int period, uint64_t* seed)
+{
+    int id = audiocontext.createBuffer();
+    AudioBuffer* ab = audiocontext.getBuffer(id);
+    ab->format = config.format;
+    ab->nbChannels = config.nbChannels;
+    ab->frequency = config.frequency;
+    ab->blockSamples = MSADPCM_BLOCK_SAMPLES;
+
+    /* Odd lengths, so that loops do not end on frame boundaries */
+    int frames = config.frequency * ms / 1000 + 7;
+
+    std::vector<uint8_t> data;
+    if (config.format == SAMPLE_FMT_MSADPCM)
+        generate_msadpcm(data, config, frames, seed);
+    else
+        generate_pcm(data, config, frames, period, seed);
+
+    ab->setSamples(data.data(), data.size());
+    ab->update();
+    return id;
+}
+
+static double elapsed(const struct timespec* start, const struct timespec* end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double percentile(std::vector<double> values, double pct)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(pct * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static std::vector<Scenario> build_scenarios(void)
+{
+    std::vector<Scenario> scenarios;
+
+    scenarios.push_back({"static_u8_mono_11025", 1,
+        {{SAMPLE_FMT_U8, 1, 11025, SOURCE_STATIC, true}},
+        {0x2ecc391938798a15ULL, 0x4ce706031b1f262dULL, 0xfa87fa5213557489ULL}});
+    scenarios.push_back({"static_s16_stereo_22050", 1,
+        {{SAMPLE_FMT_S16, 2, 22050, SOURCE_STATIC, true}},
+        {0x0100e7dfc7e8bf84ULL, 0xc47aab9f3685e760ULL, 0xd1906ac73594fe0aULL}});
+    scenarios.push_back({"static_s16_stereo_44100_once", 1,
+        {{SAMPLE_FMT_S16, 2, 44100, SOURCE_STATIC, false}},
+        {0x4ba40d175dbb71d5ULL, 0x4ba40d175dbb71d5ULL, 0x4ba40d175dbb71d5ULL}});
+    scenarios.push_back({"static_s32_mono_48000", 1,
+        {{SAMPLE_FMT_S32, 1, 48000, SOURCE_STATIC, true}},
+        {0x1eb393e41a197cbdULL, 0xcbf690e3d8843f45ULL, 0x4cc5d03abf62eeadULL}});
+    scenarios.push_back({"static_flt_stereo_44100", 1,
+        {{SAMPLE_FMT_FLT, 2, 44100, SOURCE_STATIC, true}},
+        {0x3c8425400f12b467ULL, 0x3c8425400f12b467ULL, 0x3c8425400f12b467ULL}});
+    scenarios.push_back({"static_dbl_mono_32000", 1,
+        {{SAMPLE_FMT_DBL, 1, 32000, SOURCE_STATIC, true}},
+        {0x84b40b3dda12f951ULL, 0xb3c4b35a2360f4adULL, 0xbdd840468af9c919ULL}});
+    scenarios.push_back({"static_msadpcm_mono_22050", 1,
+        {{SAMPLE_FMT_MSADPCM, 1, 22050, SOURCE_STATIC, true}},
+        {0x9e2a81b5850adc45ULL, 0xd86c08ece62f400dULL, 0x22894c24e89f0a7dULL}});
+    scenarios.push_back({"static_msadpcm_stereo_44100", 1,
+        {{SAMPLE_FMT_MSADPCM, 2, 44100, SOURCE_STATIC, true}},
+        {0x4aec21a13484630eULL, 0x4aec21a13484630eULL, 0x4aec21a13484630eULL}});
+    scenarios.push_back({"queued_s16_stereo_44100", 1,
+        {{SAMPLE_FMT_S16, 2, 44100, SOURCE_STREAMING, true}},
+        {0x01365ca89bcb0bd3ULL, 0x01365ca89bcb0bd3ULL, 0x01365ca89bcb0bd3ULL}});
+    scenarios.push_back({"queued_s16_mono_22050", 1,
+        {{SAMPLE_FMT_S16, 1, 22050, SOURCE_STREAMING, true}},
+        {0x34653c515c8a5eb1ULL, 0x28440644b2b172bdULL, 0x6f6484f0681e9295ULL}});
+    scenarios.push_back({"queued_flt_stereo_48000_once", 1,
+        {{SAMPLE_FMT_FLT, 2, 48000, SOURCE_STREAMING, false}},
+        {0x14303ce901230a0cULL, 0x0d6d20a607ac44e9ULL, 0xe27303bf854c1900ULL}});
+    scenarios.push_back({"queued_msadpcm_stereo_22050", 1,
+        {{SAMPLE_FMT_MSADPCM, 2, 22050, SOURCE_STREAMING, true}},
+        {0xfa292ba9b1bc062aULL, 0xa8bad58a6a9b5c84ULL, 0xa690099795f2da7fULL}});
+
+    /* Many sources of all kinds playing together, as in a busy game */
+    Scenario mixed = {"mixed_64", 64, {},
+        {0x1c838e87e87c62a9ULL, 0xe159a7664442f6f4ULL, 0x504c5c56c98cd9a8ULL}};
+    for (size_t s = 0; s < scenarios.size(); s++)
+        mixed.configs.push_back(scenarios[s].configs[0]);
+    scenarios.push_back(mixed);
+
+    return scenarios;
+}
+
+/* Run a scenario and return the hash of the whole output */
+static uint64_t run_scenario(const Scenario& scenario, const BenchConfig& config, std::vector<double>& times, double& samples)
+{
+    uint64_t seed = 42;
+    std::vector<int> sourceIds, bufferIds;
+
+    for (int s = 0; s < scenario.nbSources; s++) {
+        const SourceConfig& sc = scenario.configs[s % scenario.configs.size()];
+        int period = 50 + 37 * s;
+
+        int sid = audiocontext.createSource();
+        AudioSource* as = audiocontext.getSource(sid);
+        as->source = sc.type;
+        as->looping = sc.looping;
+        as->volume = 1.0f / (1 + s % 4);
+
+        /* Static sources have a single long buffer, streaming ones
+         * a queue of short buffers */
+        int nbBuffers = (sc.type == SOURCE_STATIC) ? 1 : 4;
+        int ms = (sc.type == SOURCE_STATIC) ? 1300 : 170;
+        for (int b = 0; b < nbBuffers; b++) {
+            int bid = create_buffer(sc, ms, period, &seed);
+            bufferIds.push_back(bid);
+            as->buffer_queue.push_back(audiocontext.getBuffer(bid));
+        }
+
+        audiocontext.playSource(as);
+        sourceIds.push_back(sid);
+    }
+
+    struct timespec ticks = {0, FRAME_NSEC};
+    uint64_t hash = 14695981039346656037ULL;
+    for (int f = 0; f < config.n_frames; f++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        audiocontext.mixAllSources(ticks);
+        audiocontext.waitMix();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        times.push_back(elapsed(&t0, &t1));
+        samples += audiocontext.outNbSamples;
+        hash = hash_bytes(hash, audiocontext.outSamples.data(), audiocontext.outBytes);
+    }
+
+    for (int sid : sourceIds)
+        audiocontext.deleteSource(sid);
+    for (int bid : bufferIds)
+        audiocontext.deleteBuffer(bid);
+
+    return hash;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -n N     Number of frames of each scenario (default %d)\n", DEFAULT_FRAMES);
+    fprintf(stderr, "  -q N     Resampling quality: 0 (nearest), 1 (linear), 2 (sinc) (default 2)\n");
+    fprintf(stderr, "  -f N     Frequency of the output (default %d)\n", DEFAULT_FREQUENCY);
+    fprintf(stderr, "  -c N     Number of channels of the output (default %d)\n", DEFAULT_CHANNELS);
+    fprintf(stderr, "  -a       Mix the audio in a separate thread\n");
+    fprintf(stderr, "  -g       Print the hashes in the format of the golden table\n");
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config = {DEFAULT_FRAMES, RESAMPLE_SINC, 0, DEFAULT_FREQUENCY, DEFAULT_CHANNELS, 0};
+
+    int c;
+    while ((c = getopt (argc, argv, "n:q:f:c:agh")) != -1)
+        switch (c) {
+            case 'n':
+                config.n_frames = atoi(optarg);
+                break;
+            case 'q':
+                config.quality = atoi(optarg);
+                break;
+            case 'f':
+                config.frequency = atoi(optarg);
+                break;
+            case 'c':
+                config.channels = atoi(optarg);
+                break;
+            case 'a':
+                config.async = 1;
+                break;
+            case 'g':
+                config.print_hashes = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+
+    if ((config.n_frames <= 0) || (config.quality < RESAMPLE_NEAREST) || (config.quality > RESAMPLE_SINC) ||
+        (config.frequency <= 0) || (config.channels < 1) || (config.channels > 2)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    tasflags.resample_quality = config.quality;
+    tasflags.async_audio_mix = config.async;
+    audiocontext.outFrequency = config.frequency;
+    audiocontext.outNbChannels = config.channels;
+    audiocontext.outAlignSize = config.channels * audiocontext.outBitDepth / 8;
+
+    /* Golden hashes are only known for the default output */
+    bool check = (config.n_frames == DEFAULT_FRAMES) && (config.frequency == DEFAULT_FREQUENCY) &&
+                 (config.channels == DEFAULT_CHANNELS);
+
+    std::vector<Scenario> scenarios = build_scenarios();
+    int failures = 0;
+
+    printf("{\n");
+    printf("  \"frames\": %d,\n", config.n_frames);
+    printf("  \"frequency\": %d,\n", config.frequency);
+    printf("  \"channels\": %d,\n", config.channels);
+    printf("  \"quality\": %d,\n", config.quality);
+    printf("  \"async\": %d,\n", config.async);
+    printf("  \"scenarios\": {\n");
+
+    for (size_t s = 0; s < scenarios.size(); s++) {
+        const Scenario& scenario = scenarios[s];
+        std::vector<double> times;
+        double samples = 0;
+        uint64_t hash = run_scenario(scenario, config, times, samples);
+
+        double sum = 0;
+        for (double t : times)
+            sum += t;
+
+        const char* status = "unchecked";
+        if (check) {
+            if (hash == scenario.golden[config.quality])
+                status = "ok";
+            else {
+                status = "mismatch";
+                failures++;
+            }
+        }
+
+        printf("    \"%s\": {\"sources\": %d, \"samples_per_sec\": %.0f, \"p50_us\": %.2f, \"p99_us\": %.2f, \"hash\": \"%016llx\", \"status\": \"%s\"}%s\n",
+                scenario.name, scenario.nbSources, (sum > 0) ? (samples / sum) : 0,
+                percentile(times, 0.50) * 1e6, percentile(times, 0.99) * 1e6,
+                (unsigned long long) hash, status, (s + 1 < scenarios.size()) ? "," : "");
+
+        if (config.print_hashes)
+            fprintf(stderr, "%s: 0x%016llxULL\n", scenario.name, (unsigned long long) hash);
+    }
+
+    printf("  },\n");
+    printf("  \"failures\": %d\n", failures);
+    printf("}\n");
+
+    audiocontext.stopMixThread();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,340 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark of the savestate code of linTAS.
+ * A synthetic child process is spawned with a configurable memory layout,
+ * then we repeatedly dirty part of its memory and save its state, then
+ * dirty it again and load the state, which must restore the dirty pages.
+ * Results are printed as a single JSON object on stdout.
+ *
+ * Built with cmake -DENABLE_BENCHMARKS=ON
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <vector>
+#include <algorithm>
+#include "../src/linTAS/savestates.h"
+
+struct BenchConfig {
+    int n_mappings;
+    size_t total_size;
+    double dirty_fraction;
+    double zero_fraction;
+    int n_threads;
+    int n_iterations;
+    const char* policyfile;
+    int verbose;
+};
+
+/* Commands sent by the benchmark to the child */
+enum {
+    CHILD_DIRTY = 'd',
+    CHILD_QUIT = 'q'
+};
+
+static void* idle_thread(void*)
+{
+    while (1)
+        pause();
+    return NULL;
+}
+
+/* Simple deterministic generator, so that runs are comparable */
+static uint64_t lcg_next(uint64_t* state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+static void fill_page(char* page, size_t pagesize, uint64_t* seed)
+{
+    uint64_t* words = (uint64_t*) page;
+    for (size_t w = 0; w < pagesize / sizeof(uint64_t); w++)
+        words[w] = (lcg_next(seed) << 32) | lcg_next(seed);
+}
+
+/* Code executed by the synthetic game process */
+static void run_child(const BenchConfig* config, int cmdfd, int ackfd)
+{
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t map_size = config->total_size / config->n_mappings;
+    map_size -= map_size % pagesize;
+    size_t n_pages = map_size / pagesize;
+    uint64_t seed = 42;
+
+    std::vector<char*> mappings;
+    for (int m = 0; m < config->n_mappings; m++) {
+        char* mem = (char*) mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            fprintf(stderr, "mmap failed\n");
+            _exit(1);
+        }
+
+        /* Populate all pages, leaving a fraction of them filled with zeros */
+        for (size_t p = 0; p < n_pages; p++) {
+            if ((lcg_next(&seed) % 1000) < config->zero_fraction * 1000)
+                mem[p * pagesize] = 0;
+            else
+                fill_page(mem + p * pagesize, pagesize, &seed);
+        }
+        mappings.push_back(mem);
+    }
+
+    for (int t = 0; t < config->n_threads; t++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, idle_thread, NULL);
+    }
+
+    char cmd = 0;
+    write(ackfd, &cmd, 1);
+
+    while (read(cmdfd, &cmd, 1) == 1) {
+        if (cmd == CHILD_QUIT)
+            break;
+
+        if (cmd == CHILD_DIRTY) {
+            for (char* mem : mappings) {
+                for (size_t p = 0; p < n_pages; p++) {
+                    if ((lcg_next(&seed) % 1000) < config->dirty_fraction * 1000)
+                        fill_page(mem + p * pagesize, pagesize, &seed);
+                }
+            }
+        }
+        write(ackfd, &cmd, 1);
+    }
+    _exit(0);
+}
+
+/*
+ * Wait for the child to be blocked reading the next command.
+ * As in linTAS, where states are saved and loaded when the game is waiting
+ * at a frame boundary, the child must be at the same point of execution
+ * when saving and loading, otherwise we would restore a stack that does not
+ * match its current registers.
+ */
+static void wait_child_blocked(pid_t child_pid)
+{
+    char syscallfilename[64];
+    sprintf(syscallfilename, "/proc/%d/syscall", child_pid);
+
+    while (1) {
+        FILE* syscallfile = fopen(syscallfilename, "r");
+        if (syscallfile == NULL)
+            return;
+        long syscall_nr = -1;
+        int ret = fscanf(syscallfile, "%ld", &syscall_nr);
+        fclose(syscallfile);
+        if ((ret == 1) && (syscall_nr == SYS_read))
+            return;
+        usleep(100);
+    }
+}
+
+/* Ask the child to modify part of its memory, and wait until it is done */
+static void dirty_child(pid_t child_pid, int cmdfd, int ackfd)
+{
+    char cmd = CHILD_DIRTY;
+    write(cmdfd, &cmd, 1);
+    read(ackfd, &cmd, 1);
+    wait_child_blocked(child_pid);
+}
+
+static double elapsed(const struct timespec* start, const struct timespec* end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double percentile(std::vector<double> values, double pct)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(pct * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static void print_stats(const char* name, const std::vector<double>& times, double bytes, int last)
+{
+    double sum = 0;
+    for (double t : times)
+        sum += t;
+
+    printf("  \"%s\": {\"throughput_gbps\": %.3f, \"p50_ms\": %.3f, \"p99_ms\": %.3f}%s\n",
+            name, (sum > 0) ? (bytes * times.size() / sum / 1e9) : 0,
+            percentile(times, 0.50) * 1e3, percentile(times, 0.99) * 1e3,
+            last ? "" : ",");
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -m N     Number of mappings (default 16)\n");
+    fprintf(stderr, "  -s MB    Total size of the mappings in MB (default 256)\n");
+    fprintf(stderr, "  -d F     Fraction of pages dirtied at each iteration (default 0.1)\n");
+    fprintf(stderr, "  -z F     Fraction of pages containing zeros (default 0.25)\n");
+    fprintf(stderr, "  -t N     Number of threads of the child (default 1)\n");
+    fprintf(stderr, "  -n N     Number of iterations (default 20)\n");
+    fprintf(stderr, "  -p FILE  Savestate policy file\n");
+    fprintf(stderr, "  -v       Show the savestate logs\n");
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config = {16, 256ULL << 20, 0.1, 0.25, 1, 20, NULL, 0};
+
+    int c;
+    while ((c = getopt (argc, argv, "m:s:d:z:t:n:p:vh")) != -1)
+        switch (c) {
+            case 'm':
+                config.n_mappings = atoi(optarg);
+                break;
+            case 's':
+                config.total_size = strtoull(optarg, NULL, 10) << 20;
+                break;
+            case 'd':
+                config.dirty_fraction = atof(optarg);
+                break;
+            case 'z':
+                config.zero_fraction = atof(optarg);
+                break;
+            case 't':
+                config.n_threads = atoi(optarg);
+                break;
+            case 'n':
+                config.n_iterations = atoi(optarg);
+                break;
+            case 'p':
+                config.policyfile = optarg;
+                break;
+            case 'v':
+                config.verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+
+    if ((config.n_mappings <= 0) || (config.n_iterations <= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct SavePolicy policy = {0, NULL};
+    if (config.policyfile && !loadSavePolicy(config.policyfile, &policy))
+        return 1;
+
+    int cmdpipe[2], ackpipe[2];
+    if (pipe(cmdpipe) || pipe(ackpipe)) {
+        fprintf(stderr, "Could not create pipes\n");
+        return 1;
+    }
+
+    pid_t child_pid = fork();
+    if (child_pid == 0) {
+        close(cmdpipe[1]);
+        close(ackpipe[0]);
+        run_child(&config, cmdpipe[0], ackpipe[1]);
+    }
+    close(cmdpipe[0]);
+    close(ackpipe[1]);
+
+    /* Wait for the child to populate its memory */
+    char cmd;
+    if (read(ackpipe[0], &cmd, 1) != 1) {
+        fprintf(stderr, "Child process failed\n");
+        return 1;
+    }
+
+    /* The savestate code is very verbose on stderr */
+    int stderr_fd = dup(2);
+    FILE* devnull = fopen("/dev/null", "w");
+
+    std::vector<double> save_times, load_times;
+    unsigned long long state_size = 0;
+
+    for (int i = 0; i < config.n_iterations; i++) {
+        dirty_child(child_pid, cmdpipe[1], ackpipe[0]);
+
+        if (!config.verbose)
+            dup2(fileno(devnull), 2);
+
+        struct State state = {};
+        struct timespec t0, t1, t2, t3;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        saveState(child_pid, &state, config.policyfile ? &policy : NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        /* Modify the memory after the save, so that the load has pages
+         * to restore */
+        dirty_child(child_pid, cmdpipe[1], ackpipe[0]);
+
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        loadState(child_pid, &state);
+        clock_gettime(CLOCK_MONOTONIC, &t3);
+
+        if (!config.verbose)
+            dup2(stderr_fd, 2);
+
+        save_times.push_back(elapsed(&t0, &t1));
+        load_times.push_back(elapsed(&t2, &t3));
+        state_size = state.total_size;
+        deallocState(&state);
+    }
+
+    cmd = CHILD_QUIT;
+    write(cmdpipe[1], &cmd, 1);
+    waitpid(child_pid, NULL, 0);
+
+    /* Peak memory of the child, which includes the pages restored by loads */
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    /* Throughput is computed on the size of the synthetic game memory */
+    double bytes = config.total_size;
+
+    printf("{\n");
+    printf("  \"mappings\": %d,\n", config.n_mappings);
+    printf("  \"total_size\": %zu,\n", config.total_size);
+    printf("  \"dirty_fraction\": %.3f,\n", config.dirty_fraction);
+    printf("  \"zero_fraction\": %.3f,\n", config.zero_fraction);
+    printf("  \"threads\": %d,\n", config.n_threads);
+    printf("  \"iterations\": %d,\n", config.n_iterations);
+    printf("  \"state_size\": %llu,\n", state_size);
+    printf("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+    print_stats("save", save_times, bytes, 0);
+    print_stats("load", load_times, bytes, 1);
+    printf("}\n");
+
+    fclose(devnull);
+    close(stderr_fd);
+    deallocSavePolicy(&policy);
+    return 0;
+}
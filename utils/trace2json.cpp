@@ -0,0 +1,157 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Convert a binary trace file written by libTAS into the Chrome trace
+ * event format (JSON), which can be opened in chrome://tracing or Perfetto.
+ *
+ * Usage: trace2json trace_file [json_file]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include "../src/shared/tracefile.h"
+
+static void print_escaped(FILE* out, const std::string& str)
+{
+    for (char c : str) {
+        if ((c == '"') || (c == '\\'))
+            fputc('\\', out);
+        if ((unsigned char)c < 0x20)
+            continue;
+        fputc(c, out);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "Usage: %s trace_file [json_file]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (argc == 3) {
+        out = fopen(argv[2], "w");
+        if (!out) {
+            fprintf(stderr, "Could not open %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    struct TraceFileHeader header;
+    if ((fread(&header, sizeof(header), 1, in) != 1) ||
+        (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)) {
+        fprintf(stderr, "%s is not a libTAS trace file\n", argv[1]);
+        return 1;
+    }
+    if (header.version != TRACE_VERSION) {
+        fprintf(stderr, "Unsupported trace version %u\n", header.version);
+        return 1;
+    }
+
+    /* Read the event names */
+    std::vector<std::string> names;
+    for (uint32_t n = 0; n < header.n_names; n++) {
+        uint32_t len;
+        if (fread(&len, sizeof(len), 1, in) != 1) {
+            fprintf(stderr, "Truncated trace file\n");
+            return 1;
+        }
+        std::string name(len, '\0');
+        if (len && (fread(&name[0], 1, len, in) != len)) {
+            fprintf(stderr, "Truncated trace file\n");
+            return 1;
+        }
+        names.push_back(name);
+    }
+
+    /* Timestamps are printed relative to the first event */
+    std::vector<TraceThreadHeader> threads;
+    std::vector<std::vector<TraceEvent>> events;
+    uint64_t start_time = UINT64_MAX;
+    for (uint32_t t = 0; t < header.n_threads; t++) {
+        struct TraceThreadHeader thheader;
+        if (fread(&thheader, sizeof(thheader), 1, in) != 1) {
+            fprintf(stderr, "Truncated trace file\n");
+            return 1;
+        }
+        std::vector<TraceEvent> thevents(thheader.n_events);
+        if (fread(thevents.data(), sizeof(TraceEvent), thheader.n_events, in) != thheader.n_events) {
+            fprintf(stderr, "Truncated trace file\n");
+            return 1;
+        }
+        if (!thevents.empty() && (thevents[0].time < start_time))
+            start_time = thevents[0].time;
+        threads.push_back(thheader);
+        events.push_back(thevents);
+    }
+    fclose(in);
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    bool first = true;
+
+    for (size_t t = 0; t < threads.size(); t++) {
+        /* Thread name */
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+            first ? "" : ",\n", threads[t].tid, threads[t].is_main ? "Main thread" : "Thread", threads[t].tid);
+        first = false;
+
+        if (threads[t].n_dropped)
+            fprintf(stderr, "Thread %u: %llu older events were overwritten\n",
+                threads[t].tid, (unsigned long long)threads[t].n_dropped);
+
+        /* If the ring buffer has wrapped, the first events may be the end
+         * of scopes whose beginning was overwritten, so we skip them */
+        int depth = 0;
+        for (const TraceEvent& ev : events[t]) {
+            if (ev.phase == TRACE_END) {
+                if (depth == 0)
+                    continue;
+                depth--;
+            }
+            if (ev.phase == TRACE_BEGIN)
+                depth++;
+
+            const char* phase = (ev.phase == TRACE_BEGIN) ? "B" : ((ev.phase == TRACE_END) ? "E" : "i");
+            fprintf(out, ",\n{\"name\":\"");
+            if (ev.name < names.size())
+                print_escaped(out, names[ev.name]);
+            fprintf(out, "\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u", phase,
+                (ev.time - start_time) / 1000.0, threads[t].tid);
+            if (ev.phase == TRACE_INSTANT)
+                fprintf(out, ",\"s\":\"t\",\"args\":{\"arg\":%u}", ev.arg);
+            fprintf(out, "}");
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}